@@ -1,12 +1,17 @@
 import AppKit
 
 
-/// Manages the "Add Feed" window (run as a sheet)
+/// Manages the "Add Feed" window (run as a sheet), which is also used to edit feeds
 class AddFeedController: NSWindowController {
   @IBOutlet private weak var feedNameTextField: NSTextField!
   @IBOutlet private weak var feedURLTextField: NSTextField!
+  @IBOutlet private weak var includesTextField: NSTextField!
+  @IBOutlet private weak var excludesTextField: NSTextField!
   @IBOutlet private weak var addButton: NSButton!
   
+  /// The feed being edited, nil when adding a new one
+  private var editedFeed: Feed? = nil
+  
   override func awakeFromNib() {
     refresh()
   }
@@ -22,11 +27,38 @@ class AddFeedController: NSWindowController {
     window.sheetParent?.endSheet(window)
   }
   
+  /// Gets the sheet ready to add a new feed
   func clear() {
+    editedFeed = nil
     feedNameTextField.stringValue = ""
     feedURLTextField.stringValue = ""
+    includesTextField.stringValue = ""
+    excludesTextField.stringValue = ""
+    addButton.title = NSLocalizedString("Add Feed", comment: "")
+    refresh()
+    window?.makeFirstResponder(feedNameTextField)
+  }
+  
+  /// Gets the sheet ready to edit `feed`. Only title substring rules of its
+  /// filter are shown, other rules are kept as they are.
+  func edit(_ feed: Feed) {
+    editedFeed = feed
+    feedNameTextField.stringValue = feed.name
+    feedURLTextField.stringValue = feed.url.absoluteString
+    includesTextField.stringValue = feed.filter.includedTitleSubstrings.joined(separator: ", ")
+    excludesTextField.stringValue = feed.filter.excludedTitleSubstrings.joined(separator: ", ")
+    addButton.title = NSLocalizedString("OK", comment: "")
+    refresh()
     window?.makeFirstResponder(feedNameTextField)
   }
+  
+  /// The comma-separated, non-empty values in `textField`
+  private func titleSubstrings(in textField: NSTextField) -> [String] {
+    return textField.stringValue
+      .split(separator: ",")
+      .map { $0.trimmingCharacters(in: .whitespaces) }
+      .filter { !$0.isEmpty }
+  }
 }
 
 
@@ -43,9 +75,17 @@ extension AddFeedController {
       return
     }
     
-    let newFeed = Feed(name: feedName, url: feedURL)
+    var filter = editedFeed?.filter ?? EpisodeFilter()
+    filter.includedTitleSubstrings = titleSubstrings(in: includesTextField)
+    filter.excludedTitleSubstrings = titleSubstrings(in: excludesTextField)
     
-    Defaults.shared.feeds.append(newFeed)
+    let newFeed = Feed(name: feedName, url: feedURL, filter: filter, folder: editedFeed?.folder ?? [])
+    
+    if let editedFeed = editedFeed, let index = Defaults.shared.feeds.firstIndex(where: { $0.id == editedFeed.id }) {
+      Defaults.shared.feeds[index] = newFeed
+    } else {
+      Defaults.shared.feeds.append(newFeed)
+    }
     
     dismiss()
   }
@@ -3,6 +3,8 @@ import AppKit
 
 class AddFeedView: NSView {
   @IBOutlet weak var feedNameField: NSTextField!
+  @IBOutlet weak var includesField: NSTextField!
+  @IBOutlet weak var excludesField: NSTextField!
   
   @IBOutlet weak var addButton: NSButton!
   @IBOutlet weak var cancelButton: NSButton!
@@ -11,6 +13,8 @@ class AddFeedView: NSView {
     super.awakeFromNib()
     
     feedNameField.placeholderString = NSLocalizedString("Feed Name", comment: "")
+    includesField.placeholderString = NSLocalizedString("Only download titles containing (comma-separated)", comment: "")
+    excludesField.placeholderString = NSLocalizedString("Skip titles containing (comma-separated)", comment: "")
 
     addButton.title = NSLocalizedString("Add Feed", comment: "")
     cancelButton.title = NSLocalizedString("Cancel", comment: "")
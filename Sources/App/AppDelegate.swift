@@ -11,8 +11,11 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
   }
   
   func applicationWillTerminate(_: Notification) {
-    // Persist defaults before quitting
-    Defaults.shared.save()
+    // Don't leave the Feed Helper downloading for nobody
+    FeedChecker.shared.cancelCheck()
+    
+    // Persist defaults and history before quitting
+    Defaults.shared.save(waitingForHistory: true)
   }
 }
 
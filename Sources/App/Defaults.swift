@@ -12,7 +12,7 @@ private extension Int {
 }
 
 
-/// Singleton. Wrapper around UserDefaults.standard that provides a nice interface to the app's preferences
+/// Singleton. Wrapper around `UserDefaults` that provides a nice interface to the app's preferences
 /// and download history data.
 final class Defaults: NSObject {
   static let shared = Defaults()
@@ -20,8 +20,10 @@ final class Defaults: NSObject {
   /// Posted whenever any default changes
   static let changedNotification = NSNotification.Name("Defaults.changedNotification")
   
-  /// Posted whenever `downloadHistory` changes
+  /// Posted whenever `downloadHistory` changes. Unless the whole history was
+  /// just loaded, `userInfo` has a `DownloadHistoryChange` for `downloadHistoryChangeKey`.
   static let downloadHistoryChangedNotification = NSNotification.Name("Defaults.downloadHistoryChangedNotification")
+  static let downloadHistoryChangeKey = "change"
   
   private struct Keys {
     static let feeds = "feeds"
@@ -31,45 +33,72 @@ final class Defaults: NSObject {
     static let torrentsSavePath = "savePath"
     static let shouldOrganizeTorrents = "organizeTorrents"
     static let shouldOpenTorrentsAutomatically = "openAutomatically"
-    static let history = "history"
+    static let legacyHistory = "history"
     static let shouldRunHeadless = "headless"
     static let preventSystemSleep = "preventSystemSleep"
     static let downloadScriptPath = "downloadScriptPath"
     static let isDownloadScriptEnabled = "downloadScriptEnabled"
+    static let maxConcurrentFeedChecks = "maxConcurrentFeedChecks"
+    static let maxConcurrentFeedChecksPerHost = "maxConcurrentFeedChecksPerHost"
+    static let useStreamingFeedParser = "useStreamingFeedParser"
+    static let stopFeedParsingAtKnownItems = "stopFeedParsingAtKnownItems"
+    static let maxConcurrentTorrentDownloads = "maxConcurrentTorrentDownloads"
+    static let maxConcurrentTorrentDownloadsPerHost = "maxConcurrentTorrentDownloadsPerHost"
+    static let maxTorrentDownloadAttempts = "maxTorrentDownloadAttempts"
+    static let maxConcurrentDownloadScripts = "maxConcurrentDownloadScripts"
+    static let downloadScriptTimeout = "downloadScriptTimeout"
+    static let downloadScriptBatchSize = "downloadScriptBatchSize"
   }
   
+  /// Decoded and validated once, then kept in memory until defaults change
   var feeds: [Feed] {
     get {
-      let rawFeeds = UserDefaults.standard.array(forKey: Keys.feeds) as! [[AnyHashable:Any]]
-      return rawFeeds.compactMap { return Feed(dictionary: $0) }
+      return cachedFeeds.feeds
     }
     set {
-      UserDefaults.standard.set(newValue.removingDuplicates().map { $0.dictionaryRepresentation }, forKey: Keys.feeds)
+      userDefaults.set(newValue.removingDuplicates { $0.id }.map { $0.dictionaryRepresentation }, forKey: Keys.feeds)
+      invalidateFeedCache()
     }
   }
   
+  /// Adds the feeds in `newFeeds` whose ID (see `Feed.id`) isn't used by any
+  /// feed yet, without rewriting existing ones.
+  ///
+  /// - Returns: the feeds that were added
+  @discardableResult
+  func mergeFeeds(_ newFeeds: [Feed]) -> [Feed] {
+    var feedIDs = cachedFeeds.feedIDs
+    let addedFeeds = newFeeds.filter { feedIDs.insert($0.id).inserted }
+    guard !addedFeeds.isEmpty else { return [] }
+    
+    let rawFeeds = userDefaults.array(forKey: Keys.feeds) ?? []
+    userDefaults.set(rawFeeds + addedFeeds.map { $0.dictionaryRepresentation }, forKey: Keys.feeds)
+    invalidateFeedCache()
+    return addedFeeds
+  }
+  
   var areTimeRestrictionsEnabled: Bool {
-    return UserDefaults.standard.bool(forKey: Keys.onlyUpdateBetween)
+    return userDefaults.bool(forKey: Keys.onlyUpdateBetween)
   }
   
   var fromDateForTimeRestrictions: Date {
-    return UserDefaults.standard.object(forKey: Keys.updateFrom) as! Date
+    return userDefaults.object(forKey: Keys.updateFrom) as! Date
   }
   
   var toDateForTimeRestrictions: Date {
-    return UserDefaults.standard.object(forKey: Keys.updateTo) as! Date
+    return userDefaults.object(forKey: Keys.updateTo) as! Date
   }
   
   var shouldOrganizeTorrentsByShow: Bool {
-    return UserDefaults.standard.bool(forKey: Keys.shouldOrganizeTorrents)
+    return userDefaults.bool(forKey: Keys.shouldOrganizeTorrents)
   }
   
   var shouldOpenTorrentsAutomatically: Bool {
-    return UserDefaults.standard.bool(forKey: Keys.shouldOpenTorrentsAutomatically)
+    return userDefaults.bool(forKey: Keys.shouldOpenTorrentsAutomatically)
   }
   
   var torrentsSavePath: URL? {
-    guard let rawValue = UserDefaults.standard.string(forKey: Keys.torrentsSavePath) else {
+    guard let rawValue = userDefaults.string(forKey: Keys.torrentsSavePath) else {
       return nil
     }
     let expanded = NSString(string: rawValue).expandingTildeInPath
@@ -78,7 +107,7 @@ final class Defaults: NSObject {
   
   var downloadScriptPath: URL? {
     get {
-      guard let rawValue = UserDefaults.standard.string(forKey: Keys.downloadScriptPath) else {
+      guard let rawValue = userDefaults.string(forKey: Keys.downloadScriptPath) else {
         return nil
       }
       let expanded = NSString(string: rawValue).expandingTildeInPath
@@ -86,54 +115,96 @@ final class Defaults: NSObject {
     }
     set {
       let rawValue = newValue?.absoluteString
-      UserDefaults.standard.set(rawValue, forKey: Keys.downloadScriptPath)
+      userDefaults.set(rawValue, forKey: Keys.downloadScriptPath)
     }
   }
   
   var isDownloadScriptEnabled: Bool {
-    return UserDefaults.standard.bool(forKey: Keys.isDownloadScriptEnabled)
+    return userDefaults.bool(forKey: Keys.isDownloadScriptEnabled)
   }
   
   /// Recently downloaded episodes. Remembered so they won't be downloaded again
   /// every time feeds are checked. They are presented in the UI as well.
-  /// Automatically kept sorted chronologically, newest to oldest.
-  /// This is really slow to deserialize from and serialize to defaults, so
-  /// keep it in memory while the app is running.
-  var downloadHistory: [HistoryItem] = [] {
-    didSet {
-      // Only keep one copy of each episode
-      var uniqueItems: [HistoryItem] = []
-      do {
-        var seenEpisodes: Set<Episode> = []
-        for newItem in downloadHistory {
-          if !seenEpisodes.contains(newItem.episode) {
-            seenEpisodes.insert(newItem.episode)
-            uniqueItems.append(newItem)
-          } else {
-            os_log("Discarding duplicate history item: %{public}@", log: .main, type: .info, "\(newItem)")
-          }
-        }
-      }
-      
-      // Only keep the most recent items
-      let truncatedCount = min(uniqueItems.count, .historyLimit * feeds.count)
-      let truncatedHistory = uniqueItems.sorted().reversed().prefix(upTo: truncatedCount)
-      
-      downloadHistory = Array(truncatedHistory)
-      
-      NotificationCenter.default.post(
-        name: Defaults.downloadHistoryChangedNotification,
-        object: self
-      )
+  /// Sorted chronologically, newest to oldest, one item per episode.
+  /// Loaded from `historyStore` the first time it's needed, then kept in memory
+  /// while the app is running.
+  var downloadHistory: DownloadHistory {
+    loadDownloadHistoryIfNeeded()
+    return storedDownloadHistory
+  }
+  
+  /// Records newly downloaded episodes in the history, all at once.
+  /// Posts `downloadHistoryChangedNotification` once per call.
+  func addToDownloadHistory(_ newItems: [HistoryItem]) {
+    guard !newItems.isEmpty else { return }
+    
+    loadDownloadHistoryIfNeeded()
+    let (insertedItems, evictedItems) = storedDownloadHistory.insert(newItems, limit: downloadHistoryLimit)
+    
+    if insertedItems.count < newItems.count {
+      os_log("Discarded %d duplicate history items", log: .main, type: .info, newItems.count - insertedItems.count)
     }
+    
+    historyStore.append(insertedItems)
+    historyStore.compactIfNeeded(liveItems: storedDownloadHistory)
+    
+    postDownloadHistoryChangedNotification(change: DownloadHistoryChange(inserted: insertedItems, removed: evictedItems))
+  }
+  
+  func removeFromDownloadHistory(_ item: HistoryItem) {
+    loadDownloadHistoryIfNeeded()
+    guard let removedItem = storedDownloadHistory.remove(item.episode) else { return }
+    
+    historyStore.remove([removedItem])
+    
+    postDownloadHistoryChangedNotification(change: DownloadHistoryChange(removed: [removedItem]))
+  }
+  
+  /// `feeds`, as last read from defaults. Nil until they're read, and
+  /// after defaults change.
+  private var feedCache: (feeds: [Feed], feedIDs: Set<String>)? = nil
+  private let feedCacheLock = NSLock()
+  
+  private var cachedFeeds: (feeds: [Feed], feedIDs: Set<String>) {
+    feedCacheLock.lock()
+    defer { feedCacheLock.unlock() }
+    
+    if let feedCache = feedCache {
+      return feedCache
+    }
+    
+    let rawFeeds = userDefaults.array(forKey: Keys.feeds) as? [[AnyHashable:Any]] ?? []
+    let feeds = rawFeeds.compactMap(Feed.init(dictionary:))
+    let feedIDs = Set(feeds.map(\.id))
+    
+    feedCache = (feeds, feedIDs)
+    return (feeds, feedIDs)
+  }
+  
+  /// Changes made through `Defaults` post `UserDefaults.didChangeNotification`
+  /// too, but not before `init` has finished
+  private func invalidateFeedCache() {
+    feedCacheLock.lock()
+    feedCache = nil
+    feedCacheLock.unlock()
+  }
+  
+  private let userDefaults: UserDefaults
+  private let historyStore: HistoryStore
+  private var isDownloadHistoryLoaded = false
+  private var storedDownloadHistory = DownloadHistory()
+  
+  /// Maximum number of items in the download history
+  private var downloadHistoryLimit: Int {
+    return .historyLimit * feeds.count
   }
   
   var shouldRunHeadless: Bool {
-    return UserDefaults.standard.bool(forKey: Keys.shouldRunHeadless)
+    return userDefaults.bool(forKey: Keys.shouldRunHeadless)
   }
   
   var shouldPreventSystemSleep: Bool {
-    return UserDefaults.standard.bool(forKey: Keys.preventSystemSleep)
+    return userDefaults.bool(forKey: Keys.preventSystemSleep)
   }
   
   var isConfigurationValid: Bool {
@@ -164,6 +235,28 @@ final class Defaults: NSObject {
     )
   }
   
+  /// Not exposed in the UI, can be tweaked with `defaults write`.
+  var feedCheckOptions: FeedCheckOptions {
+    return FeedCheckOptions(
+      maxConcurrentFeeds: userDefaults.integer(forKey: Keys.maxConcurrentFeedChecks),
+      maxConcurrentFeedsPerHost: userDefaults.integer(forKey: Keys.maxConcurrentFeedChecksPerHost),
+      usesStreamingParser: userDefaults.bool(forKey: Keys.useStreamingFeedParser),
+      stopsAtKnownItems: userDefaults.bool(forKey: Keys.stopFeedParsingAtKnownItems),
+      maxConcurrentDownloads: userDefaults.integer(forKey: Keys.maxConcurrentTorrentDownloads),
+      maxConcurrentDownloadsPerHost: userDefaults.integer(forKey: Keys.maxConcurrentTorrentDownloadsPerHost),
+      maxDownloadAttempts: userDefaults.integer(forKey: Keys.maxTorrentDownloadAttempts)
+    )
+  }
+  
+  /// Not exposed in the UI, can be tweaked with `defaults write`.
+  var downloadScriptOptions: DownloadScriptOptions {
+    return DownloadScriptOptions(
+      maxConcurrentRuns: userDefaults.integer(forKey: Keys.maxConcurrentDownloadScripts),
+      timeout: userDefaults.double(forKey: Keys.downloadScriptTimeout),
+      batchSize: userDefaults.integer(forKey: Keys.downloadScriptBatchSize)
+    )
+  }
+  
   func restricts(date: Date) -> Bool {
     if !areTimeRestrictionsEnabled { return false }
     
@@ -173,15 +266,53 @@ final class Defaults: NSObject {
     )
   }
   
-  func save() {
-    // Only save history to defaults when necessary
-    let serializedHistory = downloadHistory.map { $0.dictionaryRepresentation }
-    UserDefaults.standard.set(serializedHistory, forKey: Keys.history)
+  /// - Parameter waitingForHistory: whether to block until the history is on
+  ///   disk too. It's written in the background as it changes, so only needed
+  ///   when quitting.
+  func save(waitingForHistory: Bool = false) {
+    if waitingForHistory {
+      historyStore.flush()
+    }
+    
+    userDefaults.synchronize()
+  }
+  
+  private func loadDownloadHistoryIfNeeded() {
+    guard !isDownloadHistoryLoaded else { return }
+    isDownloadHistoryLoaded = true
     
-    UserDefaults.standard.synchronize()
+    // Migrate from history stored in defaults
+    if !historyStore.exists, let rawHistory = userDefaults.array(forKey: Keys.legacyHistory) as? [[AnyHashable:Any]] {
+      os_log("Migrating download history from defaults", log: .main, type: .info)
+      let migratedHistory = rawHistory.compactMap(HistoryItem.init(defaultsDictionary:))
+      storedDownloadHistory.insert(migratedHistory, limit: downloadHistoryLimit)
+      historyStore.compact(liveItems: storedDownloadHistory)
+      historyStore.flush()
+      userDefaults.removeObject(forKey: Keys.legacyHistory)
+    } else {
+      storedDownloadHistory.insert(historyStore.load(), limit: downloadHistoryLimit)
+    }
+    
+    postDownloadHistoryChangedNotification()
+  }
+  
+  private func postDownloadHistoryChangedNotification(change: DownloadHistoryChange? = nil) {
+    NotificationCenter.default.post(
+      name: Defaults.downloadHistoryChangedNotification,
+      object: self,
+      userInfo: change.map { [Defaults.downloadHistoryChangeKey: $0] }
+    )
   }
   
-  private override init() {
+  /// - Parameter userDefaults: where preferences are stored
+  /// - Parameter historyStore: where the download history is stored
+  init(
+    userDefaults: UserDefaults = .standard,
+    historyStore: HistoryStore = HistoryStore(
+      fileURL: HistoryStore.defaultFileURL ?? URL(fileURLWithPath: NSTemporaryDirectory()).appendingPathComponent("History.log")
+    )) {
+    self.userDefaults = userDefaults
+    self.historyStore = historyStore
     super.init()
     
     // Default values for time restrictions
@@ -201,17 +332,26 @@ final class Defaults: NSObject {
       Keys.torrentsSavePath: defaultDownloadsDirectory,
       Keys.shouldOrganizeTorrents: false,
       Keys.shouldOpenTorrentsAutomatically: true,
-      Keys.history: [],
       Keys.shouldRunHeadless: false,
       Keys.preventSystemSleep: true,
-      Keys.isDownloadScriptEnabled: false
+      Keys.isDownloadScriptEnabled: false,
+      Keys.maxConcurrentFeedChecks: FeedCheckOptions().maxConcurrentFeeds,
+      Keys.maxConcurrentFeedChecksPerHost: FeedCheckOptions().maxConcurrentFeedsPerHost,
+      Keys.useStreamingFeedParser: FeedCheckOptions().usesStreamingParser,
+      Keys.stopFeedParsingAtKnownItems: FeedCheckOptions().stopsAtKnownItems,
+      Keys.maxConcurrentTorrentDownloads: FeedCheckOptions().maxConcurrentDownloads,
+      Keys.maxConcurrentTorrentDownloadsPerHost: FeedCheckOptions().maxConcurrentDownloadsPerHost,
+      Keys.maxTorrentDownloadAttempts: FeedCheckOptions().maxDownloadAttempts,
+      Keys.maxConcurrentDownloadScripts: DownloadScriptOptions().maxConcurrentRuns,
+      Keys.downloadScriptTimeout: DownloadScriptOptions().timeout,
+      Keys.downloadScriptBatchSize: DownloadScriptOptions().batchSize
     ]
-    UserDefaults.standard.register(defaults: defaultDefaults)
+    userDefaults.register(defaults: defaultDefaults)
     
     // Migrate from single-feed to multi-feed
-    if let legacyFeedURLString = UserDefaults.standard.string(forKey: "feedURL") {
+    if let legacyFeedURLString = userDefaults.string(forKey: "feedURL") {
       os_log("Migrating feed URLs defaults", log: .main, type: .info)
-      UserDefaults.standard.set(nil, forKey: "feedURL")
+      userDefaults.set(nil, forKey: "feedURL")
       if let legacyFeedURL = URL(string: legacyFeedURLString) {
         feeds.append(Feed(name: "ShowRSS", url: legacyFeedURL))
       }
@@ -224,13 +364,12 @@ final class Defaults: NSObject {
       name: UserDefaults.didChangeNotification,
       object: nil
     )
-    
-    // Load history from defaults at launch
-    let rawHistory = UserDefaults.standard.array(forKey: Keys.history) as! [[AnyHashable:Any]]
-    downloadHistory = rawHistory.compactMap(HistoryItem.init(defaultsDictionary:))
   }
   
   @objc private func defaultsChanged(_: Notification) {
+    // Notifications don't say which keys changed
+    invalidateFeedCache()
+    
     NotificationCenter.default.post(
       name: Defaults.changedNotification,
       object: self
@@ -259,7 +398,15 @@ private extension HistoryItem {
 
 extension Collection where Element: Hashable {
   func removingDuplicates() -> [Element] {
-    var set = Set<Element>()
-    return compactMap { set.insert($0).inserted ? $0 : nil }
+    return removingDuplicates { $0 }
+  }
+}
+
+
+extension Collection {
+  /// Keeps the first of the elements that have the same `key`
+  func removingDuplicates<Key: Hashable>(by key: (Element) -> Key) -> [Element] {
+    var set = Set<Key>()
+    return compactMap { set.insert(key($0)).inserted ? $0 : nil }
   }
 }
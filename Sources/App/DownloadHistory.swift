@@ -0,0 +1,134 @@
+import Foundation
+
+
+/// A collection of history items, newest to oldest, with at most one item per
+/// episode.
+///
+/// Items are stored oldest first, so that adding new downloads (the common case)
+/// appends at the end, and membership is checked with a hash index.
+struct DownloadHistory {
+  /// Oldest to newest
+  private var items: [HistoryItem] = []
+  private var episodes: Set<Episode> = []
+  
+  init() {}
+  
+  func contains(_ episode: Episode) -> Bool {
+    return episodes.contains(episode)
+  }
+  
+  /// Adds a batch of items, keeping them sorted, and drops the oldest items
+  /// beyond `limit`.
+  ///
+  /// - Note: items for episodes that are already in the history (or earlier in
+  ///         the same batch) are ignored.
+  /// - Returns: the items that were actually added, and those that were dropped
+  @discardableResult
+  mutating func insert<Items: Sequence>(_ newItems: Items, limit: Int) -> (inserted: [HistoryItem], evicted: [HistoryItem]) where Items.Element == HistoryItem {
+    var inserted: [HistoryItem] = []
+    for newItem in newItems where episodes.insert(newItem.episode).inserted {
+      items.insert(newItem, at: insertionIndex(for: newItem))
+      inserted.append(newItem)
+    }
+    
+    // Only keep the most recent items
+    let evicted = Array(items.prefix(max(0, items.count - limit)))
+    if !evicted.isEmpty {
+      items.removeFirst(evicted.count)
+      for evictedItem in evicted {
+        episodes.remove(evictedItem.episode)
+      }
+    }
+    
+    return (inserted, evicted)
+  }
+  
+  /// Removes the item for `episode`, if there is one
+  @discardableResult
+  mutating func remove(_ episode: Episode) -> HistoryItem? {
+    guard
+      episodes.remove(episode) != nil,
+      let index = items.lastIndex(where: { $0.episode == episode })
+    else {
+      return nil
+    }
+    
+    return items.remove(at: index)
+  }
+  
+  /// Position of `item` (newest to oldest), found with a binary search by date
+  func position(of item: HistoryItem) -> Int? {
+    guard episodes.contains(item.episode) else { return nil }
+    
+    // Find the first item with the same date (items without dates come first),
+    // then look among those
+    var lowerBound = 0
+    if item.downloadDate != nil {
+      var upperBound = items.count
+      while lowerBound < upperBound {
+        let middle = (lowerBound + upperBound) / 2
+        if items[middle] < item {
+          lowerBound = middle + 1
+        } else {
+          upperBound = middle
+        }
+      }
+    }
+    
+    var index = lowerBound
+    while index < items.count && items[index].downloadDate == item.downloadDate {
+      if items[index].episode == item.episode {
+        return items.count - 1 - index
+      }
+      index += 1
+    }
+    return nil
+  }
+  
+  /// Where to insert an item in `items` to keep it sorted, after any items with
+  /// the same date. Usually the end, found in O(1).
+  private func insertionIndex(for newItem: HistoryItem) -> Int {
+    if let newestItem = items.last, newestItem > newItem {
+      // Binary search for the first item that's newer than the new one
+      var lowerBound = 0
+      var upperBound = items.count - 1
+      while lowerBound < upperBound {
+        let middle = (lowerBound + upperBound) / 2
+        if items[middle] > newItem {
+          upperBound = middle
+        } else {
+          lowerBound = middle + 1
+        }
+      }
+      return lowerBound
+    }
+    
+    return items.count
+  }
+}
+
+
+extension DownloadHistory: RandomAccessCollection {
+  var startIndex: Int {
+    return 0
+  }
+  
+  var endIndex: Int {
+    return items.count
+  }
+  
+  /// Newest to oldest
+  subscript(position: Int) -> HistoryItem {
+    return items[items.count - 1 - position]
+  }
+}
+
+
+/// What a call to `Defaults.addToDownloadHistory` or
+/// `Defaults.removeFromDownloadHistory` did to the download history
+struct DownloadHistoryChange {
+  var inserted: [HistoryItem] = []
+  
+  /// Including items dropped because the history got too long
+  var removed: [HistoryItem] = []
+}
@@ -18,15 +18,24 @@ private extension Timer {
 
 
 private extension TimeInterval {
-  /// How often to check feeds.
-  static let feedUpdateInterval: TimeInterval = 60 * 10
+  /// How often to look for feeds that are due to be checked.
+  /// When each feed is due is up to `FeedScheduler`.
+  static let feedSchedulingInterval: TimeInterval = 60
   
   /// How much leeway to give to the os for scheduling.
-  static let feedUpdateIntervalTolerance: TimeInterval = 30
+  static let feedSchedulingIntervalTolerance: TimeInterval = 15
 }
 
 
-/// Singleton. Periodically invokes the Feed Helper service to check the feeds.
+private extension Int {
+  /// How many times to run the download script on an episode before giving up
+  /// on it. Failed episodes are retried along with the next checks' episodes.
+  static let maxDownloadScriptAttempts = 3
+}
+
+
+/// Singleton. Periodically invokes the Feed Helper service to check the feeds
+/// that are due.
 final class FeedChecker {
   enum Status {
     case polling, paused
@@ -52,9 +61,17 @@ final class FeedChecker {
       if oldValue != status {
         // If we have just been set to polling, check immediately
         if oldValue == .paused && status == .polling {
-          intervalTimer.fireNow()
+          intervalTimer?.fireNow()
+        }
+        
+        // Don't keep downloading after users asked us to stop
+        if status == .paused {
+          cancelCheck()
         }
         
+        // Episodes waiting for the download script wait for "Resume" too
+        scriptExecutor.isPaused = status == .paused
+        
         postStateChangedNotification()
       }
     }
@@ -69,104 +86,296 @@ final class FeedChecker {
     }
   }
   
-  private let feedHelperProxy = FeedHelperProxy()
-  private var intervalTimer: Timer!
+  private let feedHelperProxy: FeedCheckService
+  private let scriptExecutor: DownloadScriptExecutor
+  private let defaults: Defaults
+  private let seenEpisodeSync = SeenEpisodeSync()
+  private let scheduler = FeedScheduler()
+  private let healthMonitor = FeedHealthMonitor()
+  private var intervalTimer: Timer?
   
-  private init() {
-    intervalTimer = Timer.scheduledTimer(
-      withTimeInterval: .feedUpdateInterval,
-      repeats: true,
-      block: { [weak self] _ in
-        guard let self = self else { return }
-        
-        // Skip if paused or if current time is outside user-defined range
-        guard self.status == .polling, !Defaults.shared.restricts(date: Date()) else { return }
-        
-        self.checkFeeds()
-      }
-    )
-    intervalTimer.tolerance = .feedUpdateIntervalTolerance
+  /// Episodes the download script failed on, and how many times it did.
+  /// Not persisted: episodes that are still failing when the app quits are
+  /// dropped, and are only downloaded again if they show up in a feed again.
+  private var failedScriptEpisodes: [(historyItem: HistoryItem, attempts: Int)] = []
+  
+  /// - Parameter defaults: where preferences are read, and episodes are added
+  ///   to the history
+  /// - Parameter checksPeriodically: whether to check due feeds on a timer,
+  ///   starting right away
+  init(
+    feedHelperProxy: FeedCheckService = FeedHelperProxy(),
+    scriptExecutor: DownloadScriptExecutor = .shared,
+    defaults: Defaults = .shared,
+    checksPeriodically: Bool = true) {
+    self.feedHelperProxy = feedHelperProxy
+    self.scriptExecutor = scriptExecutor
+    self.defaults = defaults
     
-    // Check now
-    intervalTimer.fireNow()
+    if checksPeriodically {
+      let intervalTimer = Timer.scheduledTimer(
+        withTimeInterval: .feedSchedulingInterval,
+        repeats: true,
+        block: { [weak self] _ in
+          guard let self = self else { return }
+          
+          // Skip if paused or if current time is outside user-defined range
+          guard self.status == .polling, !self.defaults.restricts(date: Date()) else { return }
+          
+          self.checkDueFeeds()
+        }
+      )
+      intervalTimer.tolerance = .feedSchedulingIntervalTolerance
+      
+      // Check now
+      intervalTimer.fireNow()
+      
+      self.intervalTimer = intervalTimer
+    }
     
     feedHelperProxy.delegate = self
+    
+    // Keep track of what to tell the helper about the history as it changes,
+    // instead of going through all of it before each check
+    NotificationCenter.default.addObserver(
+      forName: Defaults.downloadHistoryChangedNotification,
+      object: defaults,
+      queue: nil,
+      using: { [weak self] notification in
+        if let change = notification.userInfo?[Defaults.downloadHistoryChangeKey] as? DownloadHistoryChange {
+          self?.seenEpisodeSync.historyDidChange(change)
+        } else {
+          self?.seenEpisodeSync.historyWasReplaced()
+        }
+      }
+    )
+  }
+  
+  /// How checks of `feed` have been going (failures, latency, last success,
+  /// whether it's being skipped)
+  func health(of feed: Feed) -> FeedHealth {
+    return healthMonitor.health(of: feed)
   }
   
-  /// Checks feeds right now ignoring time restrictions and "paused" mode
+  /// Checks all feeds right now ignoring time restrictions, "paused" mode,
+  /// their schedules and their health
   func forceCheck() {
-    checkFeeds()
+    checkFeeds(defaults.feeds)
+  }
+  
+  /// Stops the check in progress, if any. Feeds that weren't done are left
+  /// due, so they're checked again as soon as possible.
+  func cancelCheck() {
+    guard lastCheckStatus == .inProgress else { return }
+    
+    os_log("Cancelling feed check", log: .main, type: .info)
+    feedHelperProxy.cancelChecks()
+  }
+  
+  private func checkDueFeeds() {
+    let feeds = defaults.feeds
+    scheduler.removeFeeds(notIn: feeds)
+    healthMonitor.removeFeeds(notIn: feeds)
+    
+    let now = Date()
+    let dueFeeds = scheduler.dueFeeds(among: feeds, at: now)
+    
+    // Leave feeds that keep failing alone for a while
+    let feedsToCheck = dueFeeds.filter { healthMonitor.allowsCheck(of: $0, at: now) }
+    if feedsToCheck.count < dueFeeds.count {
+      os_log("Skipping %d failing feeds", log: .main, type: .info, dueFeeds.count - feedsToCheck.count)
+    }
+    
+    guard !feedsToCheck.isEmpty else { return }
+    
+    checkFeeds(feedsToCheck)
   }
   
-  private func checkFeeds() {
+  private func checkFeeds(_ feeds: [Feed]) {
     // Don't check twice simultaneously
     guard lastCheckStatus != .inProgress else { return }
     
     // Skip check if downloads directory isn't currently available
-    guard Defaults.shared.isTorrentsSavePathValid else {
+    guard defaults.isTorrentsSavePathValid else {
       os_log("Skipping feed check: downloads directory is not available", log: .helper, type: .info)
+      scheduler.feedsWereSkipped(feeds, at: Date())
       lastCheckStatus = .skipped(Date())
       return
     }
     
     // Only work with valid preferences
     guard
-      Defaults.shared.isConfigurationValid,
-      Defaults.shared.hasValidFeeds,
-      let downloadOptions = Defaults.shared.downloadOptions
+      defaults.isConfigurationValid,
+      defaults.hasValidFeeds,
+      let downloadOptions = defaults.downloadOptions
     else {
       os_log("Skipping feed check: invalid preferences", log: .helper, type: .info)
+      scheduler.feedsWereSkipped(feeds, at: Date())
       lastCheckStatus = .skipped(Date())
       return
     }
     
     lastCheckStatus = .inProgress
     
-    // Extract URLs from history
-    let previouslyDownloadedURLs = Defaults.shared.downloadHistory.map { $0.episode.url }
+    os_log("Checking %d of %d feeds", log: .main, type: .info, feeds.count, defaults.feeds.count)
+    checkFeeds(feeds, downloadOptions: downloadOptions)
+  }
+  
+  /// Checks `feeds` without looking at preferences or at the last check first
+  func checkFeeds(_ feeds: [Feed], downloadOptions: DownloadOptions, isRetry: Bool = false) {
+    // Tell the helper what changed in the history since the last check
+    let seenEpisodeUpdate = seenEpisodeSync.makeUpdate(history: defaults.downloadHistory)
+    
+    // Episodes are handled as soon as they are reported, remember which ones
+    // so they aren't handled again when the check is done
+    var handledEpisodes: Set<Episode> = []
+    
+    // Episodes for the download script are collected until the check is done,
+    // so that they can be batched together
+    var scriptHistoryItems: [HistoryItem] = []
+    
+    // Same for feeds, which are handled as soon as they are done
+    var finishedFeeds: Set<String> = []
+    
+    let checkStartDate = Date()
     
     // Check feeds
     feedHelperProxy.checkFeeds(
-      feeds: Defaults.shared.feeds,
+      feeds: feeds,
+      options: defaults.feedCheckOptions,
       downloadOptions: downloadOptions,
-      previouslyDownloadedURLs: previouslyDownloadedURLs,
+      seenEpisodeUpdate: seenEpisodeUpdate,
+      didDownloadEpisode: { [weak self] downloadedEpisode in
+        guard let self = self, handledEpisodes.insert(downloadedEpisode.episode).inserted else { return }
+        scriptHistoryItems += self.handleDownloadedEpisodes([downloadedEpisode])
+      },
+      didFinishFeed: { [weak self] feed, report in
+        os_log("Checked feed %{public}@: %d new episodes, %d failures", log: .main, type: .info, feed.name, report.downloadedEpisodes.count, report.failures.count + report.episodeFailures.count)
+        guard finishedFeeds.insert(feed.id).inserted else { return }
+        self?.feedDidFinish(feed, report: report, checkStartDate: checkStartDate)
+      },
       completion: { [weak self] result in
+        guard let self = self else { return }
+        
         switch result {
-        case .success(let downloadedEpisodes):
-          os_log("Checking feed succeeded, %d new episodes found", log: .main, type: .info, downloadedEpisodes.count)
-          // Deal with new files
-          self?.handleDownloadedEpisodes(downloadedEpisodes)
-          self?.lastCheckStatus = .successful(Date())
+        case .success:
+          self.seenEpisodeSync.updateWasApplied()
+        case .failure(let error as NSError) where error.domain == feedHelperErrorDomain && error.code == SeenEpisodeUpdate.outOfSyncErrorCode && !isRetry:
+          // The helper lost track of the history, send all of it again
+          os_log("Feed Helper needs a full history snapshot", log: .main, type: .info)
+          self.seenEpisodeSync.updateWasNotApplied()
+          self.runDownloadScript(on: scriptHistoryItems)
+          self.checkFeeds(feeds, downloadOptions: downloadOptions, isRetry: true)
+          return
+        case .failure:
+          self.seenEpisodeSync.updateWasNotApplied()
+        }
+        
+        switch result {
+        case .success(let report):
+          os_log("Checking feeds done, %d new episodes found, %d feeds failed, %d episodes failed", log: .main, type: .info, report.downloadedEpisodes.count, report.failures.count, report.episodeFailures.count)
+          // Deal with new files that weren't reported already, even if some feeds or episodes failed
+          scriptHistoryItems += self.handleDownloadedEpisodes(report.downloadedEpisodes.filter { !handledEpisodes.contains($0.episode) })
+          // Remember duplicates too, so they aren't downloaded again just to be skipped
+          self.defaults.addToDownloadHistory(report.duplicateEpisodes.map { HistoryItem(episode: $0, downloadDate: Date(), isDuplicate: true) })
+          for feed in feeds where !finishedFeeds.contains(feed.id) {
+            self.feedDidFinish(feed, report: report, checkStartDate: checkStartDate)
+          }
+          self.logSlowestFeed(among: feeds)
+          let failures = report.failures.filter { !$0.error.isFeedHelperCancellation }
+          let episodeFailures = report.episodeFailures.filter { !$0.error.isFeedHelperCancellation }
+          let wasCancelled = failures.count < report.failures.count || episodeFailures.count < report.episodeFailures.count
+          if let failure = failures.first {
+            os_log("Feed Helper error (checking feed %{public}@): %{public}@", log: .main, type: .error, failure.feed.name, failure.error.localizedDescription)
+            self.lastCheckStatus = .failed(Date(), failure.error)
+          } else if let episodeFailure = episodeFailures.first {
+            os_log("Feed Helper error (downloading %{public}@): %{public}@", log: .main, type: .error, episodeFailure.episode.title, episodeFailure.error.localizedDescription)
+            self.lastCheckStatus = .failed(Date(), episodeFailure.error)
+          } else if wasCancelled {
+            os_log("Feed check cancelled", log: .main, type: .info)
+            self.lastCheckStatus = .skipped(Date())
+          } else {
+            self.lastCheckStatus = .successful(Date())
+          }
         case .failure(let error):
           os_log("Feed Helper error (checking feed): %{public}@", log: .main, type: .error, error.localizedDescription)
-          self?.lastCheckStatus = .failed(Date(), error)
+          for feed in feeds where !finishedFeeds.contains(feed.id) {
+            self.scheduler.feedDidFail(feed, hint: nil, at: Date())
+            self.healthMonitor.feedDidFail(feed, error: error, latency: Date().timeIntervalSince(checkStartDate), at: Date())
+          }
+          self.lastCheckStatus = .failed(Date(), error)
         }
         
+        self.runDownloadScript(on: scriptHistoryItems)
+        
         // Synchronize defaults here. If the app dies uncleanly, no data loss.
-        Defaults.shared.save()
+        self.defaults.save()
       }
     )
   }
   
-  private func handleDownloadedEpisodes(_ downloadedEpisodes: [DownloadedEpisode]) {
+  /// Records how checking `feed` went, and schedules its next check
+  ///
+  /// - Parameter report: covers `feed`, and maybe other feeds
+  private func feedDidFinish(_ feed: Feed, report: FeedCheckReport, checkStartDate: Date) {
+    let now = Date()
+    let latency = now.timeIntervalSince(checkStartDate)
+    let hint = report.schedulingHints.first { $0.feed.id == feed.id }
+    let failure = report.failures.first { $0.feed.id == feed.id }
+    
+    // Not the feed's fault, and it's still due
+    if let failure = failure, failure.error.isFeedHelperCancellation {
+      os_log("Check of %{public}@ was cancelled", log: .main, type: .info, feed.name)
+      return
+    }
+    
+    if let failure = failure {
+      scheduler.feedDidFail(feed, hint: hint, at: now)
+      healthMonitor.feedDidFail(feed, error: failure.error, latency: latency, at: now)
+      
+      let health = healthMonitor.health(of: feed)
+      if let skippedUntil = health.skippedUntil {
+        os_log("Feed %{public}@ failed %d times in a row, skipping it for %d minutes", log: .main, type: .info, feed.name, health.consecutiveFailures, Int(skippedUntil.timeIntervalSince(now) / 60))
+      }
+    } else {
+      scheduler.feedWasChecked(hint ?? FeedCheckReport.SchedulingHint(feed: feed), at: now)
+      healthMonitor.feedWasChecked(feed, latency: latency, at: now)
+    }
+    
+    if let nextCheckDate = scheduler.nextCheckDate(for: feed) {
+      os_log("Next check of %{public}@ in %d minutes", log: .main, type: .info, feed.name, Int(nextCheckDate.timeIntervalSinceNow / 60))
+    }
+  }
+  
+  private func logSlowestFeed(among feeds: [Feed]) {
+    let latencies = feeds.compactMap { feed in
+      healthMonitor.health(of: feed).lastLatency.map { (feed, $0) }
+    }
+    guard let (feed, latency) = latencies.max(by: { $0.1 < $1.1 }) else { return }
+    
+    os_log("Slowest feed: %{public}@ (%.1fs)", log: .main, type: .info, feed.name, latency)
+  }
+  
+  /// - Returns: the history items of the episodes that are left for the download
+  ///   script, see `runDownloadScript(on:)`
+  private func handleDownloadedEpisodes(_ downloadedEpisodes: [DownloadedEpisode]) -> [HistoryItem] {
+    // Episodes that can be added to the history right away, all in one batch
+    var historyItems: [HistoryItem] = []
+    
+    // Episodes to hand to the download script. They are added to the history
+    // once the script is done with all of them, if it succeeded.
+    var scriptHistoryItems: [HistoryItem] = []
+    
     for downloadedEpisode in downloadedEpisodes {
       let episode = downloadedEpisode.episode
       let historyItem = HistoryItem(episode: episode, downloadDate: Date())
       
-      func addToDownloadHistory() {
-        Defaults.shared.downloadHistory.append(historyItem)
-      }
-      
       // Open torrents automatically if requested
-      if Defaults.shared.shouldOpenTorrentsAutomatically {
-        if Defaults.shared.isDownloadScriptEnabled {
-          Process.runDownloadScript(url: episode.url) { success in
-            if success {
-              addToDownloadHistory()
-            }
-          }
+      if defaults.shouldOpenTorrentsAutomatically {
+        if defaults.isDownloadScriptEnabled {
+          scriptHistoryItems.append(historyItem)
         } else {
-          addToDownloadHistory()
+          historyItems.append(historyItem)
           if episode.url.isMagnetLink {
             // Open magnet link
             NSWorkspace.shared.openInBackground(url: episode.url)
@@ -176,11 +385,45 @@ final class FeedChecker {
           }
         }
       } else {
-        addToDownloadHistory()
+        historyItems.append(historyItem)
       }
       
       NSUserNotificationCenter.default.deliverNewEpisodeNotification(for: episode)
     }
+    
+    defaults.addToDownloadHistory(historyItems)
+    
+    return scriptHistoryItems
+  }
+  
+  /// Hands the episodes of a check to the download script all at once, so that
+  /// they can share runs, along with the episodes it failed on before. Episodes
+  /// are added to the history once the script succeeds on them.
+  ///
+  /// The helper won't report failed episodes again (it already moved past them),
+  /// so they're kept for the next checks, up to `maxDownloadScriptAttempts` runs.
+  private func runDownloadScript(on historyItems: [HistoryItem]) {
+    let newURLs = Set(historyItems.map { $0.episode.url })
+    let scriptEpisodes = historyItems.map { (historyItem: $0, attempts: 0) } +
+      failedScriptEpisodes.filter { !newURLs.contains($0.historyItem.episode.url) }
+    failedScriptEpisodes = []
+    
+    guard !scriptEpisodes.isEmpty else { return }
+    
+    scriptExecutor.runDownloadScript(urls: scriptEpisodes.map { $0.historyItem.episode.url }, defaults: defaults) { [weak self] results in
+      var succeededHistoryItems: [HistoryItem] = []
+      for (historyItem, attempts) in scriptEpisodes {
+        if results[historyItem.episode.url] == true {
+          succeededHistoryItems.append(historyItem)
+        } else if attempts + 1 < .maxDownloadScriptAttempts {
+          self?.failedScriptEpisodes.append((historyItem, attempts + 1))
+        } else {
+          os_log("Download script failed on %{public}@ %d times, giving up", log: .main, type: .error, historyItem.episode.title, attempts + 1)
+        }
+      }
+      
+      self?.defaults.addToDownloadHistory(succeededHistoryItems)
+    }
   }
   
   private func postStateChangedNotification() {
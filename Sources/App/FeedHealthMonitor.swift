@@ -0,0 +1,87 @@
+import Foundation
+
+
+private extension Int {
+  /// How many checks in a row a feed can fail before it's skipped for a while
+  static let feedFailureThreshold = 3
+}
+
+
+private extension TimeInterval {
+  /// How long to skip a feed after it reaches `feedFailureThreshold`.
+  /// Doubles for every further failure.
+  static let feedCooldown: TimeInterval = 60 * 30
+  
+  /// Longest a feed can be skipped for, before it's tried again
+  static let maxFeedCooldown: TimeInterval = 60 * 60 * 12
+}
+
+
+/// How checks of a feed have been going
+struct FeedHealth {
+  /// Failed checks since the last successful one
+  var consecutiveFailures = 0
+  
+  var lastFailure: (date: Date, error: Error)? = nil
+  
+  var lastSuccessDate: Date? = nil
+  
+  /// How long after the start of its last check run the feed was done
+  var lastLatency: TimeInterval? = nil
+  
+  /// If the feed keeps failing, it's not checked until this date (unless
+  /// users check manually). After that, one more failure skips it again.
+  var skippedUntil: Date? = nil
+}
+
+
+/// Keeps track of the health of each feed, and acts as a circuit breaker:
+/// feeds that fail `feedFailureThreshold` checks in a row are skipped for a
+/// cooldown period (longer and longer if they keep failing), so they don't
+/// slow down checks of the other feeds.
+///
+/// - Note: only kept in memory, all feeds start out healthy when the app starts.
+final class FeedHealthMonitor {
+  /// Keyed by feed ID (see `Feed.id`)
+  private var healthByID: [String:FeedHealth] = [:]
+  
+  func health(of feed: Feed) -> FeedHealth {
+    return healthByID[feed.id] ?? FeedHealth()
+  }
+  
+  /// Whether `feed` should be checked at `date`, or skipped because it's failing
+  func allowsCheck(of feed: Feed, at date: Date) -> Bool {
+    guard let skippedUntil = healthByID[feed.id]?.skippedUntil else { return true }
+    return skippedUntil <= date
+  }
+  
+  func feedWasChecked(_ feed: Feed, latency: TimeInterval, at date: Date) {
+    var health = self.health(of: feed)
+    health.consecutiveFailures = 0
+    health.lastSuccessDate = date
+    health.lastLatency = latency
+    health.skippedUntil = nil
+    healthByID[feed.id] = health
+  }
+  
+  func feedDidFail(_ feed: Feed, error: Error, latency: TimeInterval, at date: Date) {
+    var health = self.health(of: feed)
+    health.consecutiveFailures += 1
+    health.lastFailure = (date, error)
+    health.lastLatency = latency
+    
+    let excessFailures = health.consecutiveFailures - .feedFailureThreshold
+    if excessFailures >= 0 {
+      let cooldown = min(TimeInterval.feedCooldown * pow(2, TimeInterval(excessFailures)), .maxFeedCooldown)
+      health.skippedUntil = date.addingTimeInterval(cooldown)
+    }
+    
+    healthByID[feed.id] = health
+  }
+  
+  /// Forgets feeds that aren't in `feeds` anymore
+  func removeFeeds(notIn feeds: [Feed]) {
+    let feedIDs = Set(feeds.map { $0.id })
+    healthByID = healthByID.filter { feedIDs.contains($0.key) }
+  }
+}
@@ -6,15 +6,73 @@ protocol FeedHelperProxyDelegate: AnyObject {
 }
 
 
+/// The feed checking part of `FeedHelperProxy`, which is all `FeedChecker` needs
+protocol FeedCheckService: AnyObject {
+  var delegate: FeedHelperProxyDelegate? { get set }
+  
+  /// See `FeedHelperProxy.checkFeeds(feeds:options:downloadOptions:seenEpisodeUpdate:didDownloadEpisode:didFinishFeed:completion:)`
+  func checkFeeds(
+    feeds: [Feed],
+    options: FeedCheckOptions,
+    downloadOptions: DownloadOptions,
+    seenEpisodeUpdate: SeenEpisodeUpdate,
+    didDownloadEpisode: @escaping (DownloadedEpisode) -> Void,
+    didFinishFeed: @escaping (Feed, FeedCheckReport) -> Void,
+    completion: @escaping (Result<FeedCheckReport, Error>) -> Void
+  )
+  
+  func cancelChecks()
+}
+
+
+/// Receives progress reports from the Feed Helper, and forwards them to the
+/// handlers of the feed check they belong to, on the main queue.
+private final class FeedHelperClientHandler: NSObject {
+  struct ProgressHandlers {
+    var didDownloadEpisode: (DownloadedEpisode) -> Void
+    var didFinishFeed: (Feed, FeedCheckReport) -> Void
+  }
+  
+  /// Keyed by check ID. Only accessed on the main queue.
+  var progressHandlers: [String:ProgressHandlers] = [:]
+}
+
+
+extension FeedHelperClientHandler: FeedHelperClient {
+  func feedCheck(_ checkID: String, didDownloadEpisode downloadedEpisode: Data) {
+    guard let downloadedEpisode = try? FeedHelperPayload.decode(DownloadedEpisode.self, from: downloadedEpisode) else { return }
+    
+    DispatchQueue.main.async {
+      self.progressHandlers[checkID]?.didDownloadEpisode(downloadedEpisode)
+    }
+  }
+  
+  func feedCheck(_ checkID: String, didFinishFeed feed: Data, report: Data) {
+    guard
+      let feed = try? FeedHelperPayload.decode(Feed.self, from: feed),
+      let report = try? FeedHelperPayload.decode(FeedCheckReport.self, from: report)
+    else {
+      return
+    }
+    
+    DispatchQueue.main.async {
+      self.progressHandlers[checkID]?.didFinishFeed(feed, report)
+    }
+  }
+}
+
+
 /// Encapsulates an XPC connection to the Feed Helper service, and handles
 /// serialization/deserialization.
-final class FeedHelperProxy {
+final class FeedHelperProxy: FeedCheckService {
   weak var delegate: FeedHelperProxyDelegate? = nil
   
   private let feedHelperConnection = NSXPCConnection(
     serviceName: "com.giorgiocalderolla.Catch.CatchFeedHelper"
   )
   
+  private let clientHandler = FeedHelperClientHandler()
+  
   private var service: FeedHelperService {
     return feedHelperConnection.remoteObjectProxy as! FeedHelperService
   }
@@ -22,8 +80,12 @@ final class FeedHelperProxy {
   init() {
     // Connect to the feed helper XPC service. Messages will be delivered serially.
     feedHelperConnection.remoteObjectInterface = NSXPCInterface(with: FeedHelperService.self)
+    feedHelperConnection.exportedInterface = NSXPCInterface(with: FeedHelperClient.self)
+    feedHelperConnection.exportedObject = clientHandler
     feedHelperConnection.interruptionHandler = { [weak self] in
       DispatchQueue.main.async {
+        // Replies to pending checks will never come
+        self?.clientHandler.progressHandlers = [:]
         self?.delegate?.feedHelperConnectionWasInterrupted()
       }
     }
@@ -34,37 +96,94 @@ final class FeedHelperProxy {
     feedHelperConnection.invalidate()
   }
   
+  /// - Parameter didDownloadEpisode: called as soon as each new episode is downloaded.
+  ///   These episodes are also included in the final report.
+  /// - Parameter didFinishFeed: called as soon as each feed is done, with a report for that feed only
   func checkFeeds(
     feeds: [Feed],
+    options: FeedCheckOptions,
     downloadOptions: DownloadOptions,
-    previouslyDownloadedURLs: [URL],
-    completion: @escaping (Result<[DownloadedEpisode], Error>) -> Void) {
+    seenEpisodeUpdate: SeenEpisodeUpdate,
+    didDownloadEpisode: @escaping (DownloadedEpisode) -> Void,
+    didFinishFeed: @escaping (Feed, FeedCheckReport) -> Void,
+    completion: @escaping (Result<FeedCheckReport, Error>) -> Void) {
+    let request: Data
+    do {
+      request = try FeedHelperPayload.encode(FeedCheckRequest(
+        feeds: feeds,
+        options: options,
+        downloadOptions: downloadOptions,
+        seenEpisodeUpdate: seenEpisodeUpdate
+      ))
+    } catch {
+      completion(.failure(error))
+      return
+    }
+    
+    let checkID = UUID().uuidString
+    clientHandler.progressHandlers[checkID] = FeedHelperClientHandler.ProgressHandlers(
+      didDownloadEpisode: didDownloadEpisode,
+      didFinishFeed: didFinishFeed
+    )
+    
+    let sendDate = Date()
     service.checkFeeds(
-      feeds: feeds.map { $0.dictionaryRepresentation },
-      downloadingToBookmark: downloadOptions.containerDirectoryBookmark,
-      organizingByShow: downloadOptions.shouldOrganizeByShow,
-      savingMagnetLinks: downloadOptions.shouldSaveMagnetLinks,
-      savingTorrentFiles: downloadOptions.shouldSaveTorrentFiles,
-      skippingURLs: previouslyDownloadedURLs.map { $0.absoluteString },
-      withReply: { downloadedEpisodes, error in
+      checkID: checkID,
+      request: request,
+      withReply: { [clientHandler] report, error in
+        let roundTripDuration = Date().timeIntervalSince(sendDate)
+        
         DispatchQueue.main.async {
-          switch (downloadedEpisodes, error) {
-          case (let rawDownloadedEpisodes?, nil):
-            completion(.success(rawDownloadedEpisodes.map { DownloadedEpisode(dictionary: $0)! }))
+          clientHandler.progressHandlers[checkID] = nil
+          
+          let result: Result<FeedCheckReport, Error>
+          switch (report, error) {
+          case (let rawReport?, nil):
+            result = Result { try FeedHelperPayload.decode(FeedCheckReport.self, from: rawReport) }
           case (nil, let error?):
-            completion(.failure(error))
+            result = .failure(error)
           default:
             fatalError("Bad service reply")
           }
+          
+          MetricsLog.shared.append(MetricsLog.Record(
+            date: sendDate,
+            call: .checkFeeds,
+            roundTripDuration: roundTripDuration,
+            succeeded: (try? result.get()) != nil,
+            feeds: (try? result.get())?.metrics
+          ))
+          
+          completion(result)
         }
       }
     )
   }
   
+  /// Asks the helper to stop all checks in progress. They still complete, with
+  /// what was done until then, and `feedHelperCancelledErrorCode` failures for
+  /// the rest.
+  func cancelChecks() {
+    for checkID in clientHandler.progressHandlers.keys {
+      service.cancelFeedCheck(checkID: checkID)
+    }
+  }
+  
   func download(feed: Feed, completion: @escaping (Result<Data, Error>) -> Void) {
+    let feedPayload: Data
+    do {
+      feedPayload = try FeedHelperPayload.encode(feed)
+    } catch {
+      completion(.failure(error))
+      return
+    }
+    
+    let sendDate = Date()
     service.download(
-      feed: feed.dictionaryRepresentation,
+      feed: feedPayload,
       withReply: { (feedContents, error) in
+        FeedHelperProxy.recordRoundTrip(.downloadFeed, sendDate: sendDate, succeeded: feedContents != nil)
+        
         DispatchQueue.main.async {
           switch (feedContents, error) {
           case (let feedContents?, nil):
@@ -83,17 +202,27 @@ final class FeedHelperProxy {
     episode: Episode,
     downloadOptions: DownloadOptions,
     completion: @escaping (Result<DownloadedEpisode, Error>) -> Void) {
+    let episodePayload: Data
+    let downloadOptionsPayload: Data
+    do {
+      episodePayload = try FeedHelperPayload.encode(episode)
+      downloadOptionsPayload = try FeedHelperPayload.encode(downloadOptions)
+    } catch {
+      completion(.failure(error))
+      return
+    }
+    
+    let sendDate = Date()
     service.download(
-      episode: episode.dictionaryRepresentation,
-      toBookmark: downloadOptions.containerDirectoryBookmark,
-      organizingByShow: downloadOptions.shouldOrganizeByShow,
-      savingMagnetLinks: downloadOptions.shouldSaveMagnetLinks,
-      savingTorrentFiles: downloadOptions.shouldSaveTorrentFiles,
+      episode: episodePayload,
+      downloadOptions: downloadOptionsPayload,
       withReply: { downloadedFile, error in
+        FeedHelperProxy.recordRoundTrip(.downloadEpisode, sendDate: sendDate, succeeded: downloadedFile != nil)
+        
         DispatchQueue.main.async {
           switch (downloadedFile, error) {
           case (let rawDownloadedFile?, nil):
-            completion(.success(DownloadedEpisode(dictionary: rawDownloadedFile)!))
+            completion(Result { try FeedHelperPayload.decode(DownloadedEpisode.self, from: rawDownloadedFile) })
           case (nil, let error?):
             completion(.failure(error))
           default:
@@ -103,4 +232,13 @@ final class FeedHelperProxy {
       }
     )
   }
+  
+  private static func recordRoundTrip(_ call: MetricsLog.Record.Call, sendDate: Date, succeeded: Bool) {
+    MetricsLog.shared.append(MetricsLog.Record(
+      date: sendDate,
+      call: call,
+      roundTripDuration: Date().timeIntervalSince(sendDate),
+      succeeded: succeeded
+    ))
+  }
 }
@@ -0,0 +1,109 @@
+import Foundation
+
+
+private extension TimeInterval {
+  /// How often to check feeds we don't know anything about yet.
+  static let defaultFeedCheckInterval: TimeInterval = 60 * 10
+  
+  /// Bounds for how often to check a feed, depending on how often it publishes.
+  static let minFeedCheckInterval: TimeInterval = 60 * 5
+  static let maxFeedCheckInterval: TimeInterval = 60 * 60 * 2
+  
+  /// Longest wait before checking a feed again, even if it keeps failing or its
+  /// server asks for more.
+  static let maxFeedCheckDelay: TimeInterval = 60 * 60 * 6
+}
+
+
+/// Decides when each feed should be checked next.
+///
+/// Feeds are checked a few times for each new item they are expected to publish,
+/// based on their observed cadence: active feeds are checked more often than
+/// the default, and feeds that have been quiet for a while less and less often.
+/// Feeds and servers can ask for checks to be further apart (`ttl`, `max-age`,
+/// `Retry-After`), and feeds that fail back off exponentially.
+///
+/// - Note: schedules are only kept in memory, all feeds are due when the app starts.
+final class FeedScheduler {
+  private struct Schedule {
+    var nextCheckDate: Date
+    var consecutiveFailures = 0
+  }
+  
+  /// Keyed by feed ID (see `Feed.id`)
+  private var schedules: [String:Schedule] = [:]
+  
+  /// The feeds, among `feeds`, that should be checked at `date`.
+  /// Feeds that were never checked are always due.
+  func dueFeeds(among feeds: [Feed], at date: Date) -> [Feed] {
+    return feeds.filter { feed in
+      guard let schedule = schedules[feed.id] else { return true }
+      return schedule.nextCheckDate <= date
+    }
+  }
+  
+  /// When `feed` should be checked next, if it was ever checked
+  func nextCheckDate(for feed: Feed) -> Date? {
+    return schedules[feed.id]?.nextCheckDate
+  }
+  
+  /// Schedules the next check of a feed that was just checked successfully
+  func feedWasChecked(_ hint: FeedCheckReport.SchedulingHint, at date: Date) {
+    schedules[hint.feed.id] = Schedule(
+      nextCheckDate: date.addingTimeInterval(FeedScheduler.checkInterval(for: hint, at: date))
+    )
+  }
+  
+  /// Schedules the next check of a feed that could not be checked
+  func feedDidFail(_ feed: Feed, hint: FeedCheckReport.SchedulingHint?, at date: Date) {
+    let consecutiveFailures = (schedules[feed.id]?.consecutiveFailures ?? 0) + 1
+    
+    // Back off exponentially, but never retry sooner than the server asked,
+    // or than the feed would have been checked anyway
+    let backoff = TimeInterval.defaultFeedCheckInterval * pow(2, TimeInterval(consecutiveFailures - 1))
+    let delay = [
+      backoff,
+      hint?.retryAfter ?? 0,
+      hint.map { FeedScheduler.checkInterval(for: $0, at: date) } ?? 0
+    ].max()!
+    
+    schedules[feed.id] = Schedule(
+      nextCheckDate: date.addingTimeInterval(min(delay, .maxFeedCheckDelay)),
+      consecutiveFailures: consecutiveFailures
+    )
+  }
+  
+  /// Postpones feeds that were due, but could not be checked at all
+  /// (e.g. because of invalid preferences), by the default interval.
+  func feedsWereSkipped(_ feeds: [Feed], at date: Date) {
+    for feed in feeds {
+      var schedule = schedules[feed.id] ?? Schedule(nextCheckDate: date)
+      schedule.nextCheckDate = date.addingTimeInterval(.defaultFeedCheckInterval)
+      schedules[feed.id] = schedule
+    }
+  }
+  
+  /// Forgets feeds that aren't in `feeds` anymore
+  func removeFeeds(notIn feeds: [Feed]) {
+    let feedIDs = Set(feeds.map { $0.id })
+    schedules = schedules.filter { feedIDs.contains($0.key) }
+  }
+  
+  /// How long to wait before checking a healthy feed again
+  static func checkInterval(for hint: FeedCheckReport.SchedulingHint, at date: Date) -> TimeInterval {
+    var interval = TimeInterval.defaultFeedCheckInterval
+    
+    if let publicationInterval = hint.publicationInterval, let latestPublicationDate = hint.latestPublicationDate {
+      // Check about four times per expected new item. The longer the feed has
+      // been quiet, the less likely it is to publish soon.
+      let quietTime = date.timeIntervalSince(latestPublicationDate)
+      interval = min(max(max(publicationInterval, quietTime) / 4, .minFeedCheckInterval), .maxFeedCheckInterval)
+    }
+    
+    if let timeToLive = hint.timeToLive {
+      interval = max(interval, min(timeToLive, .maxFeedCheckDelay))
+    }
+    
+    return interval
+  }
+}
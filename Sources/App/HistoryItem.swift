@@ -9,6 +9,17 @@ struct HistoryItem: Equatable, Hashable {
   ///
   /// - Note: Very old items might not have a date set.
   var downloadDate: Date?
+  
+  /// Whether the episode was skipped because a copy of it was downloaded from
+  /// another URL. Such items only keep the episode from being downloaded
+  /// again, and aren't listed as recent episodes.
+  var isDuplicate = false
+  
+  init(episode: Episode, downloadDate: Date?, isDuplicate: Bool = false) {
+    self.episode = episode
+    self.downloadDate = downloadDate
+    self.isDuplicate = isDuplicate
+  }
 }
 
 
@@ -0,0 +1,67 @@
+import Foundation
+
+
+/// Show and feed names of the episodes in the download history, each with
+/// the episodes that have it. Lets "Recent Episodes" be searched by comparing
+/// the query with each distinct name once, instead of with every item.
+struct HistorySearchIndex {
+  /// Keyed by name, folded for searching
+  private var episodesByName: [String:Set<Episode>] = [:]
+  
+  init() {}
+  
+  init<Items: Sequence>(_ items: Items) where Items.Element == HistoryItem {
+    insert(items)
+  }
+  
+  mutating func insert<Items: Sequence>(_ items: Items) where Items.Element == HistoryItem {
+    for item in items {
+      for name in HistorySearchIndex.names(of: item.episode) {
+        episodesByName[name, default: []].insert(item.episode)
+      }
+    }
+  }
+  
+  mutating func remove<Items: Sequence>(_ items: Items) where Items.Element == HistoryItem {
+    for item in items {
+      for name in HistorySearchIndex.names(of: item.episode) {
+        episodesByName[name]?.remove(item.episode)
+        if episodesByName[name]?.isEmpty == true {
+          episodesByName[name] = nil
+        }
+      }
+    }
+  }
+  
+  /// Episodes whose show or feed name contains `query`, ignoring case and diacritics
+  func episodes(matching query: String) -> Set<Episode> {
+    let foldedQuery = HistorySearchIndex.fold(query)
+    
+    var episodes: Set<Episode> = []
+    for (name, namedEpisodes) in episodesByName where name.contains(foldedQuery) {
+      episodes.formUnion(namedEpisodes)
+    }
+    return episodes
+  }
+  
+  private static func names(of episode: Episode) -> Set<String> {
+    var names: Set<String> = [fold(episode.feedDisplayName)]
+    if let showName = episode.showName ?? episode.numbering?.showName {
+      names.insert(fold(showName))
+    }
+    return names
+  }
+  
+  private static func fold(_ string: String) -> String {
+    return string.folding(options: [.caseInsensitive, .diacriticInsensitive], locale: nil)
+  }
+}
+
+
+extension Episode {
+  /// Name of the feed the episode came from, for display. Very old episodes
+  /// don't know their feed, and came from ShowRSS.
+  var feedDisplayName: String {
+    return feed?.name ?? "ShowRSS"
+  }
+}
@@ -0,0 +1,181 @@
+import Foundation
+import os
+
+
+/// Persists the download history as an append-only log, one JSON record per
+/// line, so that recording new downloads only costs as much as the new items.
+///
+/// Each record adds or removes one item. Once the log is mostly made of
+/// superseded records, it gets rewritten with just the current items.
+/// Writes happen in the background, in order.
+final class HistoryStore {
+  fileprivate enum Operation: String {
+    case add, remove
+  }
+  
+  /// Default location of the log, in the app's Application Support directory
+  static let defaultFileURL: URL? = FileManager.default
+    .urls(for: .applicationSupportDirectory, in: .userDomainMask)
+    .first?
+    .appendingPathComponent(Bundle.main.bundleIdentifier ?? "com.giorgiocalderolla.Catch")
+    .appendingPathComponent("History.log")
+  
+  private let fileURL: URL
+  private let queue = DispatchQueue(label: "com.giorgiocalderolla.Catch.HistoryStore")
+  
+  /// Number of records in the log, including superseded ones
+  private var recordCount = 0
+  
+  init(fileURL: URL) {
+    self.fileURL = fileURL
+  }
+  
+  var exists: Bool {
+    return FileManager.default.fileExists(atPath: fileURL.path)
+  }
+  
+  /// Replays the whole log. Returns items in the order they were added.
+  func load() -> [HistoryItem] {
+    guard let data = try? Data(contentsOf: fileURL) else { return [] }
+    
+    // Removed items are left as nil, so removing is O(1)
+    var items: [HistoryItem?] = []
+    var indexesByEpisode: [Episode:Int] = [:]
+    recordCount = 0
+    
+    for line in data.split(separator: UInt8(ascii: "\n")) {
+      guard
+        let record = (try? JSONSerialization.jsonObject(with: line)) as? [String:Any],
+        let operation = (record["op"] as? String).flatMap(Operation.init(rawValue:)),
+        let item = HistoryItem(logRecord: record)
+      else {
+        os_log("Skipping unreadable history record", log: .main, type: .error)
+        continue
+      }
+      
+      recordCount += 1
+      
+      switch operation {
+      case .add:
+        // The first copy of an episode wins, like in `Defaults.downloadHistory`
+        guard indexesByEpisode[item.episode] == nil else { continue }
+        indexesByEpisode[item.episode] = items.count
+        items.append(item)
+      case .remove:
+        guard let index = indexesByEpisode.removeValue(forKey: item.episode) else { continue }
+        items[index] = nil
+      }
+    }
+    
+    return items.compactMap { $0 }
+  }
+  
+  /// Records new items at the end of the log
+  func append(_ items: [HistoryItem]) {
+    write(items.map { $0.logRecord(operation: .add) })
+  }
+  
+  /// Records the removal of items at the end of the log
+  func remove(_ items: [HistoryItem]) {
+    write(items.map { $0.logRecord(operation: .remove) })
+  }
+  
+  /// Rewrites the log from scratch if most of it is superseded by later records.
+  ///
+  /// - Parameter liveItems: everything that's currently in the history
+  func compactIfNeeded<Items: Collection>(liveItems: Items) where Items.Element == HistoryItem {
+    guard recordCount > 2 * liveItems.count + 100 else { return }
+    compact(liveItems: liveItems)
+  }
+  
+  /// Rewrites the log from scratch, with one record per item.
+  func compact<Items: Collection>(liveItems: Items) where Items.Element == HistoryItem {
+    let records = liveItems.map { $0.logRecord(operation: .add) }
+    recordCount = records.count
+    
+    queue.async { [fileURL] in
+      do {
+        try HistoryStore.createDirectory(for: fileURL)
+        try HistoryStore.serialize(records).write(to: fileURL, options: .atomic)
+        os_log("Compacted history log to %d records", log: .main, type: .info, records.count)
+      } catch {
+        os_log("Could not compact history log: %{public}@", log: .main, type: .error, error.localizedDescription)
+      }
+    }
+  }
+  
+  /// Waits for pending writes to complete
+  func flush() {
+    queue.sync {}
+  }
+  
+  private func write(_ records: [[String:Any]]) {
+    guard !records.isEmpty else { return }
+    recordCount += records.count
+    
+    queue.async { [fileURL] in
+      do {
+        try HistoryStore.createDirectory(for: fileURL)
+        if !FileManager.default.fileExists(atPath: fileURL.path) {
+          FileManager.default.createFile(atPath: fileURL.path, contents: nil)
+        }
+        let fileHandle = try FileHandle(forWritingTo: fileURL)
+        defer { fileHandle.closeFile() }
+        fileHandle.seekToEndOfFile()
+        fileHandle.write(try HistoryStore.serialize(records))
+      } catch {
+        os_log("Could not write to history log: %{public}@", log: .main, type: .error, error.localizedDescription)
+      }
+    }
+  }
+  
+  private static func serialize(_ records: [[String:Any]]) throws -> Data {
+    var data = Data()
+    for record in records {
+      data.append(try JSONSerialization.data(withJSONObject: record))
+      data.append(UInt8(ascii: "\n"))
+    }
+    return data
+  }
+  
+  private static func createDirectory(for fileURL: URL) throws {
+    try FileManager.default.createDirectory(
+      at: fileURL.deletingLastPathComponent(),
+      withIntermediateDirectories: true
+    )
+  }
+}
+
+
+// MARK: Log records
+private extension HistoryItem {
+  /// Like `dictionaryRepresentation`, but JSON-friendly
+  func logRecord(operation: HistoryStore.Operation) -> [String:Any] {
+    var record: [String:Any] = [
+      "op": operation.rawValue,
+      "title": episode.title,
+      "url": episode.url.absoluteString
+    ]
+    if let showName = episode.showName {
+      record["showName"] = showName
+    }
+    if let downloadDate = downloadDate {
+      record["date"] = downloadDate.timeIntervalSince1970
+    }
+    if let feed = episode.feed {
+      record["feed"] = feed.dictionaryRepresentation
+    }
+    if isDuplicate {
+      record["duplicate"] = true
+    }
+    return record
+  }
+  
+  init?(logRecord: [String:Any]) {
+    guard let episode = Episode(dictionary: logRecord) else { return nil }
+    
+    self.episode = episode
+    self.downloadDate = (logRecord["date"] as? TimeInterval).map(Date.init(timeIntervalSince1970:))
+    self.isDuplicate = logRecord["duplicate"] as? Bool ?? false
+  }
+}
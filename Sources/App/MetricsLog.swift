@@ -0,0 +1,102 @@
+import Foundation
+import os
+
+
+private extension Int {
+  /// Size after which the log is rotated
+  static let maxMetricsLogSize = 1024 * 1024
+}
+
+
+/// Singleton. Records how long Feed Helper calls take, along with the metrics
+/// the helper collects for each feed, so that cycle times can be analyzed and
+/// compared across versions.
+///
+/// Records are appended to a local file, one JSON object per line. When the
+/// file gets too big, it's renamed with a ".1" suffix (replacing the previous
+/// one) and a new one is started.
+final class MetricsLog {
+  struct Record: Codable {
+    enum Call: String, Codable {
+      case checkFeeds, downloadFeed, downloadEpisode
+    }
+    
+    var date: Date
+    var call: Call
+    
+    /// From sending the XPC message to receiving the reply
+    var roundTripDuration: TimeInterval
+    
+    var succeeded: Bool
+    
+    /// For feed checks, what happened with each feed
+    var feeds: [FeedMetrics]? = nil
+  }
+  
+  static let shared = MetricsLog(
+    fileURL: FileManager.default
+      .urls(for: .applicationSupportDirectory, in: .userDomainMask)
+      .first?
+      .appendingPathComponent(Bundle.main.bundleIdentifier ?? "com.giorgiocalderolla.Catch")
+      .appendingPathComponent("Metrics.log")
+  )
+  
+  private let fileURL: URL?
+  private let queue = DispatchQueue(label: "com.giorgiocalderolla.Catch.MetricsLog")
+  private let encoder: JSONEncoder = {
+    let encoder = JSONEncoder()
+    encoder.dateEncodingStrategy = .secondsSince1970
+    return encoder
+  }()
+  
+  init(fileURL: URL?) {
+    self.fileURL = fileURL
+  }
+  
+  /// Appends `record` to the log, in the background
+  func append(_ record: Record) {
+    queue.async { [fileURL, encoder] in
+      guard let fileURL = fileURL else { return }
+      
+      do {
+        var line = try encoder.encode(record)
+        line.append(UInt8(ascii: "\n"))
+        
+        try FileManager.default.createDirectory(
+          at: fileURL.deletingLastPathComponent(),
+          withIntermediateDirectories: true
+        )
+        MetricsLog.rotateIfNeeded(fileURL)
+        if !FileManager.default.fileExists(atPath: fileURL.path) {
+          FileManager.default.createFile(atPath: fileURL.path, contents: nil)
+        }
+        
+        let fileHandle = try FileHandle(forWritingTo: fileURL)
+        defer { fileHandle.closeFile() }
+        fileHandle.seekToEndOfFile()
+        fileHandle.write(line)
+      } catch {
+        os_log("Could not write to metrics log: %{public}@", log: .main, type: .error, error.localizedDescription)
+      }
+    }
+  }
+  
+  /// Waits for pending writes to complete
+  func flush() {
+    queue.sync {}
+  }
+  
+  private static func rotateIfNeeded(_ fileURL: URL) {
+    guard
+      let attributes = try? FileManager.default.attributesOfItem(atPath: fileURL.path),
+      let size = attributes[.size] as? Int,
+      size > .maxMetricsLogSize
+    else {
+      return
+    }
+    
+    let rotatedFileURL = fileURL.appendingPathExtension("1")
+    try? FileManager.default.removeItem(at: rotatedFileURL)
+    try? FileManager.default.moveItem(at: fileURL, to: rotatedFileURL)
+  }
+}
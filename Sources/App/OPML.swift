@@ -2,108 +2,224 @@ import Foundation
 import os
 
 
-private extension XMLNode {
-  subscript(xPath: String) -> String? {
-    return (try? nodes(forXPath: xPath))?.last?.stringValue
+/// Feeds read from an OPML file, along with what couldn't be read
+struct OPMLImport {
+  /// An outline that looked like a feed, but couldn't be imported
+  struct InvalidEntry {
+    /// Line of the outline element in the file
+    var line: Int
+    
+    /// The outline's title or URL, whatever it has
+    var text: String?
+    
+    var reason: String
   }
+  
+  /// In document order, one per feed URL (see `URL.feedKey`)
+  var feeds: [Feed] = []
+  
+  var invalidEntries: [InvalidEntry] = []
+  
+  /// Outlines for feeds that were already in the file, under another outline
+  var duplicateCount = 0
 }
 
 
-private extension Feed {
-  /// Try to initialize an episode with the data found in an RSS "item" or Atom "entry" element
-  init?(itemNode: XMLNode) {
-    // Get the item URL
-    guard let urlString = itemNode["@xmlUrl"] else {
-      os_log("Missing feed URL", log: .main, type: .info)
-      return nil
-    }
+/// Parses feeds out of an OPML file in a single pass with `XMLParser`, without
+/// loading the whole document in memory.
+///
+/// Every `outline` inside `body` that has an `xmlUrl` is a feed, and every one
+/// that doesn't is a folder, which is recorded in `Feed.folder`.
+struct OPMLParser {
+  func parse(opml: Data) throws -> [Feed] {
+    return try importFeeds(opml: opml).feeds
+  }
+  
+  func importFeeds(opml: Data) throws -> OPMLImport {
+    os_log("Parsing OPML file", log: .main, type: .info)
     
-    guard let url = URL(string: urlString) else {
-      os_log("Invalid feed URL: %{public}@", log: .main, type: .info, urlString)
-      return nil
-    }
+    let result = try OPMLStreamingParser(opml: opml).parse()
     
-    // Get the name
-    guard let name = itemNode["@title"] ?? itemNode["@text"], name != "" else {
-      os_log("Missing or empty feed title", log: .main, type: .info)
-      return nil
-    }
+    os_log("Parsed %d feeds, %d invalid, %d duplicates", log: .main, type: .info, result.feeds.count, result.invalidEntries.count, result.duplicateCount)
     
-    self.name = name
-    self.url = url
+    return result
   }
+}
+
+
+private final class OPMLStreamingParser: NSObject, XMLParserDelegate {
+  private let parser: XMLParser
+  
+  /// Names of the currently open elements, outermost first
+  private var elementStack: [String] = []
+  
+  /// For each open outline, its name if it's a folder, or nil if it's a feed
+  private var outlineStack: [String?] = []
+  
+  private var result = OPMLImport()
+  private var feedKeys: Set<String> = []
   
-  var outlineElement: XMLElement {
-    let outlineElement = XMLElement(name: "outline")
+  init(opml: Data) {
+    parser = XMLParser(data: opml)
+    parser.shouldResolveExternalEntities = false
     
-    let titleAttribute = XMLNode(kind: .attribute)
-    titleAttribute.name = "title"
-    titleAttribute.stringValue = name
+    super.init()
     
-    let textAttribute = XMLNode(kind: .attribute)
-    textAttribute.name = "text"
-    textAttribute.stringValue = name
+    parser.delegate = self
+  }
+  
+  func parse() throws -> OPMLImport {
+    guard parser.parse() else {
+      throw parser.parserError ?? NSError(
+        domain: XMLParser.errorDomain,
+        code: XMLParser.ErrorCode.internalError.rawValue
+      )
+    }
     
-    let typeAttribute = XMLNode(kind: .attribute)
-    typeAttribute.name = "type"
-    typeAttribute.stringValue = "rss"
+    return result
+  }
+  
+  private var isInBody: Bool {
+    return elementStack.starts(with: ["opml", "body"])
+  }
+  
+  func parser(_ parser: XMLParser, didStartElement elementName: String, namespaceURI: String?, qualifiedName: String?, attributes: [String:String] = [:]) {
+    defer { elementStack.append(elementName) }
     
-    let xmlURLAttribute = XMLNode(kind: .attribute)
-    xmlURLAttribute.name = "xmlUrl"
-    xmlURLAttribute.stringValue = url.absoluteString
+    guard elementName == "outline", isInBody else { return }
     
-    outlineElement.addAttribute(titleAttribute)
-    outlineElement.addAttribute(textAttribute)
-    outlineElement.addAttribute(typeAttribute)
-    outlineElement.addAttribute(xmlURLAttribute)
+    let name = [attributes["title"], attributes["text"]].lazy.compactMap { $0 }.first { !$0.isEmpty }
     
-    return outlineElement
-  }
-}
-
-// Parses feeds out of an OPML file.
-struct OPMLParser {
-  func parse(opml: Data) throws -> [Feed] {
-    os_log("Parsing OPML file", log: .main, type: .info)
+    // Outlines without a feed URL are folders
+    guard let urlString = attributes["xmlUrl"] else {
+      outlineStack.append(name ?? "")
+      return
+    }
+    outlineStack.append(nil)
     
-    // Parse xml
-    let xml = try XMLDocument(data: opml)
+    guard let url = URL(string: urlString.trimmingCharacters(in: .whitespacesAndNewlines)), url.isValidFeedURL else {
+      reportInvalidEntry(text: name ?? urlString, reason: NSLocalizedString("Invalid feed URL", comment: ""))
+      return
+    }
     
-    // Extract feed item nodes
-    let outlineNodes = try xml.nodes(forXPath: "//opml/body//outline")
+    guard let feedName = name else {
+      reportInvalidEntry(text: urlString, reason: NSLocalizedString("Missing feed title", comment: ""))
+      return
+    }
     
-    // Extract episodes from NSXMLNodes
-    let feeds = outlineNodes.compactMap(Feed.init(itemNode:))
+    guard feedKeys.insert(url.feedKey).inserted else {
+      result.duplicateCount += 1
+      return
+    }
     
-    os_log("Parsed %d feeds", log: .main, type: .info, feeds.count)
+    let folder = outlineStack.dropLast().compactMap { $0 }.filter { !$0.isEmpty }
+    result.feeds.append(Feed(name: feedName, url: url, folder: folder))
+  }
+  
+  func parser(_ parser: XMLParser, didEndElement elementName: String, namespaceURI: String?, qualifiedName: String?) {
+    elementStack.removeLast()
     
-    return feeds
+    if elementName == "outline" && isInBody {
+      outlineStack.removeLast()
+    }
+  }
+  
+  private func reportInvalidEntry(text: String?, reason: String) {
+    os_log("%{public}@ in OPML: %{public}@", log: .main, type: .info, reason, text ?? "")
+    result.invalidEntries.append(OPMLImport.InvalidEntry(line: parser.lineNumber, text: text, reason: reason))
   }
 }
 
-// Creates an OPML file from feeds.
+
+/// Creates an OPML file from feeds, writing it out directly instead of building
+/// an `XMLDocument`. Feeds are grouped in folder outlines by `Feed.folder`, in
+/// the order folders first appear, otherwise keeping the order of the feeds.
 struct OPMLSerializer {
-  func serialize(feeds: [Feed]) throws -> Data {
-    os_log("Serializing OPML file", log: .main, type: .info)
-    
-    let xml = XMLDocument()
-    xml.characterEncoding = "utf-8"
+  /// A folder outline, or the body for the root
+  private final class FolderNode {
+    let name: String
+    var children: [Child] = []
+    var subfolders: [String:FolderNode] = [:]
+    
+    enum Child {
+      case feed(Feed)
+      case folder(FolderNode)
+    }
     
-    let opmlElement = XMLElement(name: "opml")
+    init(name: String) {
+      self.name = name
+    }
     
-    let headElement = XMLElement(name: "head")
-    let bodyElement = XMLElement(name: "body")
+    func subfolder(named name: String) -> FolderNode {
+      if let subfolder = subfolders[name] {
+        return subfolder
+      }
+      
+      let subfolder = FolderNode(name: name)
+      subfolders[name] = subfolder
+      children.append(.folder(subfolder))
+      return subfolder
+    }
+  }
+  
+  func serialize(feeds: [Feed]) -> Data {
+    os_log("Serializing OPML file", log: .main, type: .info)
     
-    let outlineElements = feeds.map(\.outlineElement)
-    for outlineElement in outlineElements {
-      bodyElement.addChild(outlineElement)
+    let root = FolderNode(name: "")
+    for feed in feeds {
+      let folder = feed.folder.reduce(root) { $0.subfolder(named: $1) }
+      folder.children.append(.feed(feed))
     }
     
-    opmlElement.addChild(headElement)
-    opmlElement.addChild(bodyElement)
+    var output = Data()
+    output.append(#"<?xml version="1.0" encoding="utf-8"?>"#)
+    output.append("\n<opml version=\"2.0\">\n  <head/>\n  <body>\n")
+    write(root.children, depth: 2, to: &output)
+    output.append("  </body>\n</opml>\n")
     
-    xml.addChild(opmlElement)
+    return output
+  }
+  
+  private func write(_ children: [FolderNode.Child], depth: Int, to output: inout Data) {
+    let indentation = String(repeating: "  ", count: depth)
+    
+    for child in children {
+      switch child {
+      case .feed(let feed):
+        let name = escaped(feed.name)
+        output.append("\(indentation)<outline title=\"\(name)\" text=\"\(name)\" type=\"rss\" xmlUrl=\"\(escaped(feed.url.absoluteString))\"/>\n")
+      case .folder(let folder):
+        let name = escaped(folder.name)
+        output.append("\(indentation)<outline title=\"\(name)\" text=\"\(name)\">\n")
+        write(folder.children, depth: depth + 1, to: &output)
+        output.append("\(indentation)</outline>\n")
+      }
+    }
+  }
+  
+  /// Escapes `string` for use in an attribute value
+  private func escaped(_ string: String) -> String {
+    var escaped = ""
+    escaped.reserveCapacity(string.utf8.count)
+    for character in string.unicodeScalars {
+      switch character {
+      case "&": escaped += "&amp;"
+      case "<": escaped += "&lt;"
+      case ">": escaped += "&gt;"
+      case "\"": escaped += "&quot;"
+      case "\n": escaped += "&#10;"
+      case "\r": escaped += "&#13;"
+      case "\t": escaped += "&#9;"
+      default: escaped.unicodeScalars.append(character)
+      }
+    }
+    return escaped
+  }
+}
+
 
-    return xml.xmlData(options: [.nodeCompactEmptyElement, .nodePrettyPrint])
+private extension Data {
+  mutating func append(_ string: String) {
+    append(contentsOf: string.utf8)
   }
 }
@@ -88,6 +88,14 @@ class PreferencesController: NSWindowController {
       copyAddressItem.target = self
       feedsTableContextMenu.addItem(copyAddressItem)
       
+      let editFeedItem = NSMenuItem(
+        title: NSLocalizedString("Edit Feed…", comment: ""),
+        action: #selector(editFeed),
+        keyEquivalent: ""
+      )
+      editFeedItem.target = self
+      feedsTableContextMenu.addItem(editFeedItem)
+      
       let showContentsItem = NSMenuItem(
         title: NSLocalizedString("Show Contents", comment: ""),
         action: #selector(showContents),
@@ -158,10 +166,9 @@ extension PreferencesController {
   }
   
   @IBAction private func removeSelectedFeeds(_: Any?) {
-    for feedIndex in feedsTableView.selectedRowIndexes.reversed() {
-      let feedToRemove = sortedFeedList[feedIndex]
-      Defaults.shared.feeds.removeAll { $0 == feedToRemove }
-    }
+    // All at once, so that the feed list is only written once
+    let feedsToRemove = Set(feedsTableView.selectedRowIndexes.map { sortedFeedList[$0] })
+    Defaults.shared.feeds.removeAll { feedsToRemove.contains($0) }
   }
   
   @IBAction private func importFromOPMLFile(_: Any?) {
@@ -175,27 +182,50 @@ extension PreferencesController {
     openPanel.beginSheetModal(for: window) { response in
       guard response == .OK, let url = openPanel.url else { return }
       
+      let opmlImport: OPMLImport
       do {
-        let data = try Data(contentsOf: url)
-        let parsedFeeds = try OPMLParser().parse(opml: data)
-        Defaults.shared.feeds += parsedFeeds
+        let data = try Data(contentsOf: url, options: .mappedIfSafe)
+        opmlImport = try OPMLParser().importFeeds(opml: data)
       } catch {
         os_log("Couldn't parse OPML: %{public}@", log: .main, type: .error, error.localizedDescription)
+        return
+      }
+      
+      let addedFeeds = Defaults.shared.mergeFeeds(opmlImport.feeds)
+      os_log("Imported %d new feeds from OPML", log: .main, type: .info, addedFeeds.count)
+      
+      if !opmlImport.invalidEntries.isEmpty {
+        self.showInvalidOPMLEntries(opmlImport.invalidEntries, importedFeedCount: addedFeeds.count)
       }
     }
   }
   
-  @IBAction private func exportToOPMLFile(_: Any?) {
+  private func showInvalidOPMLEntries(_ invalidEntries: [OPMLImport.InvalidEntry], importedFeedCount: Int) {
     guard let window = self.window else { return }
     
-    let data: Data
-    do {
-      data = try OPMLSerializer().serialize(feeds: Defaults.shared.feeds)
-    } catch {
-      os_log("Couldn't serialize OPML: %{public}@", log: .main, type: .error, error.localizedDescription)
-      return
+    let maxListedEntries = 10
+    var lines = invalidEntries.prefix(maxListedEntries).map { entry in
+      String(format: NSLocalizedString("%@ (%@, line %d)", comment: ""), entry.text ?? "?", entry.reason, entry.line)
+    }
+    if invalidEntries.count > maxListedEntries {
+      lines.append(String(format: NSLocalizedString("…and %d more", comment: ""), invalidEntries.count - maxListedEntries))
     }
     
+    let alert = NSAlert()
+    alert.messageText = String(
+      format: NSLocalizedString("Imported %d feeds, %d could not be imported", comment: ""),
+      importedFeedCount,
+      invalidEntries.count
+    )
+    alert.informativeText = lines.joined(separator: "\n")
+    alert.beginSheetModal(for: window)
+  }
+  
+  @IBAction private func exportToOPMLFile(_: Any?) {
+    guard let window = self.window else { return }
+    
+    let data = OPMLSerializer().serialize(feeds: Defaults.shared.feeds)
+    
     let savePanel = NSSavePanel()
     savePanel.nameFieldStringValue = "Catch.xml"
 
@@ -267,6 +297,13 @@ extension PreferencesController {
     NSPasteboard.general.setString(feed.url.absoluteString, forType: .string)
   }
   
+  @IBAction func editFeed(_ sender: Any?) {
+    guard let feed = clickedFeed() else { return }
+    
+    addFeedSheetController.edit(feed)
+    window?.beginSheet(addFeedSheetController.window!, completionHandler: nil)
+  }
+  
   @IBAction func showContents(_ sender: Any?) {
     guard let feed = clickedFeed() else { return }
     
@@ -8,17 +8,33 @@ private extension NSUserInterfaceItemIdentifier {
 
 
 /// Manages the "Recent Episodes" window.
+///
+/// The table is updated row by row as episodes are added to and removed from
+/// the download history, rather than reloaded, so that it stays responsive
+/// with big histories. Rows can be filtered by show or feed name.
 class RecentsController: NSWindowController {
   @IBOutlet private weak var table: NSTableView!
   
   private let contextMenu = NSMenu(title: "")
+  private let searchField = NSSearchField()
   
   private let downloadDateFormatter = DateFormatter()
   private let feedHelperProxy = FeedHelperProxy()
   
-  private var sortedHistory: [HistoryItem] = []
+  /// Episodes of the download history that were actually downloaded, as
+  /// currently shown in the table
+  private var sortedHistory = DownloadHistory()
+  private var searchIndex = HistorySearchIndex()
+  
+  /// Items matching the search field, newest to oldest. Nil when not searching.
+  private var filteredHistory: [HistoryItem]? = nil
+  
+  /// Formatted subtitles of the rows shown so far. Download dates are formatted
+  /// relative to today, so they're reset when the day changes.
+  private var subtitles: [Episode:String] = [:]
   
   private var downloadHistoryObserver: NSObjectProtocol? = nil
+  private var dayChangeObserver: NSObjectProtocol? = nil
   
   // Remember if awakeFromNib has been called
   private var awake: Bool = false
@@ -50,11 +66,33 @@ class RecentsController: NSWindowController {
       forName: Defaults.downloadHistoryChangedNotification,
       object: Defaults.shared,
       queue: nil,
+      using: { [weak self] notification in
+        self?.downloadHistoryDidChange(notification.userInfo?[Defaults.downloadHistoryChangeKey] as? DownloadHistoryChange)
+      }
+    )
+    
+    dayChangeObserver = NotificationCenter.default.addObserver(
+      forName: .NSCalendarDayChanged,
+      object: nil,
+      queue: .main,
       using: { [weak self] _ in
-        self?.reloadHistory()
+        self?.subtitles = [:]
+        self?.table.reloadData()
       }
     )
     
+    // Search by show or feed name, below the title bar
+    searchField.placeholderString = NSLocalizedString("Search Shows and Feeds", comment: "")
+    searchField.target = self
+    searchField.action = #selector(searchQueryChanged)
+    searchField.frame = NSRect(x: 8, y: 4, width: 284, height: 22)
+    searchField.autoresizingMask = [.width]
+    let searchBar = NSTitlebarAccessoryViewController()
+    searchBar.view = NSView(frame: NSRect(x: 0, y: 0, width: 300, height: 30))
+    searchBar.view.addSubview(searchField)
+    searchBar.layoutAttribute = .bottom
+    window?.addTitlebarAccessoryViewController(searchBar)
+    
     let copyURLItem = NSMenuItem(
       title: NSLocalizedString("Copy Link", comment: ""),
       action: #selector(copyURL),
@@ -77,13 +115,95 @@ class RecentsController: NSWindowController {
   }
   
   private func reloadHistory() {
-    // Keep a sorted copy of the download history, in reverse cronological order
-    sortedHistory = Defaults.shared.downloadHistory
+    // Keep a copy of the download history, without duplicates. Oldest first,
+    // so that each item is appended.
+    sortedHistory = DownloadHistory()
+    sortedHistory.insert(Defaults.shared.downloadHistory.reversed().filter { !$0.isDuplicate }, limit: .max)
+    searchIndex = HistorySearchIndex(sortedHistory)
+    subtitles = [:]
+    applySearch()
     table.reloadData()
   }
   
+  /// Updates the table with `change`, or reloads everything if there isn't one
+  private func downloadHistoryDidChange(_ change: DownloadHistoryChange?) {
+    guard let change = change else {
+      reloadHistory()
+      return
+    }
+    
+    let removedItems = change.removed.filter { !$0.isDuplicate }
+    let insertedItems = change.inserted.filter { !$0.isDuplicate }
+    guard !removedItems.isEmpty || !insertedItems.isEmpty else { return }
+    
+    let oldHistory = sortedHistory
+    for removedItem in removedItems {
+      sortedHistory.remove(removedItem.episode)
+    }
+    sortedHistory.insert(insertedItems, limit: .max)
+    searchIndex.remove(removedItems)
+    searchIndex.insert(insertedItems)
+    for removedItem in removedItems {
+      subtitles[removedItem.episode] = nil
+    }
+    
+    // Search results are small, just filter them again
+    guard filteredHistory == nil else {
+      applySearch()
+      table.reloadData()
+      return
+    }
+    
+    // Removed rows are numbered as they were, inserted ones as they are now
+    let removedRows = IndexSet(removedItems.compactMap(oldHistory.position))
+    let insertedRows = IndexSet(insertedItems.compactMap(sortedHistory.position))
+    guard oldHistory.count - removedRows.count + insertedRows.count == sortedHistory.count else {
+      table.reloadData()
+      return
+    }
+    
+    table.beginUpdates()
+    table.removeRows(at: removedRows, withAnimation: [])
+    table.insertRows(at: insertedRows, withAnimation: [])
+    table.endUpdates()
+  }
+  
+  private func applySearch() {
+    let query = searchField.stringValue.trimmingCharacters(in: .whitespaces)
+    guard !query.isEmpty else {
+      filteredHistory = nil
+      return
+    }
+    
+    let matchingEpisodes = searchIndex.episodes(matching: query)
+    filteredHistory = sortedHistory.filter { matchingEpisodes.contains($0.episode) }
+  }
+  
+  /// The item shown in `row`
+  private func historyItem(at row: Int) -> HistoryItem {
+    return filteredHistory?[row] ?? sortedHistory[row]
+  }
+  
+  private func subtitle(for historyItem: HistoryItem) -> String {
+    if let subtitle = subtitles[historyItem.episode] {
+      return subtitle
+    }
+    
+    let feedName = historyItem.episode.feedDisplayName
+    
+    let subtitle: String
+    if let formattedDownloadDate = historyItem.downloadDate.map(downloadDateFormatter.string) {
+      subtitle = "\(feedName) • \(formattedDownloadDate)"
+    } else {
+      subtitle = feedName
+    }
+    
+    subtitles[historyItem.episode] = subtitle
+    return subtitle
+  }
+  
   deinit {
-    if let observer = downloadHistoryObserver {
+    for observer in [downloadHistoryObserver, dayChangeObserver].compactMap({ $0 }) {
       NotificationCenter.default.removeObserver(observer)
     }
   }
@@ -92,7 +212,7 @@ class RecentsController: NSWindowController {
 
 extension RecentsController: NSTableViewDataSource {
   func numberOfRows(in tableView: NSTableView) -> Int {
-    return sortedHistory.count
+    return filteredHistory?.count ?? sortedHistory.count
   }
 }
 
@@ -100,26 +220,14 @@ extension RecentsController: NSTableViewDataSource {
 extension RecentsController: NSTableViewDelegate {
   func tableView(_ tableView: NSTableView, viewFor tableColumn: NSTableColumn?, row: Int) -> NSView? {
     // Get the item to display
-    let historyItem = sortedHistory[row]
+    let historyItem = self.historyItem(at: row)
     
     guard let cell = tableView.makeView(withIdentifier: .recentsCell, owner: self) as? RecentsCellView else {
       return nil
     }
     
     cell.textField?.stringValue = historyItem.episode.title
-    
-    let formattedDownloadDate = historyItem.downloadDate.map(downloadDateFormatter.string)
-    
-    let feedName = historyItem.episode.feed?.name ?? "ShowRSS"
-    
-    let subtitle: String
-    if let formattedDownloadDate = formattedDownloadDate {
-      subtitle = "\(feedName) • \(formattedDownloadDate)"
-    } else {
-      subtitle = feedName
-    }
-    
-    cell.downloadDateTextField.stringValue = subtitle
+    cell.downloadDateTextField.stringValue = subtitle(for: historyItem)
     
     return cell
   }
@@ -139,10 +247,11 @@ extension RecentsController {
   
   @IBAction private func downloadRecentItemAgain(_ senderButton: NSButton) {
     let clickedRow = table.row(for: senderButton)
-    let recentEpisode = Defaults.shared.downloadHistory[clickedRow].episode
+    guard clickedRow != -1 else { return }
+    let recentEpisode = historyItem(at: clickedRow).episode
     
     if Defaults.shared.isDownloadScriptEnabled {
-      Process.runDownloadScript(url: recentEpisode.url)
+      DownloadScriptExecutor.shared.runDownloadScript(urls: [recentEpisode.url], ignoringPause: true)
     } else {
       if recentEpisode.url.isMagnetLink {
         NSWorkspace.shared.openInBackground(url: recentEpisode.url)
@@ -173,7 +282,12 @@ extension RecentsController {
   private func clickedHistoryItem() -> HistoryItem? {
     let clickedRow = table.clickedRow
     guard clickedRow != -1 else { return nil }
-    return sortedHistory[clickedRow]
+    return historyItem(at: clickedRow)
+  }
+  
+  @objc private func searchQueryChanged(_ sender: NSSearchField) {
+    applySearch()
+    table.reloadData()
   }
   
   @IBAction func copyURL(_ sender: Any?) {
@@ -190,6 +304,6 @@ extension RecentsController {
   @IBAction func deleteHistoryItem(_ sender: Any?) {
     guard let clickedHistoryItem = clickedHistoryItem() else { return }
     
-    Defaults.shared.downloadHistory.removeAll { $0 == clickedHistoryItem }
+    Defaults.shared.removeFromDownloadHistory(clickedHistoryItem)
   }
 }
@@ -2,35 +2,161 @@ import Foundation
 import os
 
 
-extension Process {
-  static func runDownloadScript(url: URL, completion: ((Bool) -> ())? = nil) {
-    if Defaults.shared.isDownloadScriptEnabled, let downloadScriptPath = Defaults.shared.downloadScriptPath {
-      os_log("Running download script", log: .main, type: .info)
-      
-      let script = Process()
-      script.launchPath = downloadScriptPath.path
-      script.arguments = [url.absoluteString]
-      script.terminationHandler = { process in
-        DispatchQueue.main.async {
-          let success = process.terminationStatus == 0
-          completion?(success)
-          
-          if !success {
-            os_log("Script termination status: %d", log: .main, type: .error, process.terminationStatus)
-          }
-        }
+/// How the download script is run. Not exposed in the UI.
+struct DownloadScriptOptions {
+  /// How many instances of the script can run at the same time
+  var maxConcurrentRuns: Int = 2
+  
+  /// How long a run can take before it's terminated and counted as failed
+  var timeout: TimeInterval = 60 * 10
+  
+  /// How many episode URLs to pass to each run of the script, as separate
+  /// arguments. 1 runs the script once per episode.
+  var batchSize: Int = 1
+}
+
+
+/// Singleton. Runs the download script on episode URLs, a few runs at a time,
+/// so that big batches of episodes don't start dozens of processes at once.
+///
+/// Runs that can't start yet wait in a queue, in order. While the executor is
+/// paused, queued runs stay in the queue (runs already started are left alone),
+/// and they start when it's resumed.
+///
+/// - Note: must only be used from the main queue.
+final class DownloadScriptExecutor {
+  static let shared = DownloadScriptExecutor()
+  
+  /// Applies to runs that start after it's changed
+  var options = DownloadScriptOptions()
+  
+  var isPaused = false {
+    didSet {
+      if oldValue && !isPaused {
+        startQueuedRuns()
       }
-      
-      if #available(macOS 10.13, *) {
-        do {
-          try script.run()
-        } catch {
-          os_log("Couldn't run script: %{public}@", log: .main, type: .error, error.localizedDescription)
-          completion?(false)
+    }
+  }
+  
+  /// URLs that were enqueued together, and are reported together
+  private final class Batch {
+    var remainingRunCount: Int
+    var results: [URL:Bool] = [:]
+    let completion: ([URL:Bool]) -> Void
+    
+    init(runCount: Int, completion: @escaping ([URL:Bool]) -> Void) {
+      self.remainingRunCount = runCount
+      self.completion = completion
+    }
+  }
+  
+  private struct Run {
+    var scriptURL: URL
+    var urls: [URL]
+    var ignoresPause: Bool
+    var batch: Batch
+  }
+  
+  private var queuedRuns: [Run] = []
+  private var runningCount = 0
+  
+  /// Runs the script at `scriptURL` on `urls`, in runs of up to `options.batchSize` URLs.
+  ///
+  /// - Parameter ignoringPause: for runs requested explicitly by users, which
+  ///   shouldn't wait for the executor to be resumed
+  /// - Parameter completion: called once, when all runs are done, with whether
+  ///   the script succeeded for each URL
+  func enqueue(_ urls: [URL], scriptURL: URL, ignoringPause: Bool = false, completion: @escaping ([URL:Bool]) -> Void = { _ in }) {
+    guard !urls.isEmpty else {
+      completion([:])
+      return
+    }
+    
+    let batchSize = max(options.batchSize, 1)
+    let urlGroups = stride(from: 0, to: urls.count, by: batchSize).map {
+      Array(urls[$0..<min($0 + batchSize, urls.count)])
+    }
+    
+    let batch = Batch(runCount: urlGroups.count, completion: completion)
+    queuedRuns += urlGroups.map { Run(scriptURL: scriptURL, urls: $0, ignoresPause: ignoringPause, batch: batch) }
+    
+    startQueuedRuns()
+  }
+  
+  private func startQueuedRuns() {
+    while runningCount < max(options.maxConcurrentRuns, 1) {
+      guard let index = queuedRuns.firstIndex(where: { !isPaused || $0.ignoresPause }) else { return }
+      start(queuedRuns.remove(at: index))
+    }
+  }
+  
+  private func start(_ run: Run) {
+    os_log("Running download script with %d URLs", log: .main, type: .info, run.urls.count)
+    
+    runningCount += 1
+    
+    var didTimeOut = false
+    
+    let script = Process()
+    script.launchPath = run.scriptURL.path
+    script.arguments = run.urls.map { $0.absoluteString }
+    script.terminationHandler = { process in
+      DispatchQueue.main.async {
+        let success = process.terminationStatus == 0 && !didTimeOut
+        
+        if !success {
+          os_log("Script termination status: %d", log: .main, type: .error, process.terminationStatus)
         }
-      } else {
-        script.launch()
+        
+        self.finish(run, success: success)
+      }
+    }
+    
+    if #available(macOS 10.13, *) {
+      do {
+        try script.run()
+      } catch {
+        os_log("Couldn't run script: %{public}@", log: .main, type: .error, error.localizedDescription)
+        finish(run, success: false)
+        return
       }
+    } else {
+      script.launch()
     }
+    
+    // Don't let a stuck script hold up the queue
+    DispatchQueue.main.asyncAfter(deadline: .now() + options.timeout) {
+      guard script.isRunning else { return }
+      
+      os_log("Script timed out, terminating it", log: .main, type: .error)
+      didTimeOut = true
+      script.terminate()
+    }
+  }
+  
+  private func finish(_ run: Run, success: Bool) {
+    runningCount -= 1
+    
+    for url in run.urls {
+      run.batch.results[url] = success
+    }
+    run.batch.remainingRunCount -= 1
+    if run.batch.remainingRunCount == 0 {
+      run.batch.completion(run.batch.results)
+    }
+    
+    startQueuedRuns()
+  }
+}
+
+
+extension DownloadScriptExecutor {
+  /// Runs the download script set in `defaults` on `urls`, if it's enabled.
+  /// See `enqueue(_:scriptURL:ignoringPause:completion:)`.
+  func runDownloadScript(urls: [URL], ignoringPause: Bool = false, defaults: Defaults = .shared, completion: @escaping ([URL:Bool]) -> Void = { _ in }) {
+    guard defaults.isDownloadScriptEnabled, let downloadScriptPath = defaults.downloadScriptPath else { return }
+    
+    options = defaults.downloadScriptOptions
+    enqueue(urls, scriptURL: downloadScriptPath, ignoringPause: ignoringPause, completion: completion)
   }
 }
@@ -0,0 +1,137 @@
+import Foundation
+
+
+/// Keeps the Feed Helper's seen episodes index in sync with the download history.
+///
+/// The first update of each app session is a full snapshot. After that, updates
+/// only contain what changed in the history since the last update the helper
+/// applied. Changes are recorded as they happen with `historyDidChange(_:)`, so
+/// an unchanged history costs next to nothing to send.
+final class SeenEpisodeSync {
+  /// Identifies this app session, so the helper can't mistake revisions from
+  /// an earlier session for ours
+  private let generation = UUID().uuidString
+  
+  private var lastRevisionNumber = 0
+  
+  /// Download dates of the history items with each episode key. Nil until it's
+  /// built from the whole history.
+  private var downloadDates: [String:[Date]]? = nil
+  
+  /// Keys the helper is known to have, and the revision they're at. Nil if we don't know.
+  private var synced: (revision: Int, keys: Set<String>)? = nil
+  
+  /// Keys whose presence in the history may have changed since the last update
+  private var changedKeys: Set<String> = []
+  
+  /// What the last update changed, until we know if the helper applied it
+  private var pending: (revision: Int, added: [String], removed: [String])? = nil
+  
+  /// Records a change to the history, so that it's included in the next update
+  func historyDidChange(_ change: DownloadHistoryChange) {
+    guard downloadDates != nil else { return }
+    
+    for historyItem in change.removed {
+      let date = historyItem.downloadDate ?? .distantPast
+      for key in historyItem.episode.identityKeys {
+        guard var dates = downloadDates![key], let index = dates.firstIndex(of: date) else { continue }
+        dates.remove(at: index)
+        downloadDates![key] = dates.isEmpty ? nil : dates
+        changedKeys.insert(key)
+      }
+    }
+    
+    for historyItem in change.inserted {
+      let date = historyItem.downloadDate ?? .distantPast
+      for key in historyItem.episode.identityKeys {
+        downloadDates![key, default: []].append(date)
+        changedKeys.insert(key)
+      }
+    }
+  }
+  
+  /// The whole history was replaced. The next update will be a full snapshot.
+  func historyWasReplaced() {
+    downloadDates = nil
+    synced = nil
+    pending = nil
+    changedKeys = []
+  }
+  
+  /// Makes an update that brings the helper's index in line with `history`.
+  /// Report what happened to it with `updateWasApplied()` or `updateWasNotApplied()`.
+  ///
+  /// - Parameter history: only read if the history wasn't seen yet, or was replaced
+  func makeUpdate<History: Sequence>(history: @autoclosure () -> History) -> SeenEpisodeUpdate where History.Element == HistoryItem {
+    let downloadDates = self.downloadDates ?? buildDownloadDates(history: history())
+    
+    lastRevisionNumber += 1
+    
+    guard let synced = synced else {
+      pending = (lastRevisionNumber, Array(downloadDates.keys), [])
+      changedKeys = []
+      
+      return SeenEpisodeUpdate(
+        generation: generation,
+        baseRevision: nil,
+        revision: lastRevisionNumber,
+        added: downloadDates.mapValues { $0.min()! },
+        removed: []
+      )
+    }
+    
+    var added: [String:Date] = [:]
+    var removed: [String] = []
+    for key in changedKeys {
+      switch (downloadDates[key], synced.keys.contains(key)) {
+      case (let dates?, false):
+        added[key] = dates.min()!
+      case (nil, true):
+        removed.append(key)
+      default:
+        break
+      }
+    }
+    pending = (lastRevisionNumber, Array(added.keys), removed)
+    changedKeys = []
+    
+    return SeenEpisodeUpdate(
+      generation: generation,
+      baseRevision: synced.revision,
+      revision: lastRevisionNumber,
+      added: added,
+      removed: removed
+    )
+  }
+  
+  /// The helper applied the last update
+  func updateWasApplied() {
+    guard let pending = pending else { return }
+    
+    var keys = synced?.keys ?? []
+    keys.subtract(pending.removed)
+    keys.formUnion(pending.added)
+    synced = (pending.revision, keys)
+    self.pending = nil
+  }
+  
+  /// The helper rejected the last update, or we don't know if it applied it.
+  /// The next update will be a full snapshot.
+  func updateWasNotApplied() {
+    synced = nil
+    pending = nil
+  }
+  
+  private func buildDownloadDates<History: Sequence>(history: History) -> [String:[Date]] where History.Element == HistoryItem {
+    var downloadDates: [String:[Date]] = [:]
+    for historyItem in history {
+      let date = historyItem.downloadDate ?? .distantPast
+      for key in historyItem.episode.identityKeys {
+        downloadDates[key, default: []].append(date)
+      }
+    }
+    
+    self.downloadDates = downloadDates
+    return downloadDates
+  }
+}
@@ -0,0 +1,322 @@
+import Foundation
+import os
+
+
+// Checks feeds once, the same way the Feed Helper does, but without the app,
+// XPC or sandbox bookmarks, so that it can run on a server (e.g. from cron)
+// and be profiled directly. Results are written to stdout as JSON lines.
+
+
+private let usage = """
+usage: catch-check [options] <feeds> <history> <output directory>
+
+  <feeds>               OPML file, or text file with one feed URL per line
+  <history>             episodes downloaded so far, as JSON lines. Created if it
+                        doesn't exist, new episodes are appended to it.
+  <output directory>    where to save torrent files and magnet links
+
+options:
+  --state <file>        remember what feeds looked like between runs, so that
+                        unchanged feeds aren't downloaded and parsed again
+  --organize-by-show    save episodes in a subdirectory for each show
+  --save-magnet-links   save magnet links as .webloc files
+  --skip-torrent-files  don't download torrent files
+  --serial              check one feed at a time
+  --include <regex>     only download episodes whose title matches. Can be
+                        given several times, episodes need to match one.
+  --exclude <regex>     don't download episodes whose title matches
+
+"""
+
+
+private struct Arguments {
+  var feedsURL: URL
+  var historyURL: URL
+  var downloadOptions: DownloadOptions
+  var feedCheckOptions = FeedCheckOptions()
+  var stateURL: URL? = nil
+  var filter = EpisodeFilter()
+  
+  init<Strings: Collection>(_ arguments: Strings) throws where Strings.Element == String {
+    var paths: [String] = []
+    var shouldOrganizeByShow = false
+    var shouldSaveMagnetLinks = false
+    var shouldSaveTorrentFiles = true
+    
+    var iterator = arguments.makeIterator()
+    while let argument = iterator.next() {
+      switch argument {
+      case "--state":
+        guard let path = iterator.next() else { throw UsageError(message: "Missing state file") }
+        stateURL = URL(fileURLWithPath: path)
+      case "--organize-by-show":
+        shouldOrganizeByShow = true
+      case "--save-magnet-links":
+        shouldSaveMagnetLinks = true
+      case "--skip-torrent-files":
+        shouldSaveTorrentFiles = false
+      case "--serial":
+        feedCheckOptions.maxConcurrentFeeds = 1
+      case "--include":
+        guard let pattern = iterator.next() else { throw UsageError(message: "Missing include pattern") }
+        filter.includes.append(.regex(pattern))
+      case "--exclude":
+        guard let pattern = iterator.next() else { throw UsageError(message: "Missing exclude pattern") }
+        filter.excludes.append(.regex(pattern))
+      case _ where argument.hasPrefix("-"):
+        throw UsageError(message: "Unknown option: \(argument)")
+      default:
+        paths.append(argument)
+      }
+    }
+    
+    // Fail early on invalid patterns, rather than once per feed
+    _ = try CompiledEpisodeFilter(filter)
+    
+    guard paths.count == 3 else { throw UsageError(message: "Expected 3 arguments, got \(paths.count)") }
+    
+    feedsURL = URL(fileURLWithPath: paths[0])
+    historyURL = URL(fileURLWithPath: paths[1])
+    downloadOptions = DownloadOptions(
+      containerDirectory: URL(fileURLWithPath: paths[2], isDirectory: true),
+      shouldOrganizeByShow: shouldOrganizeByShow,
+      shouldSaveMagnetLinks: shouldSaveMagnetLinks,
+      shouldSaveTorrentFiles: shouldSaveTorrentFiles
+    )
+  }
+}
+
+
+private struct UsageError: Error {
+  var message: String
+}
+
+
+/// One line of the history file
+private struct HistoryEntry: Codable {
+  var url: String
+  var title: String? = nil
+  var showName: String? = nil
+  var date: Date
+}
+
+
+/// One line of output. Fields that don't apply to an event are left out.
+private struct Event: Encodable {
+  enum Kind: String, Encodable {
+    case episode, duplicateEpisode, episodeFailure, feedFailure, feedMetrics, summary
+  }
+  
+  var kind: Kind
+  var feed: String? = nil
+  var title: String? = nil
+  var url: String? = nil
+  var showName: String? = nil
+  var localPath: String? = nil
+  var error: String? = nil
+  var metrics: FeedMetrics? = nil
+  
+  /// Summary only
+  var feedCount: Int? = nil
+  var failedFeedCount: Int? = nil
+  
+  /// Feeds that were the same as last time (see `FeedMetrics.change`)
+  var unchangedFeedCount: Int? = nil
+  var downloadedEpisodeCount: Int? = nil
+  var duration: TimeInterval? = nil
+}
+
+
+private let encoder: JSONEncoder = {
+  let encoder = JSONEncoder()
+  encoder.dateEncodingStrategy = .secondsSince1970
+  return encoder
+}()
+private let outputLock = NSLock()
+
+
+/// Writes `value` to `fileHandle` as a single JSON line. Thread-safe.
+private func writeLine<Value: Encodable>(_ value: Value, to fileHandle: FileHandle = .standardOutput) {
+  guard var line = try? encoder.encode(value) else { return }
+  line.append(UInt8(ascii: "\n"))
+  
+  outputLock.lock()
+  defer { outputLock.unlock() }
+  fileHandle.write(line)
+}
+
+
+private func fail(_ message: String, status: Int32) -> Never {
+  FileHandle.standardError.write("catch-check: \(message)\n".data(using: .utf8)!)
+  exit(status)
+}
+
+
+private func loadFeeds(from fileURL: URL) throws -> [Feed] {
+  let data = try Data(contentsOf: fileURL)
+  
+  if let opml = try? OPMLParser().parse(opml: data) {
+    return opml
+  }
+  
+  guard let contents = String(data: data, encoding: .utf8) else {
+    throw UsageError(message: "Feeds file is neither OPML nor text")
+  }
+  
+  return contents
+    .split(whereSeparator: { $0.isNewline })
+    .map { $0.trimmingCharacters(in: .whitespaces) }
+    .filter { !$0.isEmpty && !$0.hasPrefix("#") }
+    .compactMap { line in
+      guard let url = URL(string: line), url.isValidFeedURL else {
+        os_log("Invalid feed URL: %{public}@", log: .helper, type: .info, line)
+        return nil
+      }
+      return Feed(name: url.host ?? line, url: url)
+    }
+}
+
+
+/// Reads the history file into a snapshot for the seen episodes index.
+/// Lines that can't be read are skipped.
+private func loadHistory(from fileURL: URL) throws -> SeenEpisodeUpdate {
+  var added: [String:Date] = [:]
+  
+  if FileManager.default.fileExists(atPath: fileURL.path) {
+    let data = try Data(contentsOf: fileURL)
+    for line in data.split(separator: UInt8(ascii: "\n")) {
+      guard
+        let entry = try? JSONDecoder.history.decode(HistoryEntry.self, from: line),
+        let url = URL(string: entry.url)
+      else {
+        continue
+      }
+      
+      let episode = Episode(title: entry.title ?? "", url: url, showName: entry.showName, feed: nil)
+      for key in episode.identityKeys {
+        added[key] = min(added[key] ?? entry.date, entry.date)
+      }
+    }
+  }
+  
+  return SeenEpisodeUpdate(generation: "catch-check", baseRevision: nil, revision: 0, added: added, removed: [])
+}
+
+
+private extension JSONDecoder {
+  static let history: JSONDecoder = {
+    let decoder = JSONDecoder()
+    decoder.dateDecodingStrategy = .secondsSince1970
+    return decoder
+  }()
+}
+
+
+// Read arguments and inputs
+private let arguments: Arguments = {
+  do {
+    return try Arguments(CommandLine.arguments.dropFirst())
+  } catch {
+    FileHandle.standardError.write(usage.data(using: .utf8)!)
+    fail((error as? UsageError)?.message ?? error.localizedDescription, status: EX_USAGE)
+  }
+}()
+
+private let seenEpisodes = SeenEpisodeIndex(fileURL: nil)
+private let feeds: [Feed] = {
+  do {
+    _ = seenEpisodes.apply(try loadHistory(from: arguments.historyURL))
+    return try loadFeeds(from: arguments.feedsURL).map { feed in
+      var feed = feed
+      feed.filter = arguments.filter
+      return feed
+    }
+  } catch {
+    fail((error as? UsageError)?.message ?? error.localizedDescription, status: EX_NOINPUT)
+  }
+}()
+
+private let historyFileHandle: FileHandle = {
+  do {
+    if !FileManager.default.fileExists(atPath: arguments.historyURL.path) {
+      FileManager.default.createFile(atPath: arguments.historyURL.path, contents: nil)
+    }
+    let fileHandle = try FileHandle(forWritingTo: arguments.historyURL)
+    fileHandle.seekToEndOfFile()
+    return fileHandle
+  } catch {
+    fail("Could not open history file: \(error.localizedDescription)", status: EX_CANTCREAT)
+  }
+}()
+
+
+// On Ctrl-C, stop downloading but still save feed states and report what was done
+private let cancellation = CancellationToken()
+signal(SIGINT, SIG_IGN)
+private let interruptSource = DispatchSource.makeSignalSource(signal: SIGINT, queue: .global())
+interruptSource.setEventHandler { cancellation.cancel() }
+interruptSource.resume()
+
+
+// Check feeds, reporting each one as soon as it's done
+let (report, duration) = FeedMetrics.measure {
+  FeedHelper.checkFeeds(
+    feeds: feeds,
+    options: arguments.feedCheckOptions,
+    downloadOptions: arguments.downloadOptions,
+    seenEpisodes: seenEpisodes,
+    feedStates: FeedStateStore(fileURL: arguments.stateURL),
+    cancellation: cancellation,
+    didFinishFeed: { feed, feedReport in
+      for downloadedEpisode in feedReport.downloadedEpisodes {
+        let episode = downloadedEpisode.episode
+        writeLine(HistoryEntry(url: episode.url.absoluteString, title: episode.title, showName: episode.showName, date: Date()), to: historyFileHandle)
+        writeLine(Event(
+          kind: .episode,
+          feed: feed.url.absoluteString,
+          title: episode.title,
+          url: episode.url.absoluteString,
+          showName: episode.showName,
+          localPath: downloadedEpisode.localURL?.path
+        ))
+      }
+      for episode in feedReport.duplicateEpisodes {
+        writeLine(HistoryEntry(url: episode.url.absoluteString, title: episode.title, showName: episode.showName, date: Date()), to: historyFileHandle)
+        writeLine(Event(
+          kind: .duplicateEpisode,
+          feed: feed.url.absoluteString,
+          title: episode.title,
+          url: episode.url.absoluteString,
+          showName: episode.showName
+        ))
+      }
+      for episodeFailure in feedReport.episodeFailures {
+        writeLine(Event(
+          kind: .episodeFailure,
+          feed: feed.url.absoluteString,
+          title: episodeFailure.episode.title,
+          url: episodeFailure.episode.url.absoluteString,
+          error: episodeFailure.error.localizedDescription
+        ))
+      }
+      for failure in feedReport.failures {
+        writeLine(Event(kind: .feedFailure, feed: feed.url.absoluteString, error: failure.error.localizedDescription))
+      }
+      for metrics in feedReport.metrics {
+        writeLine(Event(kind: .feedMetrics, feed: feed.url.absoluteString, metrics: metrics))
+      }
+    }
+  )
+}
+historyFileHandle.closeFile()
+
+writeLine(Event(
+  kind: .summary,
+  feedCount: feeds.count,
+  failedFeedCount: report.failures.count,
+  unchangedFeedCount: report.metrics.filter { $0.change != nil && $0.change != .changed }.count,
+  downloadedEpisodeCount: report.downloadedEpisodes.count,
+  duration: duration
+))
+
+exit(report.failures.isEmpty ? EXIT_SUCCESS : EXIT_FAILURE)
@@ -0,0 +1,68 @@
+import Foundation
+
+
+/// Lets work running on other threads be stopped early. Thread-safe.
+///
+/// Cancellation is cooperative: work checks `isCancelled` between steps, and
+/// while it's blocked waiting for something (a download, a retry delay) it
+/// registers a handler that interrupts the wait.
+final class CancellationToken {
+  private let lock = NSLock()
+  private var cancelled = false
+  private var handlers: [Int:() -> Void] = [:]
+  private var nextHandlerID = 0
+  
+  var isCancelled: Bool {
+    lock.lock()
+    defer { lock.unlock() }
+    return cancelled
+  }
+  
+  /// Calls the registered handlers. Only the first call does anything.
+  func cancel() {
+    lock.lock()
+    guard !cancelled else {
+      lock.unlock()
+      return
+    }
+    cancelled = true
+    let handlers = self.handlers
+    self.handlers = [:]
+    lock.unlock()
+    
+    for handler in handlers.values {
+      handler()
+    }
+  }
+  
+  /// Performs `work`, calling `handler` if the token is cancelled in the meantime
+  /// (right away if it already is). `handler` is called from the thread that
+  /// cancels the token, and must not block.
+  func performCancellable<T>(_ work: () throws -> T, onCancel handler: @escaping () -> Void) rethrows -> T {
+    lock.lock()
+    guard !cancelled else {
+      lock.unlock()
+      handler()
+      return try work()
+    }
+    let handlerID = nextHandlerID
+    nextHandlerID += 1
+    handlers[handlerID] = handler
+    lock.unlock()
+    
+    defer {
+      lock.lock()
+      handlers[handlerID] = nil
+      lock.unlock()
+    }
+    
+    return try work()
+  }
+  
+  /// Blocks the current thread for `interval`, or until the token is cancelled
+  func sleep(forTimeInterval interval: TimeInterval) {
+    let wakeUp = DispatchSemaphore(value: 0)
+    performCancellable({ _ = wakeUp.wait(timeout: .now() + interval) }, onCancel: { wakeUp.signal() })
+  }
+}
+
@@ -0,0 +1,75 @@
+import Foundation
+
+
+/// An `EpisodeFilter`, ready to be applied to many feed items: regular
+/// expressions are compiled once, up front.
+struct CompiledEpisodeFilter {
+  private enum Matcher {
+    case substring(String, in: EpisodeFilterRule.Field)
+    case regex(NSRegularExpression, in: EpisodeFilterRule.Field)
+    case sizeRange(min: Int64, max: Int64)
+    
+    init(rule: EpisodeFilterRule) throws {
+      switch rule.kind {
+      case .substring:
+        self = .substring(rule.pattern, in: rule.field)
+      case .regex:
+        self = .regex(try NSRegularExpression(pattern: rule.pattern, options: [.caseInsensitive]), in: rule.field)
+      case .sizeRange:
+        self = .sizeRange(min: rule.minSize ?? 0, max: rule.maxSize ?? .max)
+      }
+    }
+    
+    func matches(_ item: FeedItem) -> Bool {
+      switch self {
+      case .substring(let substring, let field):
+        guard let text = item[field] else { return false }
+        return text.range(of: substring, options: [.caseInsensitive]) != nil
+      case .regex(let regex, let field):
+        guard let text = item[field] else { return false }
+        return regex.firstMatch(in: text, range: NSRange(text.startIndex..., in: text)) != nil
+      case .sizeRange(let min, let max):
+        guard let size = item.size else { return false }
+        return min <= size && size <= max
+      }
+    }
+  }
+  
+  private let includes: [Matcher]
+  private let excludes: [Matcher]
+  
+  /// - Throws: if one of the filter's regular expressions is invalid
+  init(_ filter: EpisodeFilter) throws {
+    do {
+      includes = try filter.includes.map(Matcher.init(rule:))
+      excludes = try filter.excludes.map(Matcher.init(rule:))
+    } catch {
+      throw NSError(
+        domain: feedHelperErrorDomain,
+        code: -10,
+        userInfo: [
+          NSLocalizedDescriptionKey: "Invalid episode filter",
+          NSUnderlyingErrorKey: error
+        ]
+      )
+    }
+  }
+  
+  func accepts(_ item: FeedItem) -> Bool {
+    if !includes.isEmpty && !includes.contains(where: { $0.matches(item) }) {
+      return false
+    }
+    return !excludes.contains(where: { $0.matches(item) })
+  }
+}
+
+
+private extension FeedItem {
+  subscript(field: EpisodeFilterRule.Field) -> String? {
+    switch field {
+    case .title: return title
+    case .showName: return showName
+    case .url: return urlString
+    }
+  }
+}
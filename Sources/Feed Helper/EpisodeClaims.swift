@@ -0,0 +1,108 @@
+import Foundation
+
+
+/// Keeps track of the episodes being downloaded during a feed check, so that
+/// an episode found in several feeds (or several times in one, e.g. in
+/// different qualities) is only downloaded once. Thread-safe.
+///
+/// Claims are provisional until the download they were made for is done: if it
+/// fails, the claim is released, and another copy of the episode can claim it.
+final class EpisodeClaims {
+  enum Outcome {
+    /// Nobody downloaded the episode yet, go ahead
+    case claimed
+    
+    /// In the seen episodes index
+    case seen
+    
+    /// Already claimed during this check
+    case duplicate
+  }
+  
+  enum ClaimState {
+    /// The claiming download is still in progress
+    case pending
+    
+    /// The episode was dealt with
+    case fulfilled
+    
+    /// The claiming download failed, or there was no claim
+    case released
+  }
+  
+  /// Whether an episode key was downloaded before this check
+  private let isSeen: (String) -> Bool
+  private let condition = NSCondition()
+  
+  /// Claimed keys, and whether their claim is still pending
+  private var keys: [String:Bool] = [:]
+  
+  init(isSeen: @escaping (String) -> Bool) {
+    self.isSeen = isSeen
+  }
+  
+  /// Claims all of `keys` (see `Episode.identityKeys`), unless any of them was
+  /// already downloaded or claimed. The claim must then be fulfilled or released.
+  func claim(_ keys: [String]) -> Outcome {
+    condition.lock()
+    defer { condition.unlock() }
+    
+    if keys.contains(where: isSeen) {
+      return .seen
+    }
+    
+    if keys.contains(where: { self.keys[$0] != nil }) {
+      return .duplicate
+    }
+    
+    for key in keys {
+      self.keys[key] = true
+    }
+    return .claimed
+  }
+  
+  /// The episode claimed with `keys` was dealt with
+  func fulfill(_ keys: [String]) {
+    condition.lock()
+    defer { condition.unlock() }
+    
+    for key in keys where self.keys[key] != nil {
+      self.keys[key] = false
+    }
+    condition.broadcast()
+  }
+  
+  /// The download of the episode claimed with `keys` failed, other copies of
+  /// it can claim it instead
+  func release(_ keys: [String]) {
+    condition.lock()
+    defer { condition.unlock() }
+    
+    for key in keys {
+      self.keys[key] = nil
+    }
+    condition.broadcast()
+  }
+  
+  /// What became of the claim that made claiming `keys` fail with `.duplicate`
+  ///
+  /// - Parameter waiting: whether to wait for a pending claim to be fulfilled or released.
+  ///   Callers must not be holding pending claims that they haven't started downloading.
+  func state(ofClaimOn keys: [String], waiting: Bool) -> ClaimState {
+    condition.lock()
+    defer { condition.unlock() }
+    
+    while true {
+      if keys.contains(where: { self.keys[$0] == false }) {
+        return .fulfilled
+      }
+      if !keys.contains(where: { self.keys[$0] == true }) {
+        return .released
+      }
+      if !waiting {
+        return .pending
+      }
+      condition.wait()
+    }
+  }
+}
@@ -2,6 +2,29 @@ import Foundation
 import os
 
 
+private extension TimeInterval {
+  /// How long to wait before retrying a failed torrent file download.
+  /// Doubles after every attempt.
+  static let torrentDownloadRetryDelay: TimeInterval = 2
+  
+  /// Longest `Retry-After` we're willing to honor
+  static let maxTorrentDownloadRetryDelay: TimeInterval = 60
+  
+  /// Longest wait for more data from a tracker
+  static let torrentRequestTimeout: TimeInterval = 30
+}
+
+
+private extension Int {
+  /// Largest torrent file we're willing to download
+  static let maxTorrentFileSize = 10 * 1024 * 1024
+}
+
+
+/// A torrent file turned out to be the same as one that was already downloaded
+struct DuplicateEpisodeError: Error {}
+
+
 /// Downloads episodes to the file system.
 ///
 /// - Note: does not download the *contents* of torrent files, that is delegated
@@ -9,7 +32,55 @@ import os
 struct EpisodeDownloader {
   let downloadOptions: DownloadOptions
   
+  /// How many times to try downloading a torrent file, if it fails in a way
+  /// that might go away by itself (timeouts, server errors...)
+  var maxDownloadAttempts: Int = 3
+  
+  /// If set, torrent files whose info hash was already claimed (under another
+  /// URL) are not saved, and fail with `DuplicateEpisodeError`
+  var claims: EpisodeClaims? = nil
+  
+  /// Once cancelled, downloads in progress are cancelled, and episodes that
+  /// aren't done yet fail with `feedHelperCancelledErrorCode`
+  var cancellation = CancellationToken()
+  
+  /// Downloads a batch of episodes concurrently on `queue`, which limits how many
+  /// downloads run at a time (overall and per host) across all of its batches.
+  /// Episodes that fail don't prevent the others from being downloaded.
+  ///
+  /// - Parameter didFinish: called as soon as each episode is done (with how long
+  ///   it took, including retries), from any thread
+  /// - Returns: the results, in the same order as `episodes`
+  func download(
+    episodes: [Episode],
+    queue: HostFairWorkQueue,
+    didFinish: @escaping (Episode, Result<DownloadedEpisode, Error>, TimeInterval) -> Void = { _, _, _ in }) -> [Result<DownloadedEpisode, Error>] {
+    var results = [Result<DownloadedEpisode, Error>?](repeating: nil, count: episodes.count)
+    let resultsLock = NSLock()
+    
+    queue.process(
+      Array(episodes.enumerated()),
+      // Magnet links don't hit the network, don't limit them
+      host: { $0.element.url.host ?? $0.element.url.absoluteString },
+      work: { item in
+        let (result, duration) = FeedMetrics.measure {
+          Result { try self.download(episode: item.element) }
+        }
+        
+        resultsLock.lock()
+        results[item.offset] = result
+        resultsLock.unlock()
+        
+        didFinish(item.element, result, duration)
+      }
+    )
+    
+    return results.map { $0! }
+  }
+  
   func download(episode: Episode) throws -> DownloadedEpisode {
+    try cancellation.checkCancelled()
+    
     if episode.url.isMagnetLink {
       if downloadOptions.shouldSaveMagnetLinks {
         // Save the magnet link to a file
@@ -28,6 +99,9 @@ struct EpisodeDownloader {
       let downloadedTorrentFile: URL
       do {
         downloadedTorrentFile = try downloadTorrentFile(for: episode)
+      } catch let error as DuplicateEpisodeError {
+        os_log("Skipping %{public}@, same torrent as an episode that was already downloaded", log: .helper, type: .info, "\(episode.url)")
+        throw error
       } catch {
         os_log("Could not download %{public}@: %{public}@", log: .helper, type: .error, "\(episode.url)", error.localizedDescription)
         throw error
@@ -75,79 +149,214 @@ struct EpisodeDownloader {
   private func downloadTorrentFile(for episode: Episode) throws -> URL {
     os_log("Downloading torrent file %{public}@", log: .helper, type: .info, "\(episode.url)")
     
-    // Download!
-    let urlResponse: URLResponse
-    let fileData: Data
+    // Try to get a nice filename from the episode's title
+    let fileName = episode.title.torrentFileName
+    
+    // Build destination path
+    let fullPath = URL(
+      containerDirectory: downloadOptions.containerDirectory,
+      subDirectory: downloadOptions.shouldOrganizeByShow ? episode.showName : nil,
+      fileName: fileName
+    )
+    let containerDirectory = fullPath.deletingLastPathComponent()
+    
+    try FileManager.default.createDirectoryIfNeeded(at: containerDirectory)
+    
+    // Download straight to disk, next to the destination, so that the file can
+    // be moved in place atomically. Torrent clients watching the directory
+    // ignore hidden files.
+    let temporaryURL = containerDirectory.appendingPathComponent(".\(UUID().uuidString).download")
+    defer { try? FileManager.default.removeItem(at: temporaryURL) }
+    
     do {
-      (urlResponse, fileData) = try URLSession.shared.downloadSynchronously(
-        url: episode.url
-      )
+      try downloadTorrentFile(from: episode.url, to: temporaryURL)
     } catch {
-      throw NSError(
-        domain: feedHelperErrorDomain,
-        code: -1,
-        userInfo: [
-          NSLocalizedDescriptionKey: "Could not download torrent file",
-          NSUnderlyingErrorKey: error
-        ]
-      )
+      // Maybe the directory was deleted since we last saw it
+      KnownDirectories.shared.remove(containerDirectory)
+      throw error
     }
     
-    let httpResponse = urlResponse as! HTTPURLResponse
+    let fileSize = (try? temporaryURL.resourceValues(forKeys: [.fileSizeKey]))?.fileSize ?? 0
+    os_log("Download complete, filesize: %d", log: .helper, type: .info, fileSize)
     
-    guard httpResponse.statusCode == 200 else {
+    // Only now can we tell if the same torrent was found under another URL
+    var claimedInfoHashKey: String? = nil
+    if let claims = claims, let infoHash = TorrentFile.infoHash(ofFileAt: temporaryURL) {
+      let infoHashKey = URL.episodeKey(infoHash: infoHash)
+      if !episode.identityKeys.contains(infoHashKey) {
+        guard claims.claim([infoHashKey]) == .claimed else {
+          throw DuplicateEpisodeError()
+        }
+        claimedInfoHashKey = infoHashKey
+      }
+    }
+    
+    // Replaces any previous version of the file
+    guard rename(temporaryURL.path, fullPath.path) == 0 else {
+      // Before anything else gets to change errno
+      let renameError = errno
+      try? FileManager.default.removeItem(at: temporaryURL)
+      
+      if let claimedInfoHashKey = claimedInfoHashKey {
+        claims?.release([claimedInfoHashKey])
+      }
       throw NSError(
         domain: feedHelperErrorDomain,
-        code: -7,
+        code: -4,
         userInfo: [
-          NSLocalizedDescriptionKey: "Could not download torrent file (bad status code \(httpResponse.statusCode))"
+          NSLocalizedDescriptionKey: "Couldn't write data to: \(fullPath)",
+          NSUnderlyingErrorKey: NSError(domain: NSPOSIXErrorDomain, code: Int(renameError))
         ]
       )
     }
     
-    os_log("Download complete, filesize: %d", log: .helper, type: .info, fileData.count)
+    if let claimedInfoHashKey = claimedInfoHashKey {
+      claims?.fulfill([claimedInfoHashKey])
+    }
     
-    // Try to get a nice filename from the episode's title
-    let fileName = episode.title.torrentFileName
+    return fullPath
+  }
+  
+  private struct DownloadAttemptError: Error {
+    var error: NSError
     
-    // Build destination path
-    let fullPath = URL(
-      containerDirectory: downloadOptions.containerDirectory,
-      subDirectory: downloadOptions.shouldOrganizeByShow ? episode.showName : nil,
-      fileName: fileName
-    )
+    /// Whether trying again later might work
+    var isTransient: Bool
     
-    try fileData.writeWithIntermediateDirectories(to: fullPath)
+    /// How long the server asked us to wait before trying again, if it did
+    var retryAfter: TimeInterval? = nil
+  }
+  
+  /// Downloads a torrent file, retrying with exponential backoff after errors
+  /// that might go away by themselves.
+  private func downloadTorrentFile(from url: URL, to fileURL: URL) throws {
+    var attempt = 1
+    while true {
+      do {
+        return try downloadTorrentFileOnce(from: url, to: fileURL)
+      } catch let attemptError as DownloadAttemptError {
+        guard attemptError.isTransient, attempt < maxDownloadAttempts else {
+          throw attemptError.error
+        }
+        
+        let backoffDelay = TimeInterval.torrentDownloadRetryDelay * pow(2, Double(attempt - 1))
+        let delay = min(attemptError.retryAfter ?? backoffDelay, .maxTorrentDownloadRetryDelay)
+        os_log("Download attempt %d failed (%{public}@), retrying in %.0fs", log: .helper, type: .info, attempt, attemptError.error.localizedDescription, delay)
+        cancellation.sleep(forTimeInterval: delay)
+        try cancellation.checkCancelled()
+        attempt += 1
+      }
+    }
+  }
+  
+  private func downloadTorrentFileOnce(from url: URL, to fileURL: URL) throws {
+    let urlResponse: URLResponse
+    do {
+      urlResponse = try URLSession.helper.downloadFileSynchronously(
+        request: URLRequest(url: url, cachePolicy: .reloadIgnoringLocalCacheData, timeoutInterval: .torrentRequestTimeout),
+        to: fileURL,
+        maxResponseSize: .maxTorrentFileSize,
+        cancellation: cancellation
+      )
+    } catch {
+      try cancellation.checkCancelled()
+      throw DownloadAttemptError(
+        error: NSError(
+          domain: feedHelperErrorDomain,
+          code: -1,
+          userInfo: [
+            NSLocalizedDescriptionKey: "Could not download torrent file",
+            NSUnderlyingErrorKey: error
+          ]
+        ),
+        isTransient: (error as? URLError)?.isTransient ?? false
+      )
+    }
     
-    return fullPath
+    let httpResponse = urlResponse as! HTTPURLResponse
+    
+    guard httpResponse.statusCode == 200 else {
+      throw DownloadAttemptError(
+        error: NSError(
+          domain: feedHelperErrorDomain,
+          code: -7,
+          userInfo: [
+            NSLocalizedDescriptionKey: "Could not download torrent file (bad status code \(httpResponse.statusCode))"
+          ]
+        ),
+        isTransient: httpResponse.statusCode == 429 || httpResponse.statusCode >= 500,
+        retryAfter: httpResponse.retryAfter
+      )
+    }
   }
 }
 
 
-private extension Data {
-  /// Write the contents of the Data to a location, creating intermediate directories if
-  /// necessary.
-  func writeWithIntermediateDirectories(to url: URL) throws {
-    let containerDirectory = url.deletingLastPathComponent()
+private extension URLError {
+  /// Whether this is the kind of network error that might go away by itself
+  var isTransient: Bool {
+    switch code {
+    case .timedOut, .networkConnectionLost, .notConnectedToInternet, .cannotConnectToHost, .dnsLookupFailed, .cannotFindHost:
+      return true
+    default:
+      return false
+    }
+  }
+}
+
+
+/// Directories the helper knows exist, so that they aren't checked again
+/// for every episode. Thread-safe.
+private final class KnownDirectories {
+  static let shared = KnownDirectories()
+  
+  private let lock = NSLock()
+  private var paths: Set<String> = []
+  
+  func contains(_ url: URL) -> Bool {
+    lock.lock()
+    defer { lock.unlock() }
+    return paths.contains(url.path)
+  }
+  
+  func insert(_ url: URL) {
+    lock.lock()
+    defer { lock.unlock() }
+    paths.insert(url.path)
+  }
+  
+  func remove(_ url: URL) {
+    lock.lock()
+    defer { lock.unlock() }
+    paths.remove(url.path)
+  }
+}
+
+
+private extension FileManager {
+  /// Creates a directory (and any missing parents) unless it's already there.
+  /// Directories that were seen or created before aren't checked again.
+  func createDirectoryIfNeeded(at directory: URL) throws {
+    guard !KnownDirectories.shared.contains(directory) else { return }
     
     // Check if the destination dir exists, if it doesn't create it
     var isDirectory: ObjCBool = false
-    if FileManager.default.fileExists(atPath: containerDirectory.path, isDirectory: &isDirectory) {
+    if fileExists(atPath: directory.path, isDirectory: &isDirectory) {
       if !isDirectory.boolValue {
         // Exists but isn't a directory! Aaargh! Abort!
         throw NSError(
           domain: feedHelperErrorDomain,
           code: -2,
           userInfo: [
-            NSLocalizedDescriptionKey: "Download path is not a directory: \(containerDirectory)"
+            NSLocalizedDescriptionKey: "Download path is not a directory: \(directory)"
           ]
         )
       }
     } else {
       // Directory doesn't exist, create it
       do {
-        try FileManager.default.createDirectory(
-          atPath: containerDirectory.path,
+        try createDirectory(
+          atPath: directory.path,
           withIntermediateDirectories: true
         )
       } catch {
@@ -156,19 +365,33 @@ private extension Data {
           domain: feedHelperErrorDomain,
           code: -3,
           userInfo: [
-            NSLocalizedDescriptionKey: "Couldn't create directory: \(containerDirectory)",
+            NSLocalizedDescriptionKey: "Couldn't create directory: \(directory)",
             NSUnderlyingErrorKey: error
           ]
         )
       }
       
-      os_log("Directory %{public}@ created", log: .helper, type: .info, "\(containerDirectory)")
+      os_log("Directory %{public}@ created", log: .helper, type: .info, "\(directory)")
     }
     
+    KnownDirectories.shared.insert(directory)
+  }
+}
+
+
+private extension Data {
+  /// Write the contents of the Data to a location, creating intermediate directories if
+  /// necessary.
+  func writeWithIntermediateDirectories(to url: URL) throws {
+    let containerDirectory = url.deletingLastPathComponent()
+    
+    try FileManager.default.createDirectoryIfNeeded(at: containerDirectory)
+    
     // Write!
     do {
       try write(to: url, options: .atomic)
     } catch {
+      KnownDirectories.shared.remove(containerDirectory)
       throw NSError(
         domain: feedHelperErrorDomain,
         code: -4,
@@ -182,35 +405,6 @@ private extension Data {
 }
 
 
-private extension URLSession {
-  func downloadSynchronously(url: URL) throws -> (URLResponse, Data) {
-    let urlRequest = URLRequest(url: url)
-    
-    var downloadError: Error? = nil
-    var downloadedData: Data!
-    var urlResponse: URLResponse!
-    
-    let taskSemaphore = DispatchSemaphore(value: 0)
-    URLSession.shared.dataTask(with: urlRequest) { (data, response, error) in
-      if let error = error {
-        downloadError = error
-      } else {
-        downloadedData = data!
-        urlResponse = response!
-      }
-      taskSemaphore.signal()
-    }.resume()
-    taskSemaphore.wait()
-    
-    if let downloadError = downloadError {
-      throw downloadError
-    } else {
-      return (urlResponse, downloadedData)
-    }
-  }
-}
-
-
 private extension URL {
   init(containerDirectory: URL, subDirectory: String?, fileName: String) {
     var fullPath = containerDirectory
@@ -0,0 +1,42 @@
+import Foundation
+
+
+/// A 64-bit FNV-1a hash, used to tell whether a feed changed since it was last
+/// checked when its server doesn't support conditional requests. Fast, and
+/// good enough for that: a collision just means one check is skipped.
+struct FeedFingerprint: Equatable {
+  private(set) var value: UInt64 = 0xcbf29ce484222325
+  
+  /// - Parameter seed: whatever else should change the fingerprint, e.g. the
+  ///   settings the feed is checked with
+  init(seed: String? = nil) {
+    if let seed = seed {
+      combine(seed)
+    }
+  }
+  
+  mutating func combine(_ data: Data) {
+    var value = self.value
+    data.withUnsafeBytes { (bytes: UnsafeRawBufferPointer) in
+      for byte in bytes {
+        value = (value ^ UInt64(byte)) &* 0x100000001b3
+      }
+    }
+    self.value = value
+  }
+  
+  /// Combines `string` and a separator, so that ("ab", "c") and ("a", "bc")
+  /// make different fingerprints
+  mutating func combine(_ string: String) {
+    var value = self.value
+    for byte in string.utf8 {
+      value = (value ^ UInt64(byte)) &* 0x100000001b3
+    }
+    self.value = (value ^ 0xff) &* 0x100000001b3
+  }
+  
+  /// For storing in property lists, which can't hold all `UInt64` values
+  var stringValue: String {
+    return String(value, radix: 16)
+  }
+}
@@ -2,24 +2,173 @@ import Foundation
 import os
 
 
+/// `userInfo` key for the server's `Retry-After`, in feed download errors
+private let retryAfterErrorKey = "retryAfter"
+
+
+private extension TimeInterval {
+  /// Longest wait for more data from a feed's server
+  static let feedRequestTimeout: TimeInterval = 20
+}
+
+
+private extension Int {
+  /// Largest feed we're willing to download. Real feeds are way smaller.
+  static let maxFeedSize = 16 * 1024 * 1024
+}
+
+
 /// Implements the two functions of the Feed Helper service:
 /// - Checking feeds (optionally downloading any new torrent files)
 /// - Downloading a single torrent file
 enum FeedHelper {
-  static func checkFeeds(feeds: [Feed], downloadOptions: DownloadOptions, skippingURLs previouslyDownloadedURLs: [URL]) throws -> [DownloadedEpisode] {
-    return try feeds.flatMap {
-      try checkFeed(feed: $0, downloadOptions: downloadOptions, skippingURLs: previouslyDownloadedURLs)
-    }
+  /// Checks all feeds, concurrently if allowed by `options`.
+  /// Feeds that fail don't prevent the others from being checked, and are
+  /// listed in the report along with their error.
+  ///
+  /// - Parameter didDownloadEpisode: called as soon as each new episode is downloaded, from any thread
+  /// - Parameter didFinishFeed: called as soon as each feed is done, from any thread
+  static func checkFeeds(
+    feeds: [Feed],
+    options: FeedCheckOptions,
+    downloadOptions: DownloadOptions,
+    seenEpisodes: SeenEpisodeIndex,
+    feedStates: FeedStateStore = .shared,
+    cancellation: CancellationToken = CancellationToken(),
+    didDownloadEpisode: @escaping (DownloadedEpisode) -> Void = { _ in },
+    didFinishFeed: @escaping (Feed, FeedCheckReport) -> Void = { _, _ in }) -> FeedCheckReport {
+    var report: FeedCheckReport!
+    let done = DispatchSemaphore(value: 0)
+    checkFeeds(
+      feeds: feeds,
+      options: options,
+      downloadOptions: downloadOptions,
+      seenEpisodes: seenEpisodes,
+      feedStates: feedStates,
+      cancellation: cancellation,
+      didDownloadEpisode: didDownloadEpisode,
+      didFinishFeed: didFinishFeed,
+      completion: {
+        report = $0
+        done.signal()
+      }
+    )
+    done.wait()
+    return report
+  }
+  
+  /// Same as the synchronous `checkFeeds`, but doesn't block the calling thread
+  /// while feeds are checked.
+  ///
+  /// Once `cancellation` is cancelled, downloads in progress are cancelled, and
+  /// feeds and episodes that aren't done yet fail with `feedHelperCancelledErrorCode`.
+  /// What was done until then is reported as usual.
+  ///
+  /// - Parameter completion: called once all feeds are done, from any thread
+  static func checkFeeds(
+    feeds: [Feed],
+    options: FeedCheckOptions,
+    downloadOptions: DownloadOptions,
+    seenEpisodes: SeenEpisodeIndex,
+    feedStates: FeedStateStore = .shared,
+    cancellation: CancellationToken,
+    didDownloadEpisode: @escaping (DownloadedEpisode) -> Void = { _ in },
+    didFinishFeed: @escaping (Feed, FeedCheckReport) -> Void = { _, _ in },
+    completion: @escaping (FeedCheckReport) -> Void) {
+    var results = [Result<FeedResult, Error>?](repeating: nil, count: feeds.count)
+    
+    // Shared by all feeds, so that each episode is only downloaded from one of them
+    let claims = EpisodeClaims(isSeen: seenEpisodes.contains(key:))
+    var metrics = [FeedMetrics?](repeating: nil, count: feeds.count)
+    let resultsLock = NSLock()
+    
+    let feedQueue = HostFairWorkQueue(
+      maxConcurrentItems: options.maxConcurrentFeeds,
+      maxConcurrentItemsPerHost: options.maxConcurrentFeedsPerHost
+    )
+    
+    // Shared by all feeds, so that the number of concurrent downloads (and of
+    // threads waiting on them) is bounded for the whole check
+    let downloadQueue = HostFairWorkQueue(
+      maxConcurrentItems: options.maxConcurrentDownloads,
+      maxConcurrentItemsPerHost: options.maxConcurrentDownloadsPerHost
+    )
+    
+    feedQueue.process(Array(feeds.enumerated()), host: { $0.element.url.host ?? "" }, work: { item in
+      // Collected even if the check fails
+      var feedMetrics = FeedMetrics(feed: item.element)
+      let (result, duration) = FeedMetrics.measure {
+        Result {
+          try checkFeed(feed: item.element, options: options, downloadOptions: downloadOptions, claims: claims, downloadQueue: downloadQueue, feedStates: feedStates, cancellation: cancellation, metrics: &feedMetrics, didDownloadEpisode: didDownloadEpisode)
+        }
+      }
+      feedMetrics.totalDuration = duration
+      
+      resultsLock.lock()
+      results[item.offset] = result
+      metrics[item.offset] = feedMetrics
+      resultsLock.unlock()
+      
+      var feedReport = FeedCheckReport(feed: item.element, result: result, state: feedStates[item.element])
+      feedReport.metrics = [feedMetrics]
+      didFinishFeed(item.element, feedReport)
+    }, completion: {
+      feedStates.save()
+      
+      // Report results in the same order as the feeds
+      var report = FeedCheckReport()
+      for (feed, result) in zip(feeds, results) {
+        let feedReport = FeedCheckReport(feed: feed, result: result!, state: feedStates[feed])
+        report.downloadedEpisodes += feedReport.downloadedEpisodes
+        report.failures += feedReport.failures
+        report.episodeFailures += feedReport.episodeFailures
+        report.duplicateEpisodes += feedReport.duplicateEpisodes
+        report.schedulingHints += feedReport.schedulingHints
+        
+        for failure in feedReport.failures {
+          os_log("Could not check feed %{public}@: %{public}@", log: .helper, type: .error, "\(feed.url)", failure.error.localizedDescription)
+        }
+      }
+      
+      report.metrics = metrics.map { $0! }
+      
+      completion(report)
+    })
   }
   
+  /// Downloads the full contents of a feed, bypassing any caches.
   static func downloadFeed(feed: Feed) throws -> Data {
-    // Flush the cache, we want fresh results
-    URLCache.shared.removeAllCachedResponses()
+    var metrics = FeedMetrics(feed: feed)
+    let (_, feedContents) = try downloadFeed(feed: feed, state: nil, cancellation: CancellationToken(), metrics: &metrics)
+    return feedContents!
+  }
+  
+  /// Downloads a feed. If `state` has validators from a previous download, they are
+  /// sent along, and a nil body is returned if the feed was not modified since.
+  private static func downloadFeed(feed: Feed, state: FeedState?, cancellation: CancellationToken, metrics: inout FeedMetrics) throws -> (HTTPURLResponse, Data?) {
+    // We want fresh results, validation is handled explicitly below
+    var request = URLRequest(url: feed.url, cachePolicy: .reloadIgnoringLocalCacheData, timeoutInterval: .feedRequestTimeout)
+    if let entityTag = state?.entityTag {
+      request.setValue(entityTag, forHTTPHeaderField: "If-None-Match")
+    }
+    if let lastModified = state?.lastModified {
+      request.setValue(lastModified, forHTTPHeaderField: "If-Modified-Since")
+    }
     
+    let urlResponse: URLResponse
     let feedContents: Data
     do {
-      feedContents = try Data(contentsOf: feed.url)
+      let ((response, data, taskMetrics), duration) = try FeedMetrics.measure {
+        try URLSession.helper.downloadSynchronouslyCollectingMetrics(request: request, maxResponseSize: .maxFeedSize, cancellation: cancellation)
+      }
+      (urlResponse, feedContents) = (response, data)
+      metrics.downloadDuration = duration
+      metrics.bytesDownloaded = data.count
+      if let taskMetrics = taskMetrics {
+        metrics.record(taskMetrics)
+      }
     } catch {
+      try cancellation.checkCancelled()
       throw NSError(
         domain: feedHelperErrorDomain,
         code: -5,
@@ -30,19 +179,102 @@ enum FeedHelper {
       )
     }
     
-    return feedContents
+    let httpResponse = urlResponse as! HTTPURLResponse
+    metrics.statusCode = httpResponse.statusCode
+    
+    switch httpResponse.statusCode {
+    case 304 where state != nil:
+      return (httpResponse, nil)
+    case 200..<300:
+      return (httpResponse, feedContents)
+    default:
+      var userInfo: [String:Any] = [
+        NSLocalizedDescriptionKey: "Could not download feed (bad status code \(httpResponse.statusCode))"
+      ]
+      userInfo[retryAfterErrorKey] = httpResponse.retryAfter
+      throw NSError(domain: feedHelperErrorDomain, code: -5, userInfo: userInfo)
+    }
   }
   
-  private static func checkFeed(feed: Feed, downloadOptions: DownloadOptions, skippingURLs previouslyDownloadedURLs: [URL]) throws -> [DownloadedEpisode] {
+  fileprivate struct FeedResult {
+    var downloadedEpisodes: [DownloadedEpisode] = []
+    var episodeFailures: [FeedCheckReport.EpisodeFailure] = []
+    var duplicateEpisodes: [Episode] = []
+    var schedulingHint: FeedCheckReport.SchedulingHint? = nil
+  }
+  
+  private static func checkFeed(
+    feed: Feed,
+    options: FeedCheckOptions,
+    downloadOptions: DownloadOptions,
+    claims: EpisodeClaims,
+    downloadQueue: HostFairWorkQueue,
+    feedStates: FeedStateStore,
+    cancellation: CancellationToken,
+    metrics: inout FeedMetrics,
+    didDownloadEpisode: @escaping (DownloadedEpisode) -> Void) throws -> FeedResult {
+    try cancellation.checkCancelled()
+    
     os_log("Checking feed: %{public}@", log: .helper, type: .info, "\(feed.url)")
     
-    // Download the feed
-    let feedContents = try downloadFeed(feed: feed)
+    // Compile the feed's filter before downloading anything, in case it's invalid
+    let filter = feed.filter.isEmpty ? nil : try CompiledEpisodeFilter(feed.filter)
+    
+    let previousState = feedStates[feed]
+    
+    // Download the feed, unless it hasn't changed since last time
+    let (feedResponse, downloadedFeedContents) = try downloadFeed(feed: feed, state: previousState, cancellation: cancellation, metrics: &metrics)
+    
+    guard let feedContents = downloadedFeedContents else {
+      os_log("Feed not modified", log: .helper, type: .info)
+      metrics.change = .notModified
+      return FeedResult(schedulingHint: FeedCheckReport.SchedulingHint(feed: feed, state: previousState, response: feedResponse))
+    }
+    
+    // Many servers don't support conditional requests, but send the same
+    // feed again. Fingerprints include the filter, so that changing it counts
+    // as a change.
+    let fingerprintSeed = feed.filter.canonicalString
+    var bodyFingerprint = FeedFingerprint(seed: fingerprintSeed)
+    bodyFingerprint.combine(feedContents)
+    
+    guard bodyFingerprint.stringValue != previousState.bodyFingerprint else {
+      os_log("Feed body unchanged", log: .helper, type: .info)
+      metrics.change = .sameBody
+      var updatedState = previousState
+      updatedState.entityTag = feedResponse.headerValue(named: "ETag")
+      updatedState.lastModified = feedResponse.headerValue(named: "Last-Modified")
+      feedStates[feed] = updatedState
+      return FeedResult(schedulingHint: FeedCheckReport.SchedulingHint(feed: feed, state: updatedState, response: feedResponse))
+    }
+    
+    try cancellation.checkCancelled()
     
-    // Parse the feed
+    // Parse the feed, stopping at the first item we've seen before if possible,
+    // and keeping only items that pass the filter
+    let mode: FeedParser.Mode = options.usesStreamingParser ? .streaming : .document
+    var scan = IncrementalFeedScan(previousState: previousState, isEnabled: options.stopsAtKnownItems)
+    var itemsFingerprint = FeedFingerprint(seed: fingerprintSeed)
+    let shouldContinue = { (item: FeedItem) -> Bool in
+      guard scan.shouldContinue(after: item) else { return false }
+      itemsFingerprint.combine(item.urlString ?? "")
+      return true
+    }
     let episodes: [Episode]
     do {
-      episodes = try FeedParser.parse(feed: feed, feedContents: feedContents)
+      let (parsedEpisodes, parseDuration) = try FeedMetrics.measure { () throws -> [Episode] in
+        let parsedEpisodes = try FeedParser.parse(feed: feed, feedContents: feedContents, mode: mode, filter: filter, while: shouldContinue)
+        guard scan.needsFullScan else { return parsedEpisodes }
+        
+        os_log("Feed items changed unexpectedly, parsing the whole feed", log: .helper, type: .info)
+        scan = IncrementalFeedScan(previousState: previousState, isEnabled: false)
+        itemsFingerprint = FeedFingerprint(seed: fingerprintSeed)
+        return try FeedParser.parse(feed: feed, feedContents: feedContents, mode: mode, filter: filter, while: shouldContinue)
+      }
+      
+      episodes = parsedEpisodes
+      metrics.parseDuration = parseDuration
+      metrics.itemCount = parsedEpisodes.count
     } catch {
       throw NSError(
         domain: feedHelperErrorDomain,
@@ -54,20 +286,127 @@ enum FeedHelper {
       )
     }
     
-    // Skip old episodes
-    let newEpisodes = episodes.filter { !previouslyDownloadedURLs.contains($0.url) }
+    // Nothing was saved yet, so the whole feed will be dealt with next time.
+    // Past this point, claims must be fulfilled or released, so nothing throws.
+    try cancellation.checkCancelled()
+    
+    // Skip old episodes, and episodes that other feeds (or other items of
+    // this one) are already downloading. Copies of the latter are kept aside,
+    // in case those downloads fail. If the items are the same as last time,
+    // they were all dealt with then.
+    var newEpisodes: [Episode] = []
+    var otherCopies: [Episode] = []
+    if itemsFingerprint.stringValue == previousState.itemsFingerprint {
+      os_log("Feed items unchanged", log: .helper, type: .info)
+      metrics.change = .sameItems
+    } else {
+      metrics.change = .changed
+      let (_, filterDuration) = FeedMetrics.measure {
+        for episode in episodes {
+          switch claims.claim(episode.identityKeys) {
+          case .claimed: newEpisodes.append(episode)
+          case .duplicate: otherCopies.append(episode)
+          case .seen: break
+          }
+        }
+      }
+      metrics.filterDuration = filterDuration
+    }
+    metrics.newEpisodeCount = newEpisodes.count
+    
+    // Everything in this version of the feed is about to be dealt with, remember
+    // its validators so we can skip it next time if it doesn't change, its newest
+    // items so we can stop parsing there next time it does, and how often it changes
+    var updatedState = previousState
+    updatedState.entityTag = feedResponse.headerValue(named: "ETag")
+    updatedState.lastModified = feedResponse.headerValue(named: "Last-Modified")
+    (updatedState.newestItemURLs, updatedState.isNewestFirst) = scan.updatedState
+    updatedState.timeToLive = FeedParser.timeToLive(feedContents: feedContents)
+    updatedState.recordNewItems(latestPublicationDate: scan.latestPublicationDate, averageInterval: scan.averagePublicationInterval)
+    updatedState.bodyFingerprint = bodyFingerprint.stringValue
+    updatedState.itemsFingerprint = itemsFingerprint.stringValue
+    
+    // Download new episodes, concurrently
+    var feedResult = FeedResult()
+    feedResult.schedulingHint = FeedCheckReport.SchedulingHint(feed: feed, state: updatedState, response: feedResponse)
+    let downloader = EpisodeDownloader(downloadOptions: downloadOptions, maxDownloadAttempts: options.maxDownloadAttempts, claims: claims, cancellation: cancellation)
+    var episodeDownloadDurations: [TimeInterval] = []
+    let durationsLock = NSLock()
+    while !newEpisodes.isEmpty || !otherCopies.isEmpty {
+      if !newEpisodes.isEmpty {
+        os_log("Downloading %d new episodes", log: .helper, type: .info, newEpisodes.count)
+        let results = downloader.download(
+          episodes: newEpisodes,
+          queue: downloadQueue,
+          didFinish: { episode, result, duration in
+            // Let other copies of the episode know if they're needed
+            switch result {
+            case .success, .failure(is DuplicateEpisodeError):
+              claims.fulfill(episode.identityKeys)
+            case .failure:
+              claims.release(episode.identityKeys)
+            }
+            
+            durationsLock.lock()
+            episodeDownloadDurations.append(duration)
+            durationsLock.unlock()
+            
+            if case .success(let downloadedEpisode) = result {
+              os_log("Downloaded %{public}@", log: .helper, type: .info, episode.title)
+              didDownloadEpisode(downloadedEpisode)
+            }
+          }
+        )
+        
+        for (episode, result) in zip(newEpisodes, results) {
+          switch result {
+          case .success(let downloadedEpisode):
+            feedResult.downloadedEpisodes.append(downloadedEpisode)
+          case .failure(is DuplicateEpisodeError):
+            feedResult.duplicateEpisodes.append(episode)
+          case .failure(let error):
+            feedResult.episodeFailures.append(FeedCheckReport.EpisodeFailure(episode: episode, error: error))
+          }
+        }
+      }
+      
+      // Download copies of episodes whose other copy failed. Only wait for
+      // other downloads while this feed has no claims left to download itself,
+      // so that feeds waiting for each other's claims can't deadlock.
+      newEpisodes = []
+      var stillWaiting: [Episode] = []
+      for episode in otherCopies {
+        switch claims.state(ofClaimOn: episode.identityKeys, waiting: newEpisodes.isEmpty) {
+        case .fulfilled:
+          break
+        case .pending:
+          stillWaiting.append(episode)
+        case .released:
+          switch claims.claim(episode.identityKeys) {
+          case .claimed: newEpisodes.append(episode)
+          case .duplicate: stillWaiting.append(episode)
+          case .seen: break
+          }
+        }
+      }
+      otherCopies = stillWaiting
+      metrics.newEpisodeCount += newEpisodes.count
+    }
+    metrics.episodeDownloadDurations = episodeDownloadDurations
     
-    guard !newEpisodes.isEmpty else {
+    if metrics.newEpisodeCount == 0 {
       os_log("No new episodes to download", log: .helper, type: .info)
-      return []
+    } else {
+      os_log("Done downloading new episodes, %d failed", log: .helper, type: .info, feedResult.episodeFailures.count)
     }
     
-    // Download new episodes
-    os_log("Downloading %d new episodes", log: .helper, type: .info, newEpisodes.count)
-    let downloader = EpisodeDownloader(downloadOptions: downloadOptions)
-    let downloadedEpisodes = try newEpisodes.map(downloader.download(episode:))
-    os_log("Done downloading new episodes", log: .helper, type: .info)
-    return downloadedEpisodes
+    // Keep the previous state if some episodes failed, so that they are tried
+    // again next time even if the feed doesn't change
+    guard feedResult.episodeFailures.isEmpty else { return feedResult }
+    
+    feedStates[feed] = updatedState
+    
+    return feedResult
   }
   
   static func download(episode: Episode, downloadOptions: DownloadOptions) throws -> DownloadedEpisode {
@@ -77,3 +416,53 @@ enum FeedHelper {
     return try downloader.download(episode: episode)
   }
 }
+
+
+extension CancellationToken {
+  /// - Throws: an error with `feedHelperCancelledErrorCode` if the token was cancelled
+  func checkCancelled() throws {
+    guard isCancelled else { return }
+    
+    throw NSError(
+      domain: feedHelperErrorDomain,
+      code: feedHelperCancelledErrorCode,
+      userInfo: [NSLocalizedDescriptionKey: "Feed check cancelled"]
+    )
+  }
+}
+
+
+private extension FeedCheckReport {
+  /// A report for a single feed
+  ///
+  /// - Parameter state: what is known about the feed, in case it failed
+  init(feed: Feed, result: Result<FeedHelper.FeedResult, Error>, state: FeedState) {
+    self.init()
+    
+    switch result {
+    case .success(let feedResult):
+      downloadedEpisodes = feedResult.downloadedEpisodes
+      episodeFailures = feedResult.episodeFailures
+      duplicateEpisodes = feedResult.duplicateEpisodes
+      schedulingHints = feedResult.schedulingHint.map { [$0] } ?? []
+    case .failure(let error):
+      failures = [Failure(feed: feed, error: error)]
+      
+      var schedulingHint = SchedulingHint(feed: feed, state: state, response: nil)
+      schedulingHint.retryAfter = (error as NSError).userInfo[retryAfterErrorKey] as? TimeInterval
+      schedulingHints = [schedulingHint]
+    }
+  }
+}
+
+
+private extension FeedCheckReport.SchedulingHint {
+  init(feed: Feed, state: FeedState, response: HTTPURLResponse?) {
+    self.init(
+      feed: feed,
+      timeToLive: [state.timeToLive, response?.maxAge].compactMap { $0 }.max(),
+      latestPublicationDate: state.latestPublicationDate,
+      publicationInterval: state.publicationInterval
+    )
+  }
+}
@@ -2,6 +2,56 @@ import Foundation
 import os
 
 
+/// The raw values we care about in an RSS "item" or Atom "entry" element.
+/// When an element appears more than once, the last one wins.
+struct FeedItem: Equatable {
+  /// `url` attribute of an `enclosure` element
+  var enclosureURL: String?
+  
+  /// `length` attribute of an `enclosure` element
+  var enclosureLength: String?
+  
+  /// Contents of a `torrent:contentLength` element
+  var contentLength: String?
+  
+  /// `href` attribute of a `link` element
+  var linkHref: String?
+  
+  /// Contents of a `link` element
+  var link: String?
+  
+  /// Contents of the `title` element
+  var title: String?
+  
+  /// Contents of the `tv:show_name` element
+  var showName: String?
+  
+  /// Contents of the RSS `pubDate` element
+  var pubDate: String?
+  
+  /// Contents of the Atom `updated` element
+  var updated: String?
+}
+
+
+extension FeedItem {
+  /// The episode URL this item would produce, if any
+  var urlString: String? {
+    return enclosureURL ?? linkHref ?? link
+  }
+  
+  /// Size in bytes of what the item links to, if the feed says. Feeds often
+  /// put 0 in `length` when they don't know, so that's treated as unknown.
+  var size: Int64? {
+    let sizes = [contentLength, enclosureLength].lazy.compactMap { value -> Int64? in
+      guard let size = value.flatMap({ Int64($0.trimmingCharacters(in: .whitespacesAndNewlines)) }), size > 0 else { return nil }
+      return size
+    }
+    return sizes.first
+  }
+}
+
+
 private extension XMLNode {
   subscript(xPath: String) -> String? {
     return (try? nodes(forXPath: xPath))?.last?.stringValue
@@ -9,11 +59,26 @@ private extension XMLNode {
 }
 
 
-private extension Episode {
+private extension FeedItem {
+  init(itemNode: XMLNode) {
+    self.enclosureURL = itemNode["enclosure/@url"]
+    self.enclosureLength = itemNode["enclosure/@length"]
+    self.contentLength = itemNode["torrent:contentLength"]
+    self.linkHref = itemNode["link/@href"]
+    self.link = itemNode["link"]
+    self.title = itemNode["title"]
+    self.showName = itemNode["tv:show_name"]
+    self.pubDate = itemNode["pubDate"]
+    self.updated = itemNode["updated"]
+  }
+}
+
+
+extension Episode {
   /// Try to initialize an episode with the data found in an RSS "item" or Atom "entry" element
-  init?(itemNode: XMLNode, feed: Feed) {
+  init?(item: FeedItem, feed: Feed) {
     // Get the .torrent URL or magnet link
-    guard let urlString = itemNode["enclosure/@url"] ?? itemNode["link/@href"] ?? itemNode["link"] else {
+    guard let urlString = item.urlString else {
       os_log("Missing feed item URL", log: .helper, type: .info)
       return nil
     }
@@ -24,17 +89,15 @@ private extension Episode {
     }
     
     // Get the title (includes show name and season/episode numbers)
-    guard let title = itemNode["title"], title != "" else {
+    guard let title = item.title, title != "" else {
       os_log("Missing or empty feed item title", log: .helper, type: .info)
       return nil
     }
     
-    // Get the optional show name from the generic "tv:" namespace
-    let showName = itemNode["tv:show_name"]
-    
     self.url = url
     self.title = title
-    self.showName = showName
+    // Optional show name from the generic "tv:" namespace
+    self.showName = item.showName
     self.feed = feed
   }
 }
@@ -43,9 +106,38 @@ private extension Episode {
 /// Parses episodes out of a broadcatching RSS or Atom feed.
 /// Supports additional data specified with the `tv` namespace.
 enum FeedParser {
-  static func parse(feed: Feed, feedContents: Data) throws -> [Episode] {
+  enum Mode {
+    /// Load the whole feed into an `XMLDocument` and query it with XPath
+    case document
+    
+    /// Extract items in a single pass with `XMLParser`, without building a tree
+    case streaming
+  }
+  
+  /// - Parameter filter: items it rejects don't produce episodes. They are
+  ///   still passed to `shouldContinue`.
+  /// - Parameter shouldContinue: called with each item in document order. If it
+  ///   returns false, parsing stops and that item and all following ones are skipped.
+  static func parse(feed: Feed, feedContents: Data, mode: Mode = .streaming, filter: CompiledEpisodeFilter? = nil, while shouldContinue: @escaping (FeedItem) -> Bool = { _ in true }) throws -> [Episode] {
     os_log("Parsing feed...", log: .helper, type: .info)
     
+    let items: [FeedItem]
+    switch mode {
+    case .document:
+      items = try parseItemsFromDocument(feedContents: feedContents, while: shouldContinue)
+    case .streaming:
+      items = try StreamingFeedParser(feedContents: feedContents).parseItems(while: shouldContinue)
+    }
+    
+    let acceptedItems = filter.map { filter in items.filter(filter.accepts) } ?? items
+    let episodes = acceptedItems.compactMap { Episode(item: $0, feed: feed) }
+    
+    os_log("Parsed %d episodes (%d items filtered out)", log: .helper, type: .info, episodes.count, items.count - acceptedItems.count)
+    
+    return episodes
+  }
+  
+  private static func parseItemsFromDocument(feedContents: Data, while shouldContinue: (FeedItem) -> Bool) throws -> [FeedItem] {
     // Parse xml
     let xml = try XMLDocument(data: feedContents)
     
@@ -54,11 +146,70 @@ enum FeedParser {
     let atomItemNodes = try xml.nodes(forXPath: "//feed/entry")
     let itemNodes = rssItemNodes + atomItemNodes
     
-    // Extract episodes from NSXMLNodes
-    let episodes = itemNodes.compactMap { Episode(itemNode: $0, feed: feed) }
+    // Extract raw item data from NSXMLNodes, lazily so we can stop early
+    var items: [FeedItem] = []
+    for itemNode in itemNodes {
+      let item = FeedItem(itemNode: itemNode)
+      guard shouldContinue(item) else { break }
+      items.append(item)
+    }
+    return items
+  }
+  
+  /// The RSS channel's `ttl` (a number of minutes), as a time interval.
+  /// Parsing stops at the first item, since `ttl` comes before items in practice.
+  static func timeToLive(feedContents: Data) -> TimeInterval? {
+    return TimeToLiveParser(feedContents: feedContents).parse()
+  }
+}
+
+
+/// Looks for `//rss/channel/ttl` in a single pass, until the first item
+private final class TimeToLiveParser: NSObject, XMLParserDelegate {
+  private let parser: XMLParser
+  private var elementStack: [String] = []
+  private var capturedText: String? = nil
+  private var timeToLive: TimeInterval? = nil
+  
+  init(feedContents: Data) {
+    parser = XMLParser(data: feedContents)
+    parser.shouldResolveExternalEntities = false
     
-    os_log("Parsed %d episodes", log: .helper, type: .info, episodes.count)
+    super.init()
     
-    return episodes
+    parser.delegate = self
+  }
+  
+  func parse() -> TimeInterval? {
+    parser.parse()
+    return timeToLive
+  }
+  
+  func parser(_ parser: XMLParser, didStartElement elementName: String, namespaceURI: String?, qualifiedName: String?, attributes: [String:String] = [:]) {
+    if elementName == "item" || elementName == "entry" {
+      parser.abortParsing()
+      return
+    }
+    
+    if elementName == "ttl" && elementStack == ["rss", "channel"] {
+      capturedText = ""
+    }
+    
+    elementStack.append(elementName)
+  }
+  
+  func parser(_ parser: XMLParser, didEndElement elementName: String, namespaceURI: String?, qualifiedName: String?) {
+    elementStack.removeLast()
+    
+    guard let text = capturedText else { return }
+    
+    if let minutes = TimeInterval(text.trimmingCharacters(in: .whitespacesAndNewlines)), minutes > 0 {
+      timeToLive = minutes * 60
+    }
+    parser.abortParsing()
+  }
+  
+  func parser(_ parser: XMLParser, foundCharacters string: String) {
+    capturedText?.append(string)
   }
 }
@@ -0,0 +1,188 @@
+import Foundation
+import os
+
+
+/// What the Feed Helper remembers about a feed between checks.
+struct FeedState {
+  /// `ETag` header from the last successful check, sent back as `If-None-Match`
+  var entityTag: String?
+  
+  /// `Last-Modified` header from the last successful check, sent back as `If-Modified-Since`
+  var lastModified: String?
+  
+  /// URLs of the first items of the feed as of the last successful check, in
+  /// document order. Parsing can stop as soon as it reaches one of them.
+  var newestItemURLs: [String] = []
+  
+  /// Whether the last full scan of the feed found its items sorted newest first
+  var isNewestFirst: Bool = false
+  
+  /// The RSS channel's `ttl`, as of the last successful check
+  var timeToLive: TimeInterval? = nil
+  
+  /// Publication date of the newest item seen so far
+  var latestPublicationDate: Date? = nil
+  
+  /// Moving average of the time between new items, if known
+  var publicationInterval: TimeInterval? = nil
+  
+  /// `FeedFingerprint` of the whole body as of the last successful check.
+  /// If the feed comes back byte for byte the same, it isn't parsed again.
+  var bodyFingerprint: String? = nil
+  
+  /// `FeedFingerprint` of the URLs of the items parsed in the last successful
+  /// check, in order. If they come back the same, they aren't looked at again.
+  var itemsFingerprint: String? = nil
+}
+
+
+extension FeedState {
+  /// Updates the feed's publication cadence with the items found in a new
+  /// version of the feed.
+  ///
+  /// - Parameter averageInterval: average time between the new items, if there were several
+  mutating func recordNewItems(latestPublicationDate newLatestPublicationDate: Date?, averageInterval: TimeInterval?) {
+    guard
+      let newLatestPublicationDate = newLatestPublicationDate,
+      newLatestPublicationDate > latestPublicationDate ?? .distantPast
+    else {
+      return
+    }
+    
+    let sample = averageInterval ?? latestPublicationDate.map { newLatestPublicationDate.timeIntervalSince($0) }
+    if let sample = sample {
+      publicationInterval = publicationInterval.map { $0 * 0.7 + sample * 0.3 } ?? sample
+    }
+    
+    latestPublicationDate = newLatestPublicationDate
+  }
+}
+
+
+// MARK: Serialization
+extension FeedState {
+  var dictionaryRepresentation: [String:Any] {
+    var dictionary: [String:Any] = [:]
+    if let entityTag = entityTag {
+      dictionary["entityTag"] = entityTag
+    }
+    if let lastModified = lastModified {
+      dictionary["lastModified"] = lastModified
+    }
+    dictionary["newestItemURLs"] = newestItemURLs
+    dictionary["isNewestFirst"] = isNewestFirst
+    if let timeToLive = timeToLive {
+      dictionary["timeToLive"] = timeToLive
+    }
+    if let latestPublicationDate = latestPublicationDate {
+      dictionary["latestPublicationDate"] = latestPublicationDate
+    }
+    if let publicationInterval = publicationInterval {
+      dictionary["publicationInterval"] = publicationInterval
+    }
+    if let bodyFingerprint = bodyFingerprint {
+      dictionary["bodyFingerprint"] = bodyFingerprint
+    }
+    if let itemsFingerprint = itemsFingerprint {
+      dictionary["itemsFingerprint"] = itemsFingerprint
+    }
+    return dictionary
+  }
+}
+
+
+// MARK: Deserialization
+extension FeedState {
+  init(dictionary: [String:Any]) {
+    self.entityTag = dictionary["entityTag"] as? String
+    self.lastModified = dictionary["lastModified"] as? String
+    self.newestItemURLs = dictionary["newestItemURLs"] as? [String] ?? []
+    self.isNewestFirst = dictionary["isNewestFirst"] as? Bool ?? false
+    self.timeToLive = dictionary["timeToLive"] as? TimeInterval
+    self.latestPublicationDate = dictionary["latestPublicationDate"] as? Date
+    self.publicationInterval = dictionary["publicationInterval"] as? TimeInterval
+    self.bodyFingerprint = dictionary["bodyFingerprint"] as? String
+    self.itemsFingerprint = dictionary["itemsFingerprint"] as? String
+  }
+}
+
+
+/// Thread-safe, persistent storage of `FeedState`s, keyed by feed ID (see `Feed.id`).
+///
+/// - Note: the helper's `shared` store lives in its (sandboxed) caches directory.
+///         Losing it is harmless, feeds will just be downloaded and parsed in full once.
+final class FeedStateStore {
+  static let shared = FeedStateStore(
+    fileURL: FileManager.default
+      .urls(for: .cachesDirectory, in: .userDomainMask)
+      .first?
+      .appendingPathComponent("FeedState.plist")
+  )
+  
+  private let fileURL: URL?
+  private let lock = NSLock()
+  private var states: [String:FeedState] = [:]
+  private var hasUnsavedChanges = false
+  
+  /// - Parameter fileURL: where to persist states, or nil to only keep them in memory
+  init(fileURL: URL?) {
+    self.fileURL = fileURL
+    
+    load()
+  }
+  
+  subscript(feed: Feed) -> FeedState {
+    get {
+      lock.lock()
+      defer { lock.unlock() }
+      return states[feed.id] ?? FeedState()
+    }
+    set {
+      lock.lock()
+      defer { lock.unlock() }
+      states[feed.id] = newValue
+      hasUnsavedChanges = true
+    }
+  }
+  
+  /// Write changes to disk, if there are any.
+  func save() {
+    lock.lock()
+    defer { lock.unlock() }
+    
+    guard hasUnsavedChanges, let fileURL = fileURL else { return }
+    
+    do {
+      let data = try PropertyListSerialization.data(
+        fromPropertyList: states.mapValues { $0.dictionaryRepresentation },
+        format: .binary,
+        options: 0
+      )
+      try FileManager.default.createDirectory(
+        at: fileURL.deletingLastPathComponent(),
+        withIntermediateDirectories: true
+      )
+      try data.write(to: fileURL, options: .atomic)
+      hasUnsavedChanges = false
+    } catch {
+      os_log("Could not save feed state: %{public}@", log: .helper, type: .error, error.localizedDescription)
+    }
+  }
+  
+  private func load() {
+    guard
+      let fileURL = fileURL,
+      let data = try? Data(contentsOf: fileURL),
+      let plist = try? PropertyListSerialization.propertyList(from: data, format: nil),
+      let rawStates = plist as? [String:[String:Any]]
+    else {
+      return
+    }
+    
+    // States used to be keyed by URL. Feed IDs are normalized URLs, so this
+    // leaves them alone.
+    for (key, rawState) in rawStates {
+      states[URL(string: key)?.feedKey ?? key] = FeedState(dictionary: rawState)
+    }
+  }
+}
@@ -0,0 +1,129 @@
+import Foundation
+
+
+/// Processes items with a bounded pool of worker threads. Items can be submitted
+/// in batches from any thread, and all batches share the same workers.
+///
+/// Items are handed out round-robin by host, so that a host with lots of items
+/// can't starve everyone else, and no more than `maxConcurrentItemsPerHost` items
+/// for the same host are ever processed at the same time, whatever batch they
+/// belong to. Workers only run while there are items to process.
+final class HostFairWorkQueue {
+  private struct Job {
+    var host: String
+    var run: () -> Void
+  }
+  
+  private let maxConcurrentItems: Int
+  private let maxConcurrentItemsPerHost: Int
+  
+  private let condition = NSCondition()
+  
+  /// Jobs waiting for a worker, by host, in the order they were submitted
+  private var pendingJobs: [String:[Job]] = [:]
+  
+  /// Hosts with pending jobs, in the order they'll be served
+  private var hostOrder: [String] = []
+  
+  private var activeJobsByHost: [String:Int] = [:]
+  private var workerCount = 0
+  
+  init(maxConcurrentItems: Int, maxConcurrentItemsPerHost: Int) {
+    self.maxConcurrentItems = max(1, maxConcurrentItems)
+    self.maxConcurrentItemsPerHost = max(1, maxConcurrentItemsPerHost)
+  }
+  
+  /// Runs `work` on every item, and returns when all of them have been processed.
+  ///
+  /// - Note: `work` is called concurrently from multiple threads.
+  func process<Item>(_ items: [Item], host: (Item) -> String, work: @escaping (Item) -> Void) {
+    let done = DispatchSemaphore(value: 0)
+    process(items, host: host, work: work, completion: { done.signal() })
+    done.wait()
+  }
+  
+  /// Runs `work` on every item without blocking the calling thread, and calls
+  /// `completion` from a worker thread when all of them have been processed.
+  ///
+  /// - Note: `work` is called concurrently from multiple threads.
+  func process<Item>(_ items: [Item], host: (Item) -> String, work: @escaping (Item) -> Void, completion: @escaping () -> Void) {
+    let batch = DispatchGroup()
+    let jobs = items.map { item -> Job in
+      batch.enter()
+      return Job(host: host(item), run: {
+        work(item)
+        batch.leave()
+      })
+    }
+    
+    submit(jobs)
+    
+    batch.notify(queue: .global(qos: .utility), execute: completion)
+  }
+  
+  private func submit(_ jobs: [Job]) {
+    condition.lock()
+    for job in jobs {
+      if pendingJobs[job.host] == nil {
+        hostOrder.append(job.host)
+      }
+      pendingJobs[job.host, default: []].append(job)
+    }
+    let newWorkerCount = min(maxConcurrentItems - workerCount, jobs.count)
+    workerCount += max(0, newWorkerCount)
+    condition.unlock()
+    
+    for _ in 0..<max(0, newWorkerCount) {
+      DispatchQueue.global(qos: .utility).async {
+        while let job = self.dequeue() {
+          job.run()
+          self.finish(job)
+        }
+      }
+    }
+  }
+  
+  /// Returns the next job whose host isn't busy, waiting for one to free up if needed.
+  /// Returns nil (and retires the calling worker) when there's nothing left to do.
+  private func dequeue() -> Job? {
+    condition.lock()
+    defer { condition.unlock() }
+    
+    while !hostOrder.isEmpty {
+      let nextHostIndex = hostOrder.firstIndex {
+        activeJobsByHost[$0, default: 0] < maxConcurrentItemsPerHost
+      }
+      
+      if let nextHostIndex = nextHostIndex {
+        let host = hostOrder.remove(at: nextHostIndex)
+        let job = pendingJobs[host]!.removeFirst()
+        
+        // The host goes to the back of the line
+        if pendingJobs[host]!.isEmpty {
+          pendingJobs[host] = nil
+        } else {
+          hostOrder.append(host)
+        }
+        
+        activeJobsByHost[host, default: 0] += 1
+        return job
+      }
+      
+      // All remaining jobs are for hosts that are already busy
+      condition.wait()
+    }
+    
+    workerCount -= 1
+    return nil
+  }
+  
+  private func finish(_ job: Job) {
+    condition.lock()
+    activeJobsByHost[job.host, default: 1] -= 1
+    if activeJobsByHost[job.host] == 0 {
+      activeJobsByHost[job.host] = nil
+    }
+    condition.broadcast()
+    condition.unlock()
+  }
+}
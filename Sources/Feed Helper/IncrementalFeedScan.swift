@@ -0,0 +1,136 @@
+import Foundation
+
+
+/// Decides, item by item, whether a feed needs to be parsed any further.
+///
+/// Broadcatching feeds list their newest items first, so once we reach the item
+/// that was newest last time, everything after it has already been dealt with.
+/// We only rely on this for feeds whose publication dates confirmed that order
+/// during their last full scan.
+final class IncrementalFeedScan {
+  /// How many of the newest item URLs are remembered between checks
+  static let watermarkSize = 5
+  
+  private let previousState: FeedState
+  private let knownURLs: Set<String>
+  
+  /// Whether we can stop at the first already-seen item
+  let isIncremental: Bool
+  
+  /// URL of the already-seen item we stopped at, if any
+  private(set) var stoppedAtURL: String? = nil
+  
+  /// URLs of the items seen so far, in document order (up to `watermarkSize`)
+  private var leadingURLs: [String] = []
+  
+  private var previousDate: Date? = nil
+  private var hasDates = false
+  private var isNewestFirst = true
+  
+  /// Publication dates of the items seen so far
+  private(set) var latestPublicationDate: Date? = nil
+  private var earliestPublicationDate: Date? = nil
+  private var datedItemCount = 0
+  
+  init(previousState: FeedState, isEnabled: Bool) {
+    self.previousState = previousState
+    self.knownURLs = Set(previousState.newestItemURLs)
+    self.isIncremental = isEnabled && previousState.isNewestFirst && !previousState.newestItemURLs.isEmpty
+  }
+  
+  /// Call with each item in document order. Returns false once the rest of
+  /// the feed can be skipped.
+  func shouldContinue(after item: FeedItem) -> Bool {
+    let urlString = item.urlString
+    
+    if isIncremental, let urlString = urlString, knownURLs.contains(urlString) {
+      if let date = item.publicationDate, let previousDate = previousDate, date > previousDate {
+        isNewestFirst = false
+      }
+      stoppedAtURL = urlString
+      return false
+    }
+    
+    if let urlString = urlString, leadingURLs.count < IncrementalFeedScan.watermarkSize {
+      leadingURLs.append(urlString)
+    }
+    
+    if let date = item.publicationDate {
+      if let previousDate = previousDate, date > previousDate {
+        isNewestFirst = false
+      }
+      previousDate = date
+      hasDates = true
+      
+      latestPublicationDate = max(date, latestPublicationDate ?? date)
+      earliestPublicationDate = min(date, earliestPublicationDate ?? date)
+      datedItemCount += 1
+    }
+    
+    return true
+  }
+  
+  /// True if we stopped early, but the feed doesn't look the way it did last
+  /// time (e.g. the newest item was removed, or items were reordered).
+  /// The feed should be parsed again in full.
+  var needsFullScan: Bool {
+    guard let stoppedAtURL = stoppedAtURL else { return false }
+    return stoppedAtURL != previousState.newestItemURLs.first || !isNewestFirst
+  }
+  
+  /// Average time between the publication dates of the items seen, if there
+  /// were at least two
+  var averagePublicationInterval: TimeInterval? {
+    guard
+      datedItemCount > 1,
+      let latestPublicationDate = latestPublicationDate,
+      let earliestPublicationDate = earliestPublicationDate
+    else {
+      return nil
+    }
+    return latestPublicationDate.timeIntervalSince(earliestPublicationDate) / TimeInterval(datedItemCount - 1)
+  }
+  
+  /// What to remember about the feed's items for next time.
+  /// Only meaningful after a scan that didn't need a full scan.
+  var updatedState: (newestItemURLs: [String], isNewestFirst: Bool) {
+    guard stoppedAtURL != nil else {
+      // Full scan: the order observed here is the feed's order
+      return (leadingURLs, hasDates && isNewestFirst)
+    }
+    
+    // Stopped at the previous newest item: new items go on top of the old ones
+    let newestItemURLs = Array((leadingURLs + previousState.newestItemURLs).prefix(IncrementalFeedScan.watermarkSize))
+    return (newestItemURLs, previousState.isNewestFirst)
+  }
+}
+
+
+private let rfc822DateFormatters: [DateFormatter] = [
+  "EEE, dd MMM yyyy HH:mm:ss Z",
+  "EEE, dd MMM yyyy HH:mm:ss zzz",
+  "EEE, dd MMM yyyy HH:mm Z",
+  "dd MMM yyyy HH:mm:ss Z"
+].map { format in
+  let formatter = DateFormatter()
+  formatter.locale = Locale(identifier: "en_US_POSIX")
+  formatter.dateFormat = format
+  return formatter
+}
+
+
+private let iso8601DateFormatter = ISO8601DateFormatter()
+
+
+extension FeedItem {
+  /// `pubDate` (RFC 822) or `updated` (ISO 8601) parsed as a date, if possible
+  var publicationDate: Date? {
+    if let pubDate = pubDate?.trimmingCharacters(in: .whitespacesAndNewlines) {
+      return rfc822DateFormatters.lazy.compactMap { $0.date(from: pubDate) }.first
+    }
+    if let updated = updated?.trimmingCharacters(in: .whitespacesAndNewlines) {
+      return iso8601DateFormatter.date(from: updated)
+    }
+    return nil
+  }
+}
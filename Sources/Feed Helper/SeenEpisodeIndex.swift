@@ -0,0 +1,184 @@
+import Foundation
+import os
+
+
+/// Thread-safe, persistent index of already downloaded episodes,
+/// mapping their `Episode.identityKeys` to the date they were first seen.
+///
+/// Mirrors the app's download history, which is the source of truth: the app
+/// keeps it up to date by sending `SeenEpisodeUpdate`s with each feed check.
+///
+/// - Note: the helper's `shared` index lives in its (sandboxed) caches directory, so the
+///         index survives the helper being terminated while idle. It's saved in the
+///         background after updates, so the last ones can be lost. If the index
+///         is lost or out of date, the app will just send a full snapshot.
+final class SeenEpisodeIndex {
+  static let shared = SeenEpisodeIndex(
+    fileURL: FileManager.default
+      .urls(for: .cachesDirectory, in: .userDomainMask)
+      .first?
+      .appendingPathComponent("SeenEpisodes.plist")
+  )
+  
+  private let fileURL: URL?
+  
+  /// Where the current revision is saved when an update doesn't change the
+  /// index itself, so that the whole index isn't written again
+  private let revisionFileURL: URL?
+  
+  private let lock = NSLock()
+  private var generation: String? = nil
+  private var revision: Int? = nil
+  private var firstSeenDates: [String:Date] = [:]
+  
+  /// Revision of the index as last saved to `fileURL`
+  private var savedIndexRevision: Int? = nil
+  
+  private var isSaveScheduled = false
+  private var needsIndexSave = false
+  private let saveQueue = DispatchQueue(label: "com.giorgiocalderolla.Catch.CatchFeedHelper.SeenEpisodeIndex", qos: .utility)
+  
+  /// - Parameter fileURL: where to persist the index, or nil to only keep it in memory
+  init(fileURL: URL?) {
+    self.fileURL = fileURL
+    self.revisionFileURL = fileURL.map {
+      $0.deletingPathExtension().appendingPathExtension("revision.plist")
+    }
+    
+    load()
+  }
+  
+  /// Applies an update from the app. The result is saved to disk in the background.
+  ///
+  /// - Returns: false if the update is a delta against a revision we don't
+  ///            have. The index is left untouched in that case.
+  func apply(_ update: SeenEpisodeUpdate) -> Bool {
+    lock.lock()
+    defer { lock.unlock() }
+    
+    if let baseRevision = update.baseRevision {
+      guard generation == update.generation, revision == baseRevision else {
+        os_log("Seen episodes index is out of sync (have %{public}@, update is based on %d)", log: .helper, type: .info, "\(revision ?? -1)", baseRevision)
+        return false
+      }
+    } else {
+      firstSeenDates = [:]
+    }
+    
+    for key in update.removed {
+      firstSeenDates[key] = nil
+    }
+    firstSeenDates.merge(update.added) { existingDate, _ in existingDate }
+    
+    generation = update.generation
+    revision = update.revision
+    
+    os_log("Applied seen episodes update (%d added, %d removed, %d total)", log: .helper, type: .info, update.added.count, update.removed.count, firstSeenDates.count)
+    
+    // Most updates are empty deltas, only the revision needs saving then
+    let changesIndex = update.isSnapshot || !update.added.isEmpty || !update.removed.isEmpty
+    scheduleSave(changesIndex: changesIndex)
+    
+    return true
+  }
+  
+  /// - Parameter key: one of an episode's `identityKeys`
+  func contains(key: String) -> Bool {
+    lock.lock()
+    defer { lock.unlock() }
+    
+    return firstSeenDates[key] != nil
+  }
+  
+  /// - Note: must be called with `lock` held
+  private func scheduleSave(changesIndex: Bool) {
+    needsIndexSave = needsIndexSave || changesIndex
+    
+    guard !isSaveScheduled else { return }
+    isSaveScheduled = true
+    saveQueue.async { self.save() }
+  }
+  
+  /// Writes the index if it changed since it was last saved, and the revision
+  private func save() {
+    lock.lock()
+    isSaveScheduled = false
+    let (generation, revision, firstSeenDates) = (self.generation, self.revision, self.firstSeenDates)
+    let savesIndex = needsIndexSave
+    needsIndexSave = false
+    if savesIndex {
+      savedIndexRevision = revision
+    }
+    let savedIndexRevision = self.savedIndexRevision
+    lock.unlock()
+    
+    guard
+      let fileURL = fileURL,
+      let revisionFileURL = revisionFileURL,
+      let generation = generation,
+      let revision = revision,
+      let indexRevision = savedIndexRevision
+    else {
+      return
+    }
+    
+    do {
+      try FileManager.default.createDirectory(
+        at: fileURL.deletingLastPathComponent(),
+        withIntermediateDirectories: true
+      )
+      
+      if savesIndex {
+        let plist: [String:Any] = [
+          "generation": generation,
+          "revision": revision,
+          "firstSeenDates": firstSeenDates
+        ]
+        let data = try PropertyListSerialization.data(fromPropertyList: plist, format: .binary, options: 0)
+        try data.write(to: fileURL, options: .atomic)
+      }
+      
+      let revisionPlist: [String:Any] = [
+        "generation": generation,
+        "revision": revision,
+        "indexRevision": indexRevision
+      ]
+      let revisionData = try PropertyListSerialization.data(fromPropertyList: revisionPlist, format: .binary, options: 0)
+      try revisionData.write(to: revisionFileURL, options: .atomic)
+    } catch {
+      os_log("Could not save seen episodes index: %{public}@", log: .helper, type: .error, error.localizedDescription)
+    }
+  }
+  
+  private func load() {
+    guard
+      let fileURL = fileURL,
+      let data = try? Data(contentsOf: fileURL),
+      let plist = try? PropertyListSerialization.propertyList(from: data, format: nil) as? [String:Any],
+      let generation = plist["generation"] as? String,
+      let revision = plist["revision"] as? Int,
+      let firstSeenDates = plist["firstSeenDates"] as? [String:Date]
+    else {
+      return
+    }
+    
+    self.generation = generation
+    self.revision = revision
+    self.firstSeenDates = firstSeenDates
+    self.savedIndexRevision = revision
+    
+    // Later updates might not have changed the index, only its revision
+    guard
+      let revisionFileURL = revisionFileURL,
+      let revisionData = try? Data(contentsOf: revisionFileURL),
+      let revisionPlist = try? PropertyListSerialization.propertyList(from: revisionData, format: nil) as? [String:Any],
+      revisionPlist["generation"] as? String == generation,
+      revisionPlist["indexRevision"] as? Int == revision,
+      let latestRevision = revisionPlist["revision"] as? Int
+    else {
+      return
+    }
+    
+    self.revision = latestRevision
+  }
+}
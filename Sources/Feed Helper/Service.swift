@@ -1,84 +1,171 @@
 import Foundation
+import os
 
 
-/// Implements the FeedHelperService XPC protocol, and handles serialization/deserialization
-final class Service: NSObject {}
+/// Checks in progress, so that they can be cancelled. Thread-safe.
+private final class ActiveChecks {
+  private struct Check {
+    var cancellation: CancellationToken
+    
+    /// Identifies the connection the check came from
+    var connection: ObjectIdentifier?
+  }
+  
+  private let lock = NSLock()
+  private var checks: [String:Check] = [:]
+  
+  func insert(_ checkID: String, cancellation: CancellationToken, connection: NSXPCConnection?) {
+    lock.lock()
+    defer { lock.unlock() }
+    checks[checkID] = Check(cancellation: cancellation, connection: connection.map { ObjectIdentifier($0) })
+  }
+  
+  func remove(_ checkID: String) {
+    lock.lock()
+    defer { lock.unlock() }
+    checks[checkID] = nil
+  }
+  
+  func cancel(_ checkID: String) {
+    lock.lock()
+    let check = checks[checkID]
+    lock.unlock()
+    
+    check?.cancellation.cancel()
+  }
+  
+  /// Cancels all checks that came from `connection`
+  func cancelAll(from connection: ObjectIdentifier) {
+    lock.lock()
+    let connectionChecks = checks.values.filter { $0.connection == connection }
+    lock.unlock()
+    
+    for check in connectionChecks {
+      check.cancellation.cancel()
+    }
+  }
+}
+
+
+/// Implements the FeedHelperService XPC protocol, and handles serialization/deserialization.
+///
+/// Messages from a connection are delivered one at a time, so work is done on
+/// other threads, and replies are sent when it's done. That leaves the
+/// connection free to deliver `cancelFeedCheck(checkID:)` in the meantime.
+final class Service: NSObject {
+  private let activeChecks = ActiveChecks()
+  
+  private let workQueue = DispatchQueue(label: "com.giorgiocalderolla.Catch.CatchFeedHelper.work", qos: .utility, attributes: .concurrent)
+}
 
 
 extension Service: FeedHelperService {
   func checkFeeds(
-    feeds: [[AnyHashable:Any]],
-    downloadingToBookmark downloadDirectoryBookmark: Data,
-    organizingByShow shouldOrganizeByShow: Bool,
-    savingMagnetLinks shouldSaveMagnetLinks: Bool,
-    savingTorrentFiles shouldSaveTorrentFiles: Bool,
-    skippingURLs previouslyDownloadedURLs: [String],
-    withReply reply: @escaping (_ downloadedFeedFiles: [[AnyHashable:Any]]?, _ error: Error?) -> Void) {
-    let downloadedEpisodes: [DownloadedEpisode]
+    checkID: String,
+    request: Data,
+    withReply reply: @escaping (_ report: Data?, _ error: Error?) -> Void) {
+    // Only available while handling the message
+    let connection = NSXPCConnection.current()
+    let client = connection?.remoteObjectProxy as? FeedHelperClient
     
+    let request: FeedCheckRequest
     do {
-      let downloadOptions = try DownloadOptions(
-        containerDirectoryBookmark: downloadDirectoryBookmark,
-        shouldOrganizeByShow: shouldOrganizeByShow,
-        shouldSaveMagnetLinks: shouldSaveMagnetLinks,
-        shouldSaveTorrentFiles: shouldSaveTorrentFiles
-      )
-      
-      downloadedEpisodes = try FeedHelper.checkFeeds(
-        feeds: feeds.map { Feed(dictionary: $0)! },
-        downloadOptions: downloadOptions,
-        skippingURLs: previouslyDownloadedURLs.map { URL.init(string: $0)! }
-      )
+      request = try FeedHelperPayload.decode(FeedCheckRequest.self, from: request)
     } catch {
       reply(nil, error)
       return
     }
     
-    reply(downloadedEpisodes.map { $0.dictionaryRepresentation }, nil)
-  }
-  
-  func download(feed: [AnyHashable : Any], withReply reply: @escaping (Data?, Error?) -> Void) {
-    let feedContents: Data
-    
-    do {
-      feedContents = try FeedHelper.downloadFeed(
-        feed: Feed(dictionary: feed)!
-      )
-    } catch {
-      reply(nil, error)
+    // Bring the seen episodes index up to date before checking anything. This
+    // is done right away, so that updates are applied in the order they're sent.
+    guard SeenEpisodeIndex.shared.apply(request.seenEpisodeUpdate) else {
+      reply(nil, NSError(
+        domain: feedHelperErrorDomain,
+        code: SeenEpisodeUpdate.outOfSyncErrorCode,
+        userInfo: [NSLocalizedDescriptionKey: "Seen episodes index is out of sync"]
+      ))
       return
     }
     
-    reply(feedContents, nil)
+    let cancellation = CancellationToken()
+    activeChecks.insert(checkID, cancellation: cancellation, connection: connection)
+    
+    FeedHelper.checkFeeds(
+      feeds: request.feeds,
+      options: request.options,
+      downloadOptions: request.downloadOptions,
+      seenEpisodes: SeenEpisodeIndex.shared,
+      cancellation: cancellation,
+      didDownloadEpisode: { downloadedEpisode in
+        guard let payload = try? FeedHelperPayload.encode(downloadedEpisode) else { return }
+        client?.feedCheck(checkID, didDownloadEpisode: payload)
+      },
+      didFinishFeed: { feed, feedReport in
+        guard
+          let feedPayload = try? FeedHelperPayload.encode(feed),
+          let reportPayload = try? FeedHelperPayload.encode(feedReport)
+        else {
+          return
+        }
+        client?.feedCheck(checkID, didFinishFeed: feedPayload, report: reportPayload)
+      },
+      completion: { [activeChecks] report in
+        activeChecks.remove(checkID)
+        
+        // Even if the check was cancelled, the episodes downloaded until then
+        // need to be handled
+        do {
+          reply(try FeedHelperPayload.encode(report), nil)
+        } catch {
+          reply(nil, error)
+        }
+      }
+    )
+  }
+  
+  func cancelFeedCheck(checkID: String) {
+    os_log("Cancelling feed check", log: .helper, type: .info)
+    activeChecks.cancel(checkID)
+  }
+  
+  func download(feed: Data, withReply reply: @escaping (Data?, Error?) -> Void) {
+    workQueue.async {
+      let feedContents: Data
+      
+      do {
+        feedContents = try FeedHelper.downloadFeed(
+          feed: FeedHelperPayload.decode(Feed.self, from: feed)
+        )
+      } catch {
+        reply(nil, error)
+        return
+      }
+      
+      reply(feedContents, nil)
+    }
   }
   
   func download(
-    episode: [AnyHashable:Any],
-    toBookmark downloadDirectoryBookmark: Data,
-    organizingByShow shouldOrganizeByShow: Bool,
-    savingMagnetLinks shouldSaveMagnetLinks: Bool,
-    savingTorrentFiles shouldSaveTorrentFiles: Bool,
-    withReply reply: @escaping (_ downloadedFile: [AnyHashable:Any]?, _ error: Error?) -> Void) {
-    let downloadedFile: DownloadedEpisode
-    
-    do {
-      let downloadOptions = try DownloadOptions(
-        containerDirectoryBookmark: downloadDirectoryBookmark,
-        shouldOrganizeByShow: shouldOrganizeByShow,
-        shouldSaveMagnetLinks: shouldSaveMagnetLinks,
-        shouldSaveTorrentFiles: shouldSaveTorrentFiles
-      )
+    episode: Data,
+    downloadOptions: Data,
+    withReply reply: @escaping (_ downloadedFile: Data?, _ error: Error?) -> Void) {
+    workQueue.async {
+      let downloadedFilePayload: Data
       
-      downloadedFile = try FeedHelper.download(
-        episode: Episode(dictionary: episode)!,
-        downloadOptions: downloadOptions
-      )
-    } catch {
-      reply(nil, error)
-      return
+      do {
+        let downloadedFile = try FeedHelper.download(
+          episode: FeedHelperPayload.decode(Episode.self, from: episode),
+          downloadOptions: FeedHelperPayload.decode(DownloadOptions.self, from: downloadOptions)
+        )
+        
+        downloadedFilePayload = try FeedHelperPayload.encode(downloadedFile)
+      } catch {
+        reply(nil, error)
+        return
+      }
+      
+      reply(downloadedFilePayload, nil)
     }
-    
-    reply(downloadedFile.dictionaryRepresentation, nil)
   }
 }
 
@@ -87,6 +174,14 @@ extension Service: NSXPCListenerDelegate {
   func listener(_ listener: NSXPCListener, shouldAcceptNewConnection newConnection: NSXPCConnection) -> Bool {
     newConnection.exportedInterface = NSXPCInterface(with: FeedHelperService.self)
     newConnection.exportedObject = self
+    newConnection.remoteObjectInterface = NSXPCInterface(with: FeedHelperClient.self)
+    
+    // Nobody is waiting for the checks of a connection that's gone, e.g. because the app quit
+    let connectionID = ObjectIdentifier(newConnection)
+    newConnection.invalidationHandler = { [activeChecks] in
+      activeChecks.cancelAll(from: connectionID)
+    }
+    
     newConnection.resume()
     
     return true
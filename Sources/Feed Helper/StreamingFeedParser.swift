@@ -0,0 +1,166 @@
+import Foundation
+
+
+/// Extracts `FeedItem`s from an RSS or Atom feed in a single pass with `XMLParser`,
+/// without loading the whole document in memory.
+///
+/// Produces exactly the same items as the XPath queries used by `FeedParser` in
+/// `.document` mode: RSS items (`//rss/channel/item`) first, then Atom entries
+/// (`//feed/entry`), each in document order.
+final class StreamingFeedParser: NSObject {
+  private let parser: XMLParser
+  
+  /// Names of the currently open elements, outermost first
+  private var elementStack: [String] = []
+  
+  private var rssItems: [FeedItem] = []
+  private var atomItems: [FeedItem] = []
+  
+  private struct OpenItem {
+    var item = FeedItem()
+    var isAtom: Bool
+    
+    /// Depth of the item's element in `elementStack`
+    var depth: Int
+  }
+  
+  /// The item being parsed, if any
+  private var currentItem: OpenItem? = nil
+  
+  /// Text of the item child element currently being captured, if any
+  private var capturedText: String? = nil
+  
+  private var shouldContinue: (FeedItem) -> Bool = { _ in true }
+  private var didStopEarly = false
+  
+  init(feedContents: Data) {
+    parser = XMLParser(data: feedContents)
+    parser.shouldProcessNamespaces = false
+    parser.shouldReportNamespacePrefixes = false
+    parser.shouldResolveExternalEntities = false
+    
+    super.init()
+    
+    parser.delegate = self
+  }
+  
+  /// - Parameter shouldContinue: called with each item as soon as it's parsed. If it
+  ///   returns false, parsing stops and that item and all following ones are skipped.
+  func parseItems(while shouldContinue: @escaping (FeedItem) -> Bool = { _ in true }) throws -> [FeedItem] {
+    self.shouldContinue = shouldContinue
+    
+    guard parser.parse() || didStopEarly else {
+      throw parser.parserError ?? NSError(
+        domain: XMLParser.errorDomain,
+        code: XMLParser.ErrorCode.internalError.rawValue
+      )
+    }
+    
+    return rssItems + atomItems
+  }
+  
+  private var isInRSSChannel: Bool {
+    return elementStack.suffix(2) == ["rss", "channel"]
+  }
+  
+  private var isInAtomFeed: Bool {
+    return elementStack.last == "feed"
+  }
+}
+
+
+extension StreamingFeedParser: XMLParserDelegate {
+  func parser(_ parser: XMLParser, didStartElement elementName: String, namespaceURI: String?, qualifiedName: String?, attributes: [String:String] = [:]) {
+    defer { elementStack.append(elementName) }
+    
+    guard var openItem = currentItem else {
+      // Not inside an item, look for the start of one
+      if elementName == "item" && isInRSSChannel {
+        currentItem = OpenItem(isAtom: false, depth: elementStack.count)
+      } else if elementName == "entry" && isInAtomFeed {
+        currentItem = OpenItem(isAtom: true, depth: elementStack.count)
+      }
+      return
+    }
+    
+    // Only direct children of the item are relevant
+    guard elementStack.count == openItem.depth + 1 else { return }
+    
+    switch elementName {
+    case "enclosure":
+      if let url = attributes["url"] {
+        openItem.item.enclosureURL = url
+      }
+      if let length = attributes["length"] {
+        openItem.item.enclosureLength = length
+      }
+    case "link":
+      if let href = attributes["href"] {
+        openItem.item.linkHref = href
+      }
+      capturedText = ""
+    case "title", "tv:show_name", "torrent:contentLength", "pubDate", "updated":
+      capturedText = ""
+    default:
+      break
+    }
+    
+    currentItem = openItem
+  }
+  
+  func parser(_ parser: XMLParser, didEndElement elementName: String, namespaceURI: String?, qualifiedName: String?) {
+    elementStack.removeLast()
+    
+    guard var openItem = currentItem else { return }
+    
+    if elementStack.count == openItem.depth {
+      // End of the item itself
+      currentItem = nil
+      
+      guard shouldContinue(openItem.item) else {
+        didStopEarly = true
+        parser.abortParsing()
+        return
+      }
+      
+      if openItem.isAtom {
+        atomItems.append(openItem.item)
+      } else {
+        rssItems.append(openItem.item)
+      }
+      return
+    }
+    
+    // End of a direct child of the item
+    guard elementStack.count == openItem.depth + 1, let text = capturedText else { return }
+    
+    switch elementName {
+    case "link":
+      openItem.item.link = text
+    case "title":
+      openItem.item.title = text
+    case "tv:show_name":
+      openItem.item.showName = text
+    case "torrent:contentLength":
+      openItem.item.contentLength = text
+    case "pubDate":
+      openItem.item.pubDate = text
+    case "updated":
+      openItem.item.updated = text
+    default:
+      break
+    }
+    
+    capturedText = nil
+    currentItem = openItem
+  }
+  
+  func parser(_ parser: XMLParser, foundCharacters string: String) {
+    capturedText?.append(string)
+  }
+  
+  func parser(_ parser: XMLParser, foundCDATA CDATABlock: Data) {
+    guard capturedText != nil else { return }
+    capturedText?.append(String(decoding: CDATABlock, as: UTF8.self))
+  }
+}
@@ -0,0 +1,98 @@
+import Foundation
+import CommonCrypto
+
+
+/// Just enough of the .torrent file format (bencoding) to tell torrents apart
+enum TorrentFile {
+  /// The torrent's info hash (SHA-1 of its bencoded `info` dictionary), as
+  /// lowercase hex. Nil if `data` is not a torrent file.
+  static func infoHash(of data: Data) -> String? {
+    let bytes = [UInt8](data)
+    guard let infoRange = Bencode(bytes: bytes).rangeOfInfoDictionary() else { return nil }
+    
+    var digest = [UInt8](repeating: 0, count: Int(CC_SHA1_DIGEST_LENGTH))
+    bytes[infoRange].withUnsafeBytes { buffer in
+      _ = CC_SHA1(buffer.baseAddress, CC_LONG(buffer.count), &digest)
+    }
+    
+    return digest.map { String(format: "%02x", $0) }.joined()
+  }
+  
+  static func infoHash(ofFileAt url: URL) -> String? {
+    guard let data = try? Data(contentsOf: url, options: .mappedIfSafe) else { return nil }
+    return infoHash(of: data)
+  }
+}
+
+
+/// Finds where bencoded values start and end, without decoding them
+private struct Bencode {
+  /// Deeper nesting than this is assumed to be garbage
+  private static let maxDepth = 64
+  
+  let bytes: [UInt8]
+  
+  /// Where the value of the "info" key of the top level dictionary is
+  func rangeOfInfoDictionary() -> Range<Int>? {
+    guard bytes.first == UInt8(ascii: "d") else { return nil }
+    
+    var index = 1
+    while index < bytes.count, bytes[index] != UInt8(ascii: "e") {
+      guard
+        let (key, valueStart) = byteString(at: index),
+        let valueEnd = endOfValue(at: valueStart, depth: 1)
+      else {
+        return nil
+      }
+      
+      if bytes[key].elementsEqual("info".utf8) {
+        return valueStart..<valueEnd
+      }
+      index = valueEnd
+    }
+    
+    return nil
+  }
+  
+  /// Where the value starting at `start` ends, or nil if it's malformed
+  private func endOfValue(at start: Int, depth: Int) -> Int? {
+    guard start < bytes.count, depth < Bencode.maxDepth else { return nil }
+    
+    switch bytes[start] {
+    case UInt8(ascii: "i"):
+      guard let end = bytes[start...].firstIndex(of: UInt8(ascii: "e")) else { return nil }
+      return end + 1
+    case UInt8(ascii: "l"), UInt8(ascii: "d"):
+      var index = start + 1
+      while index < bytes.count, bytes[index] != UInt8(ascii: "e") {
+        guard let end = endOfValue(at: index, depth: depth + 1) else { return nil }
+        index = end
+      }
+      return index < bytes.count ? index + 1 : nil
+    case UInt8(ascii: "0")...UInt8(ascii: "9"):
+      return byteString(at: start)?.end
+    default:
+      return nil
+    }
+  }
+  
+  /// The contents of the byte string ("<length>:<bytes>") starting at `start`,
+  /// and where it ends
+  private func byteString(at start: Int) -> (contents: Range<Int>, end: Int)? {
+    var index = start
+    var length = 0
+    while index < bytes.count, (UInt8(ascii: "0")...UInt8(ascii: "9")).contains(bytes[index]) {
+      length = length * 10 + Int(bytes[index] - UInt8(ascii: "0"))
+      guard length <= bytes.count else { return nil }
+      index += 1
+    }
+    
+    guard index > start, index < bytes.count, bytes[index] == UInt8(ascii: ":") else { return nil }
+    
+    let contentsStart = index + 1
+    let end = contentsStart + length
+    guard end <= bytes.count else { return nil }
+    
+    return (contentsStart..<end, end)
+  }
+}
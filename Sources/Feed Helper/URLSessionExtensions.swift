@@ -0,0 +1,316 @@
+import Foundation
+
+
+private extension TimeInterval {
+  /// Longest time a whole download can take, even if data keeps coming
+  static let resourceTimeout: TimeInterval = 120
+}
+
+
+private extension Int {
+  /// Connections to keep open to each host. Feeds and torrent files from the
+  /// same tracker are limited to 2 concurrent downloads each.
+  static let maxConnectionsPerHost = 4
+}
+
+
+/// Receives the responses of the tasks of the sessions it's the delegate of,
+/// enforcing a maximum size for each, and keeps their `URLSessionTaskMetrics`.
+///
+/// Data tasks' responses are accumulated in memory, download tasks' are moved
+/// to the file they were registered with.
+final class SessionTaskDelegate: NSObject, URLSessionDataDelegate, URLSessionDownloadDelegate {
+  /// The data is empty for download tasks
+  typealias Completion = (Result<(URLResponse, Data), Error>, URLSessionTaskMetrics?) -> Void
+  
+  private struct TaskState {
+    var maxResponseSize: Int
+    var fileURL: URL?
+    var completion: Completion
+    var response: URLResponse? = nil
+    var data = Data()
+    var metrics: URLSessionTaskMetrics? = nil
+    
+    /// Set when we cancel the task ourselves
+    var error: Error? = nil
+  }
+  
+  private let lock = NSLock()
+  private var states: [Int:TaskState] = [:]
+  
+  /// Must be called before `task` is resumed
+  ///
+  /// - Parameter fileURL: for download tasks, where to move the downloaded file
+  func register(_ task: URLSessionTask, maxResponseSize: Int, fileURL: URL? = nil, completion: @escaping Completion) {
+    lock.lock()
+    defer { lock.unlock() }
+    states[task.taskIdentifier] = TaskState(maxResponseSize: maxResponseSize, fileURL: fileURL, completion: completion)
+  }
+  
+  func urlSession(_ session: URLSession, dataTask: URLSessionDataTask, didReceive response: URLResponse, completionHandler: @escaping (URLSession.ResponseDisposition) -> Void) {
+    lock.lock()
+    defer { lock.unlock() }
+    
+    states[dataTask.taskIdentifier]?.response = response
+    
+    // Don't even start downloading responses that say they are too large
+    if let maxResponseSize = states[dataTask.taskIdentifier]?.maxResponseSize, response.expectedContentLength > maxResponseSize {
+      states[dataTask.taskIdentifier]?.error = URLError(.dataLengthExceedsMaximum)
+      completionHandler(.cancel)
+    } else {
+      completionHandler(.allow)
+    }
+  }
+  
+  func urlSession(_ session: URLSession, dataTask: URLSessionDataTask, didReceive data: Data) {
+    lock.lock()
+    defer { lock.unlock() }
+    
+    guard var state = states[dataTask.taskIdentifier], state.error == nil else { return }
+    
+    // Servers can lie about (or omit) the length, and compressed responses grow
+    if state.data.count + data.count > state.maxResponseSize {
+      state.error = URLError(.dataLengthExceedsMaximum)
+      state.data = Data()
+      dataTask.cancel()
+    } else {
+      state.data.append(data)
+    }
+    states[dataTask.taskIdentifier] = state
+  }
+  
+  func urlSession(_ session: URLSession, downloadTask: URLSessionDownloadTask, didWriteData bytesWritten: Int64, totalBytesWritten: Int64, totalBytesExpectedToWrite: Int64) {
+    lock.lock()
+    defer { lock.unlock() }
+    
+    guard let state = states[downloadTask.taskIdentifier], state.error == nil else { return }
+    
+    if max(totalBytesWritten, totalBytesExpectedToWrite) > Int64(state.maxResponseSize) {
+      states[downloadTask.taskIdentifier]?.error = URLError(.dataLengthExceedsMaximum)
+      downloadTask.cancel()
+    }
+  }
+  
+  func urlSession(_ session: URLSession, downloadTask: URLSessionDownloadTask, didFinishDownloadingTo location: URL) {
+    lock.lock()
+    defer { lock.unlock() }
+    
+    guard let fileURL = states[downloadTask.taskIdentifier]?.fileURL else { return }
+    
+    // The file at `location` is deleted as soon as this returns
+    do {
+      try? FileManager.default.removeItem(at: fileURL)
+      try FileManager.default.moveItem(at: location, to: fileURL)
+    } catch {
+      states[downloadTask.taskIdentifier]?.error = error
+    }
+  }
+  
+  func urlSession(_ session: URLSession, task: URLSessionTask, didFinishCollecting metrics: URLSessionTaskMetrics) {
+    lock.lock()
+    defer { lock.unlock() }
+    states[task.taskIdentifier]?.metrics = metrics
+  }
+  
+  func urlSession(_ session: URLSession, task: URLSessionTask, didCompleteWithError error: Error?) {
+    lock.lock()
+    let state = states.removeValue(forKey: task.taskIdentifier)
+    lock.unlock()
+    
+    guard let finishedState = state else { return }
+    
+    if let error = finishedState.error ?? error {
+      finishedState.completion(.failure(error), finishedState.metrics)
+    } else {
+      finishedState.completion(.success(((finishedState.response ?? task.response)!, finishedState.data)), finishedState.metrics)
+    }
+  }
+}
+
+
+extension URLSessionConfiguration {
+  /// Settings for the helper's downloads: no local caching (freshness is
+  /// handled explicitly with validators), compressed responses, and a few
+  /// persistent connections per host.
+  static var helper: URLSessionConfiguration {
+    let configuration = URLSessionConfiguration.default
+    configuration.requestCachePolicy = .reloadIgnoringLocalCacheData
+    configuration.urlCache = nil
+    configuration.timeoutIntervalForResource = .resourceTimeout
+    configuration.httpMaximumConnectionsPerHost = .maxConnectionsPerHost
+    configuration.httpShouldSetCookies = false
+    
+    // Responses are decompressed transparently
+    if #available(macOS 10.13, *) {
+      configuration.httpAdditionalHeaders = ["Accept-Encoding": "br, gzip, deflate"]
+    } else {
+      configuration.httpAdditionalHeaders = ["Accept-Encoding": "gzip, deflate"]
+    }
+    
+    return configuration
+  }
+}
+
+
+extension URLSession {
+  /// Used for all of the helper's downloads, feeds and torrent files alike, so
+  /// that connections (HTTP/2 ones in particular, which multiplex requests) to
+  /// the same few trackers are reused across checks.
+  static let helper = URLSession(
+    configuration: .helper,
+    delegate: SessionTaskDelegate(),
+    delegateQueue: nil
+  )
+  
+  func downloadSynchronously(request: URLRequest, maxResponseSize: Int = .max) throws -> (URLResponse, Data) {
+    let (urlResponse, data, _) = try downloadSynchronouslyCollectingMetrics(request: request, maxResponseSize: maxResponseSize)
+    return (urlResponse, data)
+  }
+  
+  /// Also returns the task's metrics, if the session's delegate is a `SessionTaskDelegate`.
+  ///
+  /// - Parameter cancellation: cancels the task when cancelled
+  /// - Throws: `URLError.dataLengthExceedsMaximum` if the response is larger than `maxResponseSize`,
+  ///   `URLError.cancelled` if `cancellation` was cancelled
+  func downloadSynchronouslyCollectingMetrics(request: URLRequest, maxResponseSize: Int = .max, cancellation: CancellationToken? = nil) throws -> (URLResponse, Data, URLSessionTaskMetrics?) {
+    var outcome: (Result<(URLResponse, Data), Error>, URLSessionTaskMetrics?)!
+    
+    let taskSemaphore = DispatchSemaphore(value: 0)
+    let task: URLSessionTask
+    if let taskDelegate = delegate as? SessionTaskDelegate {
+      task = dataTask(with: request)
+      taskDelegate.register(task, maxResponseSize: maxResponseSize) { result, taskMetrics in
+        outcome = (result, taskMetrics)
+        taskSemaphore.signal()
+      }
+    } else {
+      task = dataTask(with: request) { (data, response, error) in
+        if let error = error {
+          outcome = (.failure(error), nil)
+        } else if data!.count > maxResponseSize {
+          outcome = (.failure(URLError(.dataLengthExceedsMaximum)), nil)
+        } else {
+          outcome = (.success((response!, data!)), nil)
+        }
+        taskSemaphore.signal()
+      }
+    }
+    task.resumeAndWait(for: taskSemaphore, cancellation: cancellation)
+    
+    let (urlResponse, downloadedData) = try outcome.0.get()
+    return (urlResponse, downloadedData, outcome.1)
+  }
+  
+  func downloadSynchronously(url: URL) throws -> (URLResponse, Data) {
+    return try downloadSynchronously(request: URLRequest(url: url))
+  }
+  
+  /// Streams the response body to `fileURL` (replacing anything there) instead
+  /// of keeping it in memory. The file is written whatever the status code.
+  ///
+  /// - Parameter cancellation: cancels the task when cancelled
+  /// - Throws: `URLError.dataLengthExceedsMaximum` if the response is larger than `maxResponseSize`,
+  ///   `URLError.cancelled` if `cancellation` was cancelled
+  func downloadFileSynchronously(request: URLRequest, to fileURL: URL, maxResponseSize: Int = .max, cancellation: CancellationToken? = nil) throws -> URLResponse {
+    var outcome: Result<URLResponse, Error>!
+    
+    let taskSemaphore = DispatchSemaphore(value: 0)
+    let task: URLSessionTask
+    if let taskDelegate = delegate as? SessionTaskDelegate {
+      task = downloadTask(with: request)
+      taskDelegate.register(task, maxResponseSize: maxResponseSize, fileURL: fileURL) { result, _ in
+        outcome = result.map { $0.0 }
+        taskSemaphore.signal()
+      }
+    } else {
+      task = downloadTask(with: request) { (location, response, error) in
+        outcome = Result {
+          if let error = error { throw error }
+          try? FileManager.default.removeItem(at: fileURL)
+          try FileManager.default.moveItem(at: location!, to: fileURL)
+          
+          let fileSize = (try? fileURL.resourceValues(forKeys: [.fileSizeKey]))?.fileSize ?? 0
+          guard fileSize <= maxResponseSize else {
+            try? FileManager.default.removeItem(at: fileURL)
+            throw URLError(.dataLengthExceedsMaximum)
+          }
+          
+          return response!
+        }
+        taskSemaphore.signal()
+      }
+    }
+    task.resumeAndWait(for: taskSemaphore, cancellation: cancellation)
+    
+    return try outcome.get()
+  }
+}
+
+
+private extension URLSessionTask {
+  /// Starts the task, and blocks until `semaphore` is signaled by its completion.
+  /// If `cancellation` is cancelled in the meantime, the task is cancelled and
+  /// completes right away.
+  func resumeAndWait(for semaphore: DispatchSemaphore, cancellation: CancellationToken?) {
+    guard let cancellation = cancellation else {
+      resume()
+      semaphore.wait()
+      return
+    }
+    
+    cancellation.performCancellable({
+      resume()
+      semaphore.wait()
+    }, onCancel: cancel)
+  }
+}
+
+
+extension HTTPURLResponse {
+  /// Case-insensitive header lookup (`value(forHTTPHeaderField:)` requires macOS 10.15)
+  func headerValue(named name: String) -> String? {
+    for (key, value) in allHeaderFields {
+      if let key = key as? String, key.caseInsensitiveCompare(name) == .orderedSame {
+        return value as? String
+      }
+    }
+    return nil
+  }
+  
+  /// How long the server asked us to wait with `Retry-After` (either in seconds
+  /// or as an HTTP date), if it did
+  var retryAfter: TimeInterval? {
+    guard let value = headerValue(named: "Retry-After")?.trimmingCharacters(in: .whitespaces) else {
+      return nil
+    }
+    
+    if let seconds = TimeInterval(value) {
+      return max(0, seconds)
+    }
+    
+    return httpDateFormatter.date(from: value).map { max(0, $0.timeIntervalSinceNow) }
+  }
+  
+  /// The `max-age` directive of the `Cache-Control` header, if any
+  var maxAge: TimeInterval? {
+    guard let cacheControl = headerValue(named: "Cache-Control") else { return nil }
+    
+    for directive in cacheControl.split(separator: ",") {
+      let parts = directive.split(separator: "=", maxSplits: 1).map { $0.trimmingCharacters(in: .whitespaces) }
+      if parts.count == 2, parts[0].lowercased() == "max-age", let seconds = TimeInterval(parts[1]) {
+        return seconds
+      }
+    }
+    
+    return nil
+  }
+}
+
+
+private let httpDateFormatter: DateFormatter = {
+  let formatter = DateFormatter()
+  formatter.locale = Locale(identifier: "en_US_POSIX")
+  formatter.timeZone = TimeZone(identifier: "GMT")
+  formatter.dateFormat = "EEE, dd MMM yyyy HH:mm:ss zzz"
+  return formatter
+}()
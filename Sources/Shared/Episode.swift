@@ -46,17 +46,6 @@ extension Episode {
 }
 
 
-extension DownloadedEpisode {
-  var dictionaryRepresentation: [AnyHashable:Any] {
-    var dictionary = episode.dictionaryRepresentation
-    if let localURL = localURL {
-      dictionary["localURL"] = localURL.absoluteString
-    }
-    return dictionary
-  }
-}
-
-
 // MARK: Deserialization
 extension Episode {
   init?(dictionary: [AnyHashable:Any]) {
@@ -80,13 +69,3 @@ extension Episode {
     }
   }
 }
-
-
-extension DownloadedEpisode {
-  init?(dictionary: [AnyHashable:Any]) {
-    guard let episode = Episode(dictionary: dictionary) else { return nil }
-    
-    self.episode = episode
-    self.localURL = (dictionary["localURL"] as? String).flatMap(URL.init(string:))
-  }
-}
@@ -0,0 +1,175 @@
+import Foundation
+
+
+/// A condition on a feed item, used to decide whether it's worth downloading
+struct EpisodeFilterRule: Equatable, Hashable, Codable {
+  enum Kind: String, Codable {
+    /// `pattern` appears in `field`, ignoring case
+    case substring
+    
+    /// `pattern` is a regular expression that matches part of `field`, ignoring case
+    case regex
+    
+    /// The item's size (its enclosure's `length`, or `torrent:contentLength`)
+    /// is between `minSize` and `maxSize` bytes. Items of unknown size never match.
+    case sizeRange
+  }
+  
+  enum Field: String, Codable {
+    case title
+    
+    /// `tv:show_name`
+    case showName
+    
+    /// The torrent file URL or magnet link
+    case url
+  }
+  
+  var kind: Kind
+  var field: Field = .title
+  var pattern: String = ""
+  
+  /// Size range bounds in bytes, nil for no bound
+  var minSize: Int64? = nil
+  var maxSize: Int64? = nil
+  
+  init(kind: Kind, field: Field = .title, pattern: String = "", minSize: Int64? = nil, maxSize: Int64? = nil) {
+    self.kind = kind
+    self.field = field
+    self.pattern = pattern
+    self.minSize = minSize
+    self.maxSize = maxSize
+  }
+  
+  static func substring(_ pattern: String, in field: Field = .title) -> EpisodeFilterRule {
+    return EpisodeFilterRule(kind: .substring, field: field, pattern: pattern)
+  }
+  
+  static func regex(_ pattern: String, in field: Field = .title) -> EpisodeFilterRule {
+    return EpisodeFilterRule(kind: .regex, field: field, pattern: pattern)
+  }
+  
+  static func size(min minSize: Int64? = nil, max maxSize: Int64? = nil) -> EpisodeFilterRule {
+    return EpisodeFilterRule(kind: .sizeRange, minSize: minSize, maxSize: maxSize)
+  }
+}
+
+
+/// Which items of a feed to download. An item is downloaded if it matches
+/// any of `includes` (or `includes` is empty) and none of `excludes`.
+///
+/// The Feed Helper compiles filters once per check, and applies them while
+/// parsing, so that rejected items are never downloaded.
+///
+/// - Note: items the helper has already dealt with aren't looked at again, so
+///         loosening a filter doesn't bring back items that were rejected before.
+struct EpisodeFilter: Equatable, Hashable, Codable {
+  var includes: [EpisodeFilterRule] = []
+  var excludes: [EpisodeFilterRule] = []
+  
+  init(includes: [EpisodeFilterRule] = [], excludes: [EpisodeFilterRule] = []) {
+    self.includes = includes
+    self.excludes = excludes
+  }
+  
+  /// True if the filter lets every item through
+  var isEmpty: Bool {
+    return includes.isEmpty && excludes.isEmpty
+  }
+}
+
+
+// MARK: Title substrings
+extension EpisodeFilter {
+  /// Patterns of the `includes` rules that look for a substring of the title,
+  /// the kind of rule that can be edited in Preferences. Setting it leaves the
+  /// other rules alone.
+  var includedTitleSubstrings: [String] {
+    get { return includes.titleSubstrings }
+    set { includes.setTitleSubstrings(newValue) }
+  }
+  
+  /// Same as `includedTitleSubstrings`, for `excludes`
+  var excludedTitleSubstrings: [String] {
+    get { return excludes.titleSubstrings }
+    set { excludes.setTitleSubstrings(newValue) }
+  }
+}
+
+private extension Array where Element == EpisodeFilterRule {
+  var titleSubstrings: [String] {
+    return filter { $0.kind == .substring && $0.field == .title }.map { $0.pattern }
+  }
+  
+  mutating func setTitleSubstrings(_ patterns: [String]) {
+    removeAll { $0.kind == .substring && $0.field == .title }
+    append(contentsOf: patterns.map { .substring($0) })
+  }
+}
+
+// MARK: Serialization
+extension EpisodeFilterRule {
+  var dictionaryRepresentation: [AnyHashable:Any] {
+    var dictionary: [AnyHashable:Any] = [
+      "kind": kind.rawValue,
+      "field": field.rawValue,
+      "pattern": pattern
+    ]
+    dictionary["minSize"] = minSize.map(NSNumber.init(value:))
+    dictionary["maxSize"] = maxSize.map(NSNumber.init(value:))
+    return dictionary
+  }
+}
+
+extension EpisodeFilter {
+  var dictionaryRepresentation: [AnyHashable:Any] {
+    return [
+      "includes": includes.map { $0.dictionaryRepresentation },
+      "excludes": excludes.map { $0.dictionaryRepresentation }
+    ]
+  }
+}
+
+extension EpisodeFilterRule {
+  /// One line per rule. Patterns are prefixed with their length, so that no
+  /// pattern can pass for another rule's fields.
+  var canonicalString: String {
+    let bounds = [minSize, maxSize].map { bound in bound.map { String($0) } ?? "-" }
+    return "\(kind.rawValue) \(field.rawValue) \(bounds[0]) \(bounds[1]) \(pattern.utf8.count):\(pattern)"
+  }
+}
+
+extension EpisodeFilter {
+  /// Only changes when the filter does, whatever the OS or Swift version.
+  /// Used to seed `FeedFingerprint`s, so that editing a filter counts as a change.
+  var canonicalString: String {
+    let lines = includes.map { "include \($0.canonicalString)" } + excludes.map { "exclude \($0.canonicalString)" }
+    return lines.joined(separator: "\n")
+  }
+}
+
+// MARK: Deserialization
+extension EpisodeFilterRule {
+  init?(dictionary: [AnyHashable:Any]) {
+    guard let kind = (dictionary["kind"] as? String).flatMap(Kind.init(rawValue:)) else {
+      return nil
+    }
+    self.kind = kind
+    self.field = (dictionary["field"] as? String).flatMap(Field.init(rawValue:)) ?? .title
+    self.pattern = dictionary["pattern"] as? String ?? ""
+    self.minSize = (dictionary["minSize"] as? NSNumber)?.int64Value
+    self.maxSize = (dictionary["maxSize"] as? NSNumber)?.int64Value
+  }
+}
+
+extension EpisodeFilter {
+  /// Rules that can't be read are skipped
+  init(dictionary: [AnyHashable:Any]) {
+    let rules = { (key: String) -> [EpisodeFilterRule] in
+      let dictionaries = dictionary[key] as? [[AnyHashable:Any]] ?? []
+      return dictionaries.compactMap(EpisodeFilterRule.init(dictionary:))
+    }
+    self.includes = rules("includes")
+    self.excludes = rules("excludes")
+  }
+}
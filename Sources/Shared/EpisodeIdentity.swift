@@ -0,0 +1,70 @@
+import Foundation
+
+
+/// "S01E02", "s01.e02", "1x02"...
+private let numberingPatterns = [
+  try! NSRegularExpression(pattern: "\\bs(\\d{1,3})[ ._-]?e(\\d{1,4})\\b", options: .caseInsensitive),
+  try! NSRegularExpression(pattern: "\\b(\\d{1,2})x(\\d{2,3})\\b", options: .caseInsensitive)
+]
+
+
+/// Recognizing episodes that were already downloaded, even when they show up
+/// under other URLs (other trackers, other qualities) or in other feeds.
+extension Episode {
+  /// The season and episode numbers in the title, along with what comes
+  /// before them, which is usually the name of the show
+  var numbering: (showName: String, season: Int, episode: Int)? {
+    let range = NSRange(title.startIndex..., in: title)
+    
+    for pattern in numberingPatterns {
+      guard
+        let match = pattern.firstMatch(in: title, range: range),
+        let prefixRange = Range(NSRange(location: 0, length: match.range.location), in: title),
+        let seasonRange = Range(match.range(at: 1), in: title),
+        let episodeRange = Range(match.range(at: 2), in: title),
+        let season = Int(title[seasonRange]),
+        let episode = Int(title[episodeRange])
+      else {
+        continue
+      }
+      
+      return (String(title[prefixRange]), season, episode)
+    }
+    
+    return nil
+  }
+  
+  /// Keys that identify this episode in the seen episodes index:
+  /// - its URL's `episodeKey`
+  /// - the info hash in its URL, if there is one
+  /// - its show, season and episode, if the title says (the feed's
+  ///   `tv:show_name` is preferred to the title for the show)
+  var identityKeys: [String] {
+    var keys = [url.episodeKey]
+    
+    if let infoHash = url.infoHash, !keys.contains(URL.episodeKey(infoHash: infoHash)) {
+      keys.append(URL.episodeKey(infoHash: infoHash))
+    }
+    
+    if let numbering = numbering {
+      let show = (showName ?? numbering.showName).normalizedShowName
+      if !show.isEmpty {
+        keys.append("episode:\(show):s\(numbering.season)e\(numbering.episode)")
+      }
+    }
+    
+    return keys
+  }
+}
+
+
+private extension String {
+  /// Lowercase words without diacritics or punctuation, so that e.g.
+  /// "Show C & Friends" and "show.c.friends" match
+  var normalizedShowName: String {
+    return folding(options: [.caseInsensitive, .diacriticInsensitive], locale: Locale(identifier: "en_US_POSIX"))
+      .components(separatedBy: CharacterSet.alphanumerics.inverted)
+      .filter { !$0.isEmpty }
+      .joined(separator: " ")
+  }
+}
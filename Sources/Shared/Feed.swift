@@ -3,11 +3,30 @@ import Foundation
 
 struct Feed: Equatable, Hashable {
   var name: String
-  var url: URL
+  var url: URL {
+    didSet { id = url.feedKey }
+  }
+  
+  /// Identifies the feed across launches and edits of its name, filter or
+  /// folder. Feeds whose URLs only differ in ways that don't matter (see
+  /// `URL.feedKey`) have the same ID.
+  ///
+  /// Computed once per URL, since feed keys aren't cheap to make.
+  private(set) var id: String
+  
+  /// Which of the feed's items to download
+  var filter = EpisodeFilter()
   
-  init(name: String, url: URL) {
+  /// Names of the OPML folders the feed was imported from, outermost first.
+  /// Kept so that exporting puts it back where it was.
+  var folder: [String] = []
+  
+  init(name: String, url: URL, filter: EpisodeFilter = EpisodeFilter(), folder: [String] = []) {
     self.name = name
     self.url = url
+    self.id = url.feedKey
+    self.filter = filter
+    self.folder = folder
   }
 }
 
@@ -15,10 +34,17 @@ struct Feed: Equatable, Hashable {
 // MARK: Serialization
 extension Feed {
   var dictionaryRepresentation: [AnyHashable:Any] {
-    return [
+    var dictionary: [AnyHashable:Any] = [
       "name": name,
       "url": url.absoluteString
     ]
+    if !filter.isEmpty {
+      dictionary["filter"] = filter.dictionaryRepresentation
+    }
+    if !folder.isEmpty {
+      dictionary["folder"] = folder
+    }
+    return dictionary
   }
 }
 
@@ -34,5 +60,8 @@ extension Feed {
     }
     self.name = name
     self.url = url
+    self.id = url.feedKey
+    self.filter = (dictionary["filter"] as? [AnyHashable:Any]).map(EpisodeFilter.init(dictionary:)) ?? EpisodeFilter()
+    self.folder = dictionary["folder"] as? [String] ?? []
   }
 }
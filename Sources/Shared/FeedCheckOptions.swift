@@ -0,0 +1,36 @@
+import Foundation
+
+
+/// Tunables for a feed check, as opposed to `DownloadOptions` which describe
+/// what to do with new episodes.
+struct FeedCheckOptions {
+  /// How many feeds can be downloaded and parsed at the same time.
+  /// 1 checks feeds one after another.
+  var maxConcurrentFeeds: Int = 4
+  
+  /// How many feeds from the same host can be downloaded at the same time,
+  /// so that one slow tracker can't take up the whole pool.
+  var maxConcurrentFeedsPerHost: Int = 2
+  
+  /// Parse feeds in a single pass instead of building a DOM and querying it
+  /// with XPath. Both produce the same episodes.
+  var usesStreamingParser: Bool = true
+  
+  /// Stop parsing a feed at the first item that was already there last time,
+  /// for feeds that list their newest items first.
+  var stopsAtKnownItems: Bool = true
+  
+  /// How many torrent files from the same feed can be downloaded at the same time.
+  var maxConcurrentDownloads: Int = 4
+  
+  /// How many torrent files from the same host can be downloaded at the same time.
+  var maxConcurrentDownloadsPerHost: Int = 2
+  
+  /// How many times to try downloading a torrent file before giving up on it
+  /// (until the next check). Only timeouts, server errors etc. are retried.
+  var maxDownloadAttempts: Int = 3
+}
+
+
+// MARK: Serialization
+extension FeedCheckOptions: Codable {}
@@ -0,0 +1,54 @@
+import Foundation
+
+
+/// The outcome of checking a list of feeds. Feeds are checked independently, so
+/// some of them can fail without affecting episodes found in the others.
+struct FeedCheckReport {
+  struct Failure {
+    var feed: Feed
+    var error: Error
+  }
+  
+  struct EpisodeFailure {
+    var episode: Episode
+    var error: Error
+  }
+  
+  /// What is known about when a feed should be checked again
+  struct SchedulingHint {
+    var feed: Feed
+    
+    /// Minimum time between checks requested by the feed (RSS `ttl`) or its
+    /// server (`Cache-Control: max-age`)
+    var timeToLive: TimeInterval? = nil
+    
+    /// How long the server asked us to wait with `Retry-After`
+    var retryAfter: TimeInterval? = nil
+    
+    /// Publication date of the newest item ever seen in the feed
+    var latestPublicationDate: Date? = nil
+    
+    /// Typical time between new items in the feed
+    var publicationInterval: TimeInterval? = nil
+  }
+  
+  var downloadedEpisodes: [DownloadedEpisode] = []
+  
+  /// Feeds that could not be checked
+  var failures: [Failure] = []
+  
+  /// New episodes that could not be downloaded. They will be tried again
+  /// next time their feed is checked.
+  var episodeFailures: [EpisodeFailure] = []
+  
+  /// New episodes whose torrent file turned out to be the same as one that was
+  /// already downloaded, under another URL. They were not saved.
+  var duplicateEpisodes: [Episode] = []
+  
+  /// One for each feed that was checked, whether it failed or not
+  var schedulingHints: [SchedulingHint] = []
+  
+  /// One for each feed that was checked, whether it failed or not
+  var metrics: [FeedMetrics] = []
+}
+
@@ -0,0 +1,19 @@
+import Foundation
+
+
+/// Implemented by the app, so that the Feed Helper can report progress while a
+/// feed check is still running (the final reply only comes once all feeds are done).
+/// Calls are identified by the `checkID` passed to `FeedHelperService.checkFeeds`.
+/// Values are sent as `FeedHelperPayload`s.
+@objc protocol FeedHelperClient {
+  /// A new episode was downloaded (and isn't going to be retried)
+  ///
+  /// - Parameter downloadedEpisode: a `DownloadedEpisode`
+  func feedCheck(_ checkID: String, didDownloadEpisode downloadedEpisode: Data)
+  
+  /// A feed is done
+  ///
+  /// - Parameter feed: a `Feed`
+  /// - Parameter report: a `FeedCheckReport` that only covers that feed
+  func feedCheck(_ checkID: String, didFinishFeed feed: Data, report: Data)
+}
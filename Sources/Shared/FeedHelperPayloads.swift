@@ -0,0 +1,315 @@
+import Foundation
+
+
+/// Typed encoding of everything that crosses the XPC boundary between the app
+/// and the Feed Helper: payloads are `Codable` values, sent as binary property lists.
+///
+/// Both sides trust each other, so decoding doesn't validate feed URLs again.
+/// Where a payload contains many episodes, their feeds are stored once in a
+/// `FeedTable` and referenced by index.
+enum FeedHelperPayload {
+  static func encode<Payload: Encodable>(_ payload: Payload) throws -> Data {
+    let encoder = PropertyListEncoder()
+    encoder.outputFormat = .binary
+    return try encoder.encode(payload)
+  }
+  
+  static func decode<Payload: Decodable>(_ type: Payload.Type, from data: Data) throws -> Payload {
+    return try PropertyListDecoder().decode(type, from: data)
+  }
+}
+
+
+/// Everything the helper needs to check feeds
+struct FeedCheckRequest: Codable {
+  var feeds: [Feed]
+  var options: FeedCheckOptions
+  var downloadOptions: DownloadOptions
+  var seenEpisodeUpdate: SeenEpisodeUpdate
+}
+
+
+/// Interns feeds by ID (see `Feed.id`), so that each one is encoded once per payload
+struct FeedTable {
+  private(set) var feeds: [Feed] = []
+  private var indexes: [String:Int] = [:]
+  
+  /// Adds `feed` to the table if needed, and returns its index
+  mutating func index(of feed: Feed) -> Int {
+    if let index = indexes[feed.id] {
+      return index
+    }
+    
+    let index = feeds.count
+    feeds.append(feed)
+    indexes[feed.id] = index
+    return index
+  }
+  
+  func feed(at index: Int) throws -> Feed {
+    guard feeds.indices.contains(index) else {
+      throw DecodingError.dataCorrupted(.init(codingPath: [], debugDescription: "Bad feed index \(index)"))
+    }
+    return feeds[index]
+  }
+}
+
+
+extension FeedTable: Codable {
+  init(from decoder: Decoder) throws {
+    feeds = try decoder.singleValueContainer().decode([Feed].self)
+  }
+  
+  func encode(to encoder: Encoder) throws {
+    var container = encoder.singleValueContainer()
+    try container.encode(feeds)
+  }
+}
+
+
+// MARK: Feeds, episodes, options
+extension Feed: Codable {
+  private enum CodingKeys: String, CodingKey {
+    case name, url, filter, folder
+  }
+  
+  init(from decoder: Decoder) throws {
+    let container = try decoder.container(keyedBy: CodingKeys.self)
+    name = try container.decode(String.self, forKey: .name)
+    url = try container.decodeURL(forKey: .url)
+    id = url.feedKey
+    filter = try container.decodeIfPresent(EpisodeFilter.self, forKey: .filter) ?? EpisodeFilter()
+    folder = try container.decodeIfPresent([String].self, forKey: .folder) ?? []
+  }
+  
+  func encode(to encoder: Encoder) throws {
+    var container = encoder.container(keyedBy: CodingKeys.self)
+    try container.encode(name, forKey: .name)
+    try container.encode(url.absoluteString, forKey: .url)
+    if !filter.isEmpty {
+      try container.encode(filter, forKey: .filter)
+    }
+    if !folder.isEmpty {
+      try container.encode(folder, forKey: .folder)
+    }
+  }
+}
+
+
+/// An episode (and where it was saved, if it was), with its feed in a `FeedTable`
+private struct EpisodeRecord: Codable {
+  var title: String
+  var url: String
+  var showName: String?
+  var feed: Int?
+  var localURL: String?
+  
+  init(downloadedEpisode: DownloadedEpisode, feedTable: inout FeedTable) {
+    title = downloadedEpisode.episode.title
+    url = downloadedEpisode.episode.url.absoluteString
+    showName = downloadedEpisode.episode.showName
+    feed = downloadedEpisode.episode.feed.map { feedTable.index(of: $0) }
+    localURL = downloadedEpisode.localURL?.absoluteString
+  }
+  
+  func downloadedEpisode(feedTable: FeedTable) throws -> DownloadedEpisode {
+    guard let url = URL(string: url) else {
+      throw DecodingError.dataCorrupted(.init(codingPath: [], debugDescription: "Bad episode URL"))
+    }
+    
+    return DownloadedEpisode(
+      episode: Episode(
+        title: title,
+        url: url,
+        showName: showName,
+        feed: try feed.map(feedTable.feed(at:))
+      ),
+      localURL: localURL.flatMap(URL.init(string:))
+    )
+  }
+}
+
+
+extension Episode: Codable {
+  init(from decoder: Decoder) throws {
+    self = try DownloadedEpisode(from: decoder).episode
+  }
+  
+  func encode(to encoder: Encoder) throws {
+    try DownloadedEpisode(episode: self, localURL: nil).encode(to: encoder)
+  }
+}
+
+
+extension DownloadedEpisode: Codable {
+  private enum CodingKeys: String, CodingKey {
+    case feeds, episode
+  }
+  
+  init(from decoder: Decoder) throws {
+    let container = try decoder.container(keyedBy: CodingKeys.self)
+    let feedTable = try container.decode(FeedTable.self, forKey: .feeds)
+    self = try container.decode(EpisodeRecord.self, forKey: .episode).downloadedEpisode(feedTable: feedTable)
+  }
+  
+  func encode(to encoder: Encoder) throws {
+    var feedTable = FeedTable()
+    let record = EpisodeRecord(downloadedEpisode: self, feedTable: &feedTable)
+    
+    var container = encoder.container(keyedBy: CodingKeys.self)
+    try container.encode(feedTable, forKey: .feeds)
+    try container.encode(record, forKey: .episode)
+  }
+}
+
+
+extension DownloadOptions: Codable {
+  private enum CodingKeys: String, CodingKey {
+    case containerDirectoryBookmark, shouldOrganizeByShow, shouldSaveMagnetLinks, shouldSaveTorrentFiles
+  }
+  
+  /// - Note: throws if the bookmark can't be resolved
+  init(from decoder: Decoder) throws {
+    let container = try decoder.container(keyedBy: CodingKeys.self)
+    try self.init(
+      containerDirectoryBookmark: try container.decode(Data.self, forKey: .containerDirectoryBookmark),
+      shouldOrganizeByShow: try container.decode(Bool.self, forKey: .shouldOrganizeByShow),
+      shouldSaveMagnetLinks: try container.decode(Bool.self, forKey: .shouldSaveMagnetLinks),
+      shouldSaveTorrentFiles: try container.decode(Bool.self, forKey: .shouldSaveTorrentFiles)
+    )
+  }
+  
+  func encode(to encoder: Encoder) throws {
+    var container = encoder.container(keyedBy: CodingKeys.self)
+    try container.encode(containerDirectoryBookmark, forKey: .containerDirectoryBookmark)
+    try container.encode(shouldOrganizeByShow, forKey: .shouldOrganizeByShow)
+    try container.encode(shouldSaveMagnetLinks, forKey: .shouldSaveMagnetLinks)
+    try container.encode(shouldSaveTorrentFiles, forKey: .shouldSaveTorrentFiles)
+  }
+}
+
+
+// MARK: Reports
+/// Errors are flattened to what can be shown to users, since the underlying
+/// errors aren't necessarily serializable
+private struct ErrorRecord: Codable {
+  var domain: String
+  var code: Int
+  var description: String
+  var reason: String?
+  
+  init(error: Error) {
+    let nsError = error as NSError
+    domain = nsError.domain
+    code = nsError.code
+    description = nsError.localizedDescription
+    reason = (nsError.userInfo[NSUnderlyingErrorKey] as? Error)?.localizedDescription
+  }
+  
+  var error: NSError {
+    var userInfo: [String:Any] = [NSLocalizedDescriptionKey: description]
+    userInfo[NSLocalizedFailureReasonErrorKey] = reason
+    return NSError(domain: domain, code: code, userInfo: userInfo)
+  }
+}
+
+
+extension FeedCheckReport: Codable {
+  private enum CodingKeys: String, CodingKey {
+    case feeds, downloadedEpisodes, failures, episodeFailures, duplicateEpisodes, schedulingHints, metrics
+  }
+  
+  private struct FailureRecord: Codable {
+    var feed: Int
+    var error: ErrorRecord
+  }
+  
+  private struct EpisodeFailureRecord: Codable {
+    var episode: EpisodeRecord
+    var error: ErrorRecord
+  }
+  
+  private struct SchedulingHintRecord: Codable {
+    var feed: Int
+    var timeToLive: TimeInterval?
+    var retryAfter: TimeInterval?
+    var latestPublicationDate: Date?
+    var publicationInterval: TimeInterval?
+  }
+  
+  init(from decoder: Decoder) throws {
+    let container = try decoder.container(keyedBy: CodingKeys.self)
+    let feedTable = try container.decode(FeedTable.self, forKey: .feeds)
+    
+    downloadedEpisodes = try container.decode([EpisodeRecord].self, forKey: .downloadedEpisodes).map {
+      try $0.downloadedEpisode(feedTable: feedTable)
+    }
+    failures = try container.decode([FailureRecord].self, forKey: .failures).map {
+      Failure(feed: try feedTable.feed(at: $0.feed), error: $0.error.error)
+    }
+    episodeFailures = try container.decode([EpisodeFailureRecord].self, forKey: .episodeFailures).map {
+      EpisodeFailure(episode: try $0.episode.downloadedEpisode(feedTable: feedTable).episode, error: $0.error.error)
+    }
+    duplicateEpisodes = try container.decode([EpisodeRecord].self, forKey: .duplicateEpisodes).map {
+      try $0.downloadedEpisode(feedTable: feedTable).episode
+    }
+    schedulingHints = try container.decode([SchedulingHintRecord].self, forKey: .schedulingHints).map {
+      SchedulingHint(
+        feed: try feedTable.feed(at: $0.feed),
+        timeToLive: $0.timeToLive,
+        retryAfter: $0.retryAfter,
+        latestPublicationDate: $0.latestPublicationDate,
+        publicationInterval: $0.publicationInterval
+      )
+    }
+    metrics = try container.decode([FeedMetrics].self, forKey: .metrics)
+  }
+  
+  func encode(to encoder: Encoder) throws {
+    var feedTable = FeedTable()
+    
+    let downloadedEpisodeRecords = downloadedEpisodes.map {
+      EpisodeRecord(downloadedEpisode: $0, feedTable: &feedTable)
+    }
+    let failureRecords = failures.map {
+      FailureRecord(feed: feedTable.index(of: $0.feed), error: ErrorRecord(error: $0.error))
+    }
+    let episodeFailureRecords = episodeFailures.map {
+      EpisodeFailureRecord(
+        episode: EpisodeRecord(downloadedEpisode: DownloadedEpisode(episode: $0.episode, localURL: nil), feedTable: &feedTable),
+        error: ErrorRecord(error: $0.error)
+      )
+    }
+    let duplicateEpisodeRecords = duplicateEpisodes.map {
+      EpisodeRecord(downloadedEpisode: DownloadedEpisode(episode: $0, localURL: nil), feedTable: &feedTable)
+    }
+    let schedulingHintRecords = schedulingHints.map {
+      SchedulingHintRecord(
+        feed: feedTable.index(of: $0.feed),
+        timeToLive: $0.timeToLive,
+        retryAfter: $0.retryAfter,
+        latestPublicationDate: $0.latestPublicationDate,
+        publicationInterval: $0.publicationInterval
+      )
+    }
+    
+    var container = encoder.container(keyedBy: CodingKeys.self)
+    try container.encode(feedTable, forKey: .feeds)
+    try container.encode(downloadedEpisodeRecords, forKey: .downloadedEpisodes)
+    try container.encode(failureRecords, forKey: .failures)
+    try container.encode(episodeFailureRecords, forKey: .episodeFailures)
+    try container.encode(duplicateEpisodeRecords, forKey: .duplicateEpisodes)
+    try container.encode(schedulingHintRecords, forKey: .schedulingHints)
+    try container.encode(metrics, forKey: .metrics)
+  }
+}
+
+
+private extension KeyedDecodingContainer {
+  func decodeURL(forKey key: Key) throws -> URL {
+    guard let url = URL(string: try decode(String.self, forKey: key)) else {
+      throw DecodingError.dataCorruptedError(forKey: key, in: self, debugDescription: "Bad URL")
+    }
+    return url
+  }
+}
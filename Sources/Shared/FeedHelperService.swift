@@ -4,28 +4,51 @@ import Foundation
 let feedHelperErrorDomain = "com.giorgiocalderolla.Catch.CatchFeedHelper"
 
 
+/// Code of the error for work that was stopped by `cancelFeedCheck(checkID:)`
+let feedHelperCancelledErrorCode = -11
+
+
+extension Error {
+  /// Whether this is the error for work that was cancelled
+  var isFeedHelperCancellation: Bool {
+    let nsError = self as NSError
+    return nsError.domain == feedHelperErrorDomain && nsError.code == feedHelperCancelledErrorCode
+  }
+}
+
+
+/// Values are sent as `FeedHelperPayload`s, the expected types are noted for each.
 @objc protocol FeedHelperService {
+  /// Progress is reported to the connection's `FeedHelperClient` as it happens,
+  /// tagged with `checkID`. The reply covers everything.
+  ///
+  /// - Parameter request: a `FeedCheckRequest`
+  /// - Parameter reply: with a `FeedCheckReport`
   func checkFeeds(
-    feeds: [[AnyHashable:Any]],
-    downloadingToBookmark downloadDirectoryBookmark: Data,
-    organizingByShow shouldOrganizeByShow: Bool,
-    savingMagnetLinks shouldSaveMagnetLinks: Bool,
-    savingTorrentFiles shouldSaveTorrentFiles: Bool,
-    skippingURLs previouslyDownloadedURLs: [String],
-    withReply reply: @escaping (_ downloadedFeedFiles: [[AnyHashable:Any]]?, _ error: Error?) -> Void
+    checkID: String,
+    request: Data,
+    withReply reply: @escaping (_ report: Data?, _ error: Error?) -> Void
   )
   
+  /// Stops the check with `checkID`, if it's still in progress. Feeds and
+  /// episodes that are done by then are reported as usual, the rest fail with
+  /// `feedHelperCancelledErrorCode`, and the check replies as soon as the work
+  /// in progress has wound down.
+  func cancelFeedCheck(checkID: String)
+  
+  /// - Parameter feed: a `Feed`
+  /// - Parameter reply: with the feed's raw contents
   func download(
-    feed: [AnyHashable:Any],
+    feed: Data,
     withReply reply: @escaping (_ downloadedFeed: Data?, _ error: Error?) -> Void
   )
   
+  /// - Parameter episode: an `Episode`
+  /// - Parameter downloadOptions: a `DownloadOptions`
+  /// - Parameter reply: with a `DownloadedEpisode`
   func download(
-    episode: [AnyHashable:Any],
-    toBookmark downloadDirectoryBookmark: Data,
-    organizingByShow shouldOrganizeByShow: Bool,
-    savingMagnetLinks shouldSaveMagnetLinks: Bool,
-    savingTorrentFiles shouldSaveTorrentFiles: Bool,
-    withReply reply: @escaping (_ downloadedFile: [AnyHashable:Any]?, _ error: Error?) -> Void
+    episode: Data,
+    downloadOptions: Data,
+    withReply reply: @escaping (_ downloadedFile: Data?, _ error: Error?) -> Void
   )
 }
@@ -0,0 +1,84 @@
+import Foundation
+
+
+/// Timings (in seconds) and counters for each stage of checking a feed,
+/// collected by the Feed Helper. Stages that didn't happen are nil.
+struct FeedMetrics: Codable {
+  /// How the feed compared to the last time it was checked successfully
+  enum Change: String, Codable {
+    /// The server said so (HTTP 304). Nothing was downloaded.
+    case notModified
+    
+    /// Downloaded again, but byte for byte the same. Not parsed.
+    case sameBody
+    
+    /// Parsed, but with the same items in the same order. Items weren't
+    /// compared with the download history.
+    case sameItems
+    
+    case changed
+  }
+  
+  var feedURL: String
+  
+  /// DNS lookup, from the feed download's `URLSessionTaskMetrics`
+  var domainLookupDuration: TimeInterval? = nil
+  
+  /// TCP and TLS handshakes, from the feed download's `URLSessionTaskMetrics`
+  var connectDuration: TimeInterval? = nil
+  
+  /// From sending the request to receiving the last byte of the response,
+  /// from the feed download's `URLSessionTaskMetrics`
+  var transferDuration: TimeInterval? = nil
+  
+  /// The whole feed download, as seen by the helper
+  var downloadDuration: TimeInterval? = nil
+  
+  var statusCode: Int? = nil
+  var bytesDownloaded = 0
+  
+  /// Nil if the feed couldn't be downloaded or parsed
+  var change: Change? = nil
+  
+  var parseDuration: TimeInterval? = nil
+  
+  /// Episodes found while parsing
+  var itemCount = 0
+  
+  /// Skipping episodes that were seen before
+  var filterDuration: TimeInterval? = nil
+  var newEpisodeCount = 0
+  
+  /// How long each new episode took to download, including retries
+  var episodeDownloadDurations: [TimeInterval] = []
+  
+  var totalDuration: TimeInterval = 0
+  
+  init(feed: Feed) {
+    feedURL = feed.url.absoluteString
+  }
+}
+
+
+extension FeedMetrics {
+  /// Copies network timings from the feed download task
+  mutating func record(_ taskMetrics: URLSessionTaskMetrics) {
+    guard let transaction = taskMetrics.transactionMetrics.last else { return }
+    
+    domainLookupDuration = duration(from: transaction.domainLookupStartDate, to: transaction.domainLookupEndDate)
+    connectDuration = duration(from: transaction.connectStartDate, to: transaction.connectEndDate)
+    transferDuration = duration(from: transaction.requestStartDate, to: transaction.responseEndDate)
+  }
+  
+  private func duration(from startDate: Date?, to endDate: Date?) -> TimeInterval? {
+    guard let startDate = startDate, let endDate = endDate else { return nil }
+    return endDate.timeIntervalSince(startDate)
+  }
+  
+  /// Runs `body`, and returns how long it took along with its result
+  static func measure<Result>(_ body: () throws -> Result) rethrows -> (result: Result, duration: TimeInterval) {
+    let start = DispatchTime.now()
+    let result = try body()
+    return (result, TimeInterval(DispatchTime.now().uptimeNanoseconds - start.uptimeNanoseconds) / 1_000_000_000)
+  }
+}
@@ -0,0 +1,37 @@
+import Foundation
+
+
+/// A change to the Feed Helper's index of already downloaded episodes, sent
+/// along with each feed check.
+///
+/// The index is keyed by `Episode.identityKeys` (several per episode), and
+/// remembers when each episode was first seen. After a full snapshot, the app
+/// only sends what changed since the last revision the helper applied.
+struct SeenEpisodeUpdate {
+  /// Error code the helper replies with when it can't apply a delta, because it
+  /// doesn't have its base revision. The app should send a full snapshot instead.
+  static let outOfSyncErrorCode = -9
+  
+  /// Identifies the app session revisions belong to
+  var generation: String
+  
+  /// The revision this update applies on top of, or nil if this is a full snapshot
+  var baseRevision: Int?
+  
+  /// The revision of the index once this update is applied
+  var revision: Int
+  
+  /// Keys of episodes to add to the index, with their first-seen date
+  var added: [String:Date]
+  
+  /// Keys of episodes to remove from the index
+  var removed: [String]
+  
+  var isSnapshot: Bool {
+    return baseRevision == nil
+  }
+}
+
+
+// MARK: Serialization
+extension SeenEpisodeUpdate: Codable {}
@@ -16,6 +16,81 @@ extension URL {
     return scheme == "magnet"
   }
   
+  /// Identifies the episode a .torrent URL or magnet link points to, ignoring
+  /// differences that don't matter: magnet links are reduced to their info hash
+  /// (trackers and display names vary), other URLs lose their fragment and get
+  /// a lowercase scheme and host.
+  var episodeKey: String {
+    guard var components = URLComponents(url: self, resolvingAgainstBaseURL: false) else {
+      return absoluteString
+    }
+    
+    if isMagnetLink {
+      guard let infoHash = magnetInfoHash else { return absoluteString }
+      return URL.episodeKey(infoHash: infoHash.normalizedInfoHash ?? infoHash.lowercased())
+    }
+    
+    components.scheme = components.scheme?.lowercased()
+    components.host = components.host?.lowercased()
+    components.fragment = nil
+    return components.string ?? absoluteString
+  }
+  
+  /// Identifies the feed at this URL, ignoring differences that don't matter
+  /// when comparing subscriptions: the case of the scheme and host, default
+  /// ports, fragments and trailing slashes.
+  var feedKey: String {
+    guard var components = URLComponents(url: self, resolvingAgainstBaseURL: false) else {
+      return absoluteString
+    }
+    
+    components.scheme = components.scheme?.lowercased()
+    components.host = components.host?.lowercased()
+    components.fragment = nil
+    if let port = components.port, port == ["http": 80, "https": 443][components.scheme ?? ""] {
+      components.port = nil
+    }
+    while components.path.count > 1 && components.path.hasSuffix("/") {
+      components.path.removeLast()
+    }
+    if components.path == "/" {
+      components.path = ""
+    }
+    return components.string ?? absoluteString
+  }
+  
+  /// `episodeKey` of magnet links for the torrent with this info hash
+  static func episodeKey(infoHash: String) -> String {
+    return "urn:btih:" + infoHash
+  }
+  
+  /// The BitTorrent info hash this URL points to, as lowercase hex: the `btih`
+  /// exact topic of magnet links, or a hash that makes up a whole path
+  /// component of other URLs (trackers often name .torrent files after it).
+  var infoHash: String? {
+    if isMagnetLink {
+      return magnetInfoHash?.normalizedInfoHash
+    }
+    
+    return pathComponents.lazy
+      .map { ($0 as NSString).deletingPathExtension }
+      .first { $0.count == 40 && $0.normalizedInfoHash != nil }?
+      .lowercased()
+  }
+  
+  /// The raw `xt=urn:btih:` value of a magnet link
+  private var magnetInfoHash: String? {
+    guard let queryItems = URLComponents(url: self, resolvingAgainstBaseURL: false)?.queryItems else {
+      return nil
+    }
+    
+    return queryItems
+      .filter { $0.name == "xt" }
+      .compactMap { $0.value }
+      .first { $0.lowercased().hasPrefix("urn:btih:") }
+      .map { String($0.dropFirst("urn:btih:".count)) }
+  }
+  
   var isValidFeedURL: Bool {
     guard
       let scheme = scheme,
@@ -37,3 +112,34 @@ extension URL {
     return true
   }
 }
+
+
+private extension String {
+  /// Info hashes come as 40 hex digits, or (in older magnet links) 32 base32
+  /// characters. Returns lowercase hex, or nil if this is neither.
+  var normalizedInfoHash: String? {
+    let hexDigits = CharacterSet(charactersIn: "0123456789abcdefABCDEF")
+    if count == 40, unicodeScalars.allSatisfy(hexDigits.contains) {
+      return lowercased()
+    }
+    
+    guard count == 32 else { return nil }
+    
+    let alphabet = Array("ABCDEFGHIJKLMNOPQRSTUVWXYZ234567")
+    var bytes: [UInt8] = []
+    var buffer = 0
+    var bufferedBits = 0
+    for character in uppercased() {
+      guard let value = alphabet.firstIndex(of: character) else { return nil }
+      buffer = (buffer << 5) | value
+      bufferedBits += 5
+      if bufferedBits >= 8 {
+        bufferedBits -= 8
+        bytes.append(UInt8(truncatingIfNeeded: buffer >> bufferedBits))
+        buffer &= (1 << bufferedBits) - 1
+      }
+    }
+    
+    return bytes.map { String(format: "%02x", $0) }.joined()
+  }
+}
@@ -0,0 +1,45 @@
+import XCTest
+@testable import Catch
+
+
+private let items = SyntheticInputs.historyItems(count: 50_000)
+
+
+/// The dedupe/sort path behind `Defaults.downloadHistory`, with large histories
+class DownloadHistoryBenchmarks: XCTestCase {
+  func testInsertingOneLargeBatch() {
+    logThroughput(name, itemCount: items.count) {
+      var history = DownloadHistory()
+      history.insert(items, limit: 40_000)
+    }
+    
+    measureTimeAndMemory {
+      var history = DownloadHistory()
+      history.insert(items, limit: 40_000)
+    }
+  }
+  
+  /// Like feed checks do over time: a few new items at a time into a full history
+  func testInsertingSmallBatches() {
+    let batches = stride(from: 0, to: items.count, by: 10).map { Array(items[$0..<min($0 + 10, items.count)]) }
+    
+    measureTimeAndMemory {
+      var history = DownloadHistory()
+      for batch in batches {
+        history.insert(batch, limit: 4_000)
+      }
+    }
+  }
+  
+  func testMembership() {
+    var history = DownloadHistory()
+    history.insert(items, limit: items.count)
+    let episodes = items.map(\.episode)
+    
+    measure {
+      for episode in episodes {
+        _ = history.contains(episode)
+      }
+    }
+  }
+}
@@ -0,0 +1,71 @@
+import XCTest
+@testable import Catch
+
+
+private let feed = Feed(name: "Synthetic", url: URL(string: "synthetic://feeds/rss/1")!)
+
+
+/// Parsing throughput and memory for feeds from 10 to 50k items, in both modes
+class FeedParserBenchmarks: XCTestCase {
+  private func benchmarkParsing(_ feedContents: Data, itemCount: Int, mode: FeedParser.Mode) throws {
+    try logThroughput("\(name) (\(feedContents.count) bytes)", itemCount: itemCount) {
+      let episodes = try FeedParser.parse(feed: feed, feedContents: feedContents, mode: mode)
+      XCTAssertEqual(episodes.count, itemCount)
+    }
+    
+    measureTimeAndMemory {
+      _ = try! FeedParser.parse(feed: feed, feedContents: feedContents, mode: mode)
+    }
+  }
+  
+  func testStreamingSmallRSS() throws {
+    try benchmarkParsing(SyntheticInputs.rssFeed(itemCount: 10, usesTVNamespace: false), itemCount: 10, mode: .streaming)
+  }
+  
+  func testStreamingMediumRSSWithTVNamespace() throws {
+    try benchmarkParsing(SyntheticInputs.rssFeed(itemCount: 1_000, usesTVNamespace: true), itemCount: 1_000, mode: .streaming)
+  }
+  
+  func testStreamingLargeRSS() throws {
+    try benchmarkParsing(SyntheticInputs.rssFeed(itemCount: 50_000, usesTVNamespace: false), itemCount: 50_000, mode: .streaming)
+  }
+  
+  func testStreamingLargeRSSWithTVNamespace() throws {
+    try benchmarkParsing(SyntheticInputs.rssFeed(itemCount: 50_000, usesTVNamespace: true), itemCount: 50_000, mode: .streaming)
+  }
+  
+  func testStreamingLargeAtom() throws {
+    try benchmarkParsing(SyntheticInputs.atomFeed(itemCount: 50_000), itemCount: 50_000, mode: .streaming)
+  }
+  
+  func testDocumentSmallRSS() throws {
+    try benchmarkParsing(SyntheticInputs.rssFeed(itemCount: 10, usesTVNamespace: false), itemCount: 10, mode: .document)
+  }
+  
+  func testDocumentMediumRSSWithTVNamespace() throws {
+    try benchmarkParsing(SyntheticInputs.rssFeed(itemCount: 1_000, usesTVNamespace: true), itemCount: 1_000, mode: .document)
+  }
+  
+  func testDocumentLargeRSS() throws {
+    try benchmarkParsing(SyntheticInputs.rssFeed(itemCount: 50_000, usesTVNamespace: false), itemCount: 50_000, mode: .document)
+  }
+  
+  func testDocumentLargeAtom() throws {
+    try benchmarkParsing(SyntheticInputs.atomFeed(itemCount: 50_000), itemCount: 50_000, mode: .document)
+  }
+  
+  /// Download through an in-process stand-in for the tracker, then parse
+  func testFetchAndParseLargeRSS() throws {
+    let configuration = URLSessionConfiguration.ephemeral
+    configuration.protocolClasses = [SyntheticFeedURLProtocol.self]
+    let session = URLSession(configuration: configuration)
+    defer { session.invalidateAndCancel() }
+    
+    let url = URL(string: "synthetic://feeds/rss-tv/10000")!
+    
+    measureTimeAndMemory {
+      let (_, feedContents) = try! session.downloadSynchronously(url: url)
+      XCTAssertEqual(try! FeedParser.parse(feed: feed, feedContents: feedContents, mode: .streaming).count, 10_000)
+    }
+  }
+}
@@ -0,0 +1,33 @@
+import XCTest
+@testable import Catch
+
+
+/// Importing and exporting large OPML files
+class OPMLBenchmarks: XCTestCase {
+  private let feedCount = 10_000
+  
+  func testParsing() throws {
+    let opml = try SyntheticInputs.opml(feedCount: feedCount)
+    
+    try logThroughput("\(name) (\(opml.count) bytes)", itemCount: feedCount) {
+      let feeds = try OPMLParser().parse(opml: opml)
+      XCTAssertEqual(feeds.count, feedCount)
+    }
+    
+    measureTimeAndMemory {
+      _ = try! OPMLParser().parse(opml: opml)
+    }
+  }
+  
+  func testSerializing() throws {
+    let feeds = SyntheticInputs.feeds(count: feedCount)
+    
+    try logThroughput(name, itemCount: feedCount) {
+      _ = OPMLSerializer().serialize(feeds: feeds)
+    }
+    
+    measureTimeAndMemory {
+      _ = OPMLSerializer().serialize(feeds: feeds)
+    }
+  }
+}
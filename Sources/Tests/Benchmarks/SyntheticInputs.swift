@@ -0,0 +1,215 @@
+import XCTest
+@testable import Catch
+
+
+/// Generates large, realistic-looking inputs for benchmarks. Output only depends
+/// on the parameters, so results are comparable across runs.
+enum SyntheticInputs {
+  /// An RSS feed with `itemCount` items, newest first. With `usesTVNamespace`,
+  /// items look like ShowRSS ones (magnet links and `tv:` elements), otherwise
+  /// like a generic tracker's (.torrent enclosures).
+  static func rssFeed(itemCount: Int, usesTVNamespace: Bool) -> Data {
+    var xml = """
+      <?xml version="1.0" encoding="UTF-8"?>
+      <rss version="2.0"\(usesTVNamespace ? " xmlns:tv=\"https://showrss.info\"" : "")>
+        <channel>
+          <title>Synthetic feed</title>
+          <ttl>30</ttl>
+      
+      """
+    
+    for number in (0..<itemCount).reversed() {
+      let show = "Show \(number % 97)"
+      let title = "\(show) S\(number / 1000 + 1)E\(number % 1000) 720p"
+      let date = rfc822Date(number: number)
+      if usesTVNamespace {
+        xml += """
+              <item>
+                <title>\(title)</title>
+                <link>magnet:?xt=urn:btih:\(infoHash(number: number))&amp;dn=\(show.replacingOccurrences(of: " ", with: "+"))</link>
+                <pubDate>\(date)</pubDate>
+                <tv:show_id>\(number % 97)</tv:show_id>
+                <tv:show_name>\(show)</tv:show_name>
+                <tv:episode_id>\(number)</tv:episode_id>
+              </item>
+          
+          """
+      } else {
+        xml += """
+              <item>
+                <title>\(title)</title>
+                <link>https://tracker.example.com/details/\(number)</link>
+                <enclosure url="https://tracker.example.com/download/\(number).torrent" length="\(10_000 + number)" type="application/x-bittorrent"/>
+                <pubDate>\(date)</pubDate>
+                <description><![CDATA[Release notes for <b>\(title)</b>]]></description>
+              </item>
+          
+          """
+      }
+    }
+    
+    xml += """
+        </channel>
+      </rss>
+      """
+    return Data(xml.utf8)
+  }
+  
+  /// An Atom feed with `itemCount` entries, newest first
+  static func atomFeed(itemCount: Int) -> Data {
+    var xml = """
+      <?xml version="1.0" encoding="utf-8"?>
+      <feed xmlns="http://www.w3.org/2005/Atom">
+        <title>Synthetic feed</title>
+      
+      """
+    
+    for number in (0..<itemCount).reversed() {
+      xml += """
+          <entry>
+            <title>Show \(number % 97) S01E\(number) 1080p</title>
+            <link rel="alternate" href="https://tracker.example.com/details/\(number)"/>
+            <link rel="enclosure" href="https://tracker.example.com/download/\(number).torrent"/>
+            <updated>\(iso8601Date(number: number))</updated>
+          </entry>
+        
+        """
+    }
+    
+    xml += "</feed>"
+    return Data(xml.utf8)
+  }
+  
+  /// `count` history items, in random (but repeatable) download order, with
+  /// roughly one in ten being a duplicate of an earlier one
+  static func historyItems(count: Int) -> [HistoryItem] {
+    var generator = RepeatableRandomNumberGenerator()
+    let feeds = self.feeds(count: 20)
+    return (0..<count).map { index in
+      let number = index % 10 == 9 ? Int.random(in: 0..<max(1, index), using: &generator) : index
+      return HistoryItem(
+        episode: Episode(
+          title: "Show \(number % 97) S01E\(number)",
+          url: URL(string: "https://tracker.example.com/download/\(number).torrent")!,
+          showName: "Show \(number % 97)",
+          feed: feeds[number % feeds.count]
+        ),
+        downloadDate: Date(timeIntervalSince1970: 1_500_000_000 + TimeInterval(Int.random(in: 0..<count, using: &generator)) * 600)
+      )
+    }
+  }
+  
+  static func feeds(count: Int) -> [Feed] {
+    return (0..<count).map { number in
+      Feed(
+        name: "Feed \(number)",
+        url: URL(string: "https://tracker.example.com/rss/\(number)?user=1234&passkey=0123456789abcdef")!
+      )
+    }
+  }
+  
+  static func opml(feedCount: Int) throws -> Data {
+    return OPMLSerializer().serialize(feeds: feeds(count: feedCount))
+  }
+  
+  private static func infoHash(number: Int) -> String {
+    let hex = String(number, radix: 16, uppercase: true)
+    return String(repeating: "0", count: 40 - hex.count) + hex
+  }
+  
+  private static let referenceDate = Date(timeIntervalSince1970: 1_500_000_000)
+  
+  private static let rfc822Formatter: DateFormatter = {
+    let formatter = DateFormatter()
+    formatter.locale = Locale(identifier: "en_US_POSIX")
+    formatter.timeZone = TimeZone(identifier: "GMT")
+    formatter.dateFormat = "EEE, dd MMM yyyy HH:mm:ss Z"
+    return formatter
+  }()
+  
+  private static func rfc822Date(number: Int) -> String {
+    return rfc822Formatter.string(from: referenceDate.addingTimeInterval(TimeInterval(number) * 3600))
+  }
+  
+  private static func iso8601Date(number: Int) -> String {
+    return ISO8601DateFormatter().string(from: referenceDate.addingTimeInterval(TimeInterval(number) * 3600))
+  }
+}
+
+
+/// Linear congruential generator, so that "random" inputs are the same every run
+struct RepeatableRandomNumberGenerator: RandomNumberGenerator {
+  private var state: UInt64 = 0x2545F4914F6CDD1D
+  
+  mutating func next() -> UInt64 {
+    state = state &* 6364136223846793005 &+ 1442695040888963407
+    return state
+  }
+}
+
+
+/// Serves synthetic feeds to URL sessions that list it in their configuration's
+/// `protocolClasses`, standing in for a tracker without leaving the process.
+///
+/// URLs look like `synthetic://feeds/rss/1000`, `synthetic://feeds/rss-tv/1000`
+/// or `synthetic://feeds/atom/1000`, where the last component is the item count.
+final class SyntheticFeedURLProtocol: URLProtocol {
+  static let scheme = "synthetic"
+  
+  override class func canInit(with request: URLRequest) -> Bool {
+    return request.url?.scheme == scheme
+  }
+  
+  override class func canonicalRequest(for request: URLRequest) -> URLRequest {
+    return request
+  }
+  
+  override func startLoading() {
+    let url = request.url!
+    let itemCount = Int(url.lastPathComponent) ?? 0
+    
+    let feedContents: Data
+    switch url.deletingLastPathComponent().lastPathComponent {
+    case "rss-tv": feedContents = SyntheticInputs.rssFeed(itemCount: itemCount, usesTVNamespace: true)
+    case "atom": feedContents = SyntheticInputs.atomFeed(itemCount: itemCount)
+    default: feedContents = SyntheticInputs.rssFeed(itemCount: itemCount, usesTVNamespace: false)
+    }
+    
+    let response = HTTPURLResponse(
+      url: url,
+      statusCode: 200,
+      httpVersion: "HTTP/1.1",
+      headerFields: ["Content-Type": "application/rss+xml", "Content-Length": "\(feedContents.count)"]
+    )!
+    client?.urlProtocol(self, didReceive: response, cacheStoragePolicy: .notAllowed)
+    client?.urlProtocol(self, didLoad: feedContents)
+    client?.urlProtocolDidFinishLoading(self)
+  }
+  
+  override func stopLoading() {}
+}
+
+
+extension XCTestCase {
+  /// Measures wall clock time, and peak memory where XCTest supports it
+  func measureTimeAndMemory(_ block: () -> Void) {
+    if #available(macOS 10.15, *) {
+      measure(metrics: [XCTClockMetric(), XCTMemoryMetric()], block: block)
+    } else {
+      measure(block)
+    }
+  }
+  
+  /// Reports how many items per second `block` processes, in a single run,
+  /// as an attachment to the test's results
+  func logThroughput(_ name: String, itemCount: Int, _ block: () throws -> Void) rethrows {
+    let start = Date()
+    try block()
+    let duration = Date().timeIntervalSince(start)
+    
+    let attachment = XCTAttachment(string: "\(itemCount) items in \(String(format: "%.3f", duration))s, \(Int(Double(itemCount) / duration)) items/s")
+    attachment.name = "Throughput of \(name)"
+    attachment.lifetime = .keepAlways
+    add(attachment)
+  }
+}
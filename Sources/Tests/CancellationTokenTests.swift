@@ -0,0 +1,51 @@
+import XCTest
+@testable import Catch
+
+
+class CancellationTokenTests: XCTestCase {
+  func testHandlersAreCalledOnce() {
+    let cancellation = CancellationToken()
+    var callCount = 0
+    
+    cancellation.performCancellable({
+      cancellation.cancel()
+      cancellation.cancel()
+    }, onCancel: { callCount += 1 })
+    
+    XCTAssertTrue(cancellation.isCancelled)
+    XCTAssertEqual(callCount, 1)
+  }
+  
+  func testHandlersAreCalledRightAwayIfAlreadyCancelled() {
+    let cancellation = CancellationToken()
+    cancellation.cancel()
+    
+    var wasCalled = false
+    let result = cancellation.performCancellable({ wasCalled }, onCancel: { wasCalled = true })
+    
+    XCTAssertTrue(result)
+  }
+  
+  func testHandlersAreRemovedAfterWork() {
+    let cancellation = CancellationToken()
+    var wasCalled = false
+    
+    cancellation.performCancellable({}, onCancel: { wasCalled = true })
+    cancellation.cancel()
+    
+    XCTAssertFalse(wasCalled)
+  }
+  
+  func testSleepEndsWhenCancelled() {
+    let cancellation = CancellationToken()
+    DispatchQueue.global().asyncAfter(deadline: .now() + 0.1) {
+      cancellation.cancel()
+    }
+    
+    let (_, duration) = FeedMetrics.measure {
+      cancellation.sleep(forTimeInterval: 60)
+    }
+    
+    XCTAssertLessThan(duration, 10)
+  }
+}
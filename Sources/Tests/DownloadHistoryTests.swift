@@ -0,0 +1,88 @@
+import XCTest
+@testable import Catch
+
+
+private func historyItem(_ name: String, date: TimeInterval?) -> HistoryItem {
+  return HistoryItem(
+    episode: Episode(title: name, url: URL(string: "https://example.com/\(name).torrent")!, showName: nil, feed: nil),
+    downloadDate: date.map(Date.init(timeIntervalSince1970:))
+  )
+}
+
+
+class DownloadHistoryTests: XCTestCase {
+  func testItemsAreSortedNewestFirst() {
+    var history = DownloadHistory()
+    history.insert([historyItem("b", date: 2), historyItem("d", date: 4)], limit: 10)
+    history.insert([historyItem("a", date: 1), historyItem("e", date: 5), historyItem("c", date: 3), historyItem("undated", date: nil)], limit: 10)
+    
+    XCTAssertEqual(history.map(\.episode.title), ["e", "d", "c", "b", "a", "undated"])
+  }
+  
+  func testDuplicateEpisodesAreIgnored() {
+    var history = DownloadHistory()
+    history.insert([historyItem("a", date: 1)], limit: 10)
+    let (inserted, _) = history.insert([historyItem("a", date: 2), historyItem("b", date: 3), historyItem("b", date: 4)], limit: 10)
+    
+    XCTAssertEqual(inserted, [historyItem("b", date: 3)])
+    XCTAssertEqual(history.map(\.episode.title), ["b", "a"])
+    XCTAssertEqual(history.first?.downloadDate, Date(timeIntervalSince1970: 3))
+  }
+  
+  func testOldestItemsAreEvicted() {
+    var history = DownloadHistory()
+    history.insert([historyItem("a", date: 1), historyItem("b", date: 2)], limit: 3)
+    let (_, evicted) = history.insert([historyItem("c", date: 3), historyItem("d", date: 4)], limit: 3)
+    
+    XCTAssertEqual(evicted, [historyItem("a", date: 1)])
+    XCTAssertEqual(history.map(\.episode.title), ["d", "c", "b"])
+    XCTAssertFalse(history.contains(historyItem("a", date: 1).episode))
+    
+    // Evicted episodes can come back
+    history.insert([historyItem("a", date: 5)], limit: 3)
+    XCTAssertEqual(history.map(\.episode.title), ["a", "d", "c"])
+  }
+  
+  func testRemoval() {
+    var history = DownloadHistory()
+    history.insert([historyItem("a", date: 1), historyItem("b", date: 2)], limit: 10)
+    
+    XCTAssertEqual(history.remove(historyItem("a", date: 1).episode), historyItem("a", date: 1))
+    XCTAssertNil(history.remove(historyItem("a", date: 1).episode))
+    XCTAssertEqual(history.map(\.episode.title), ["b"])
+  }
+  
+  func testPositions() {
+    var history = DownloadHistory()
+    let items = [
+      historyItem("undated", date: nil),
+      historyItem("a", date: 1),
+      historyItem("b", date: 2),
+      historyItem("b2", date: 2),
+      historyItem("c", date: 3)
+    ]
+    history.insert(items, limit: 10)
+    
+    for item in items {
+      XCTAssertEqual(history.position(of: item).map { history[$0] }, item)
+    }
+    XCTAssertNil(history.position(of: historyItem("missing", date: 2)))
+  }
+  
+  func testSearchIndex() {
+    let feed = Feed(name: "My Feed", url: URL(string: "https://example.com/feed.xml")!)
+    let showItem = HistoryItem(
+      episode: Episode(title: "Café Show S01E02 720p", url: URL(string: "https://example.com/1.torrent")!, showName: nil, feed: feed),
+      downloadDate: nil
+    )
+    let otherItem = historyItem("Other S01E01", date: 1)
+    
+    var index = HistorySearchIndex([showItem, otherItem])
+    XCTAssertEqual(index.episodes(matching: "cafe"), [showItem.episode])
+    XCTAssertEqual(index.episodes(matching: "MY FEED"), [showItem.episode])
+    XCTAssertEqual(index.episodes(matching: "showrss"), [otherItem.episode])
+    
+    index.remove([showItem])
+    XCTAssertEqual(index.episodes(matching: "cafe"), [])
+  }
+}
@@ -0,0 +1,128 @@
+import XCTest
+@testable import Catch
+
+
+class DownloadScriptExecutorTests: XCTestCase {
+  private var directoryURL: URL!
+  private var scriptURL: URL!
+  private var logURL: URL!
+  
+  override func setUp() {
+    super.setUp()
+    directoryURL = FileManager.default.temporaryDirectory.appendingPathComponent(UUID().uuidString)
+    scriptURL = directoryURL.appendingPathComponent("script.sh")
+    logURL = directoryURL.appendingPathComponent("script.log")
+    try! FileManager.default.createDirectory(at: directoryURL, withIntermediateDirectories: true)
+  }
+  
+  override func tearDown() {
+    try? FileManager.default.removeItem(at: directoryURL)
+    super.tearDown()
+  }
+  
+  /// Writes a script that logs when it starts and ends, and fails for URLs containing "fail"
+  private func makeScript(duration: TimeInterval) throws {
+    let script = """
+      #!/bin/sh
+      echo "start $#" >> "\(logURL.path)"
+      sleep \(duration)
+      echo "end" >> "\(logURL.path)"
+      case "$*" in *fail*) exit 1;; esac
+      exit 0
+      """
+    try script.write(to: scriptURL, atomically: true, encoding: .utf8)
+    try FileManager.default.setAttributes([.posixPermissions: 0o755], ofItemAtPath: scriptURL.path)
+  }
+  
+  private var logLines: [String] {
+    return ((try? String(contentsOf: logURL)) ?? "").split(separator: "\n").map(String.init)
+  }
+  
+  private func urls(_ names: String...) -> [URL] {
+    return names.map { URL(string: "https://example.com/\($0).torrent")! }
+  }
+  
+  func testConcurrentRunsAreBounded() throws {
+    try makeScript(duration: 0.2)
+    let executor = DownloadScriptExecutor()
+    executor.options.maxConcurrentRuns = 2
+    
+    let done = expectation(description: "done")
+    var reportCount = 0
+    executor.enqueue(urls("1", "2", "3", "4", "5"), scriptURL: scriptURL) { results in
+      reportCount += 1
+      XCTAssertEqual(results.count, 5)
+      XCTAssertTrue(results.values.allSatisfy { $0 })
+      done.fulfill()
+    }
+    wait(for: [done], timeout: 10)
+    
+    var running = 0
+    var maxRunning = 0
+    for line in logLines {
+      running += line.hasPrefix("start") ? 1 : -1
+      maxRunning = max(maxRunning, running)
+    }
+    XCTAssertEqual(maxRunning, 2)
+    XCTAssertEqual(reportCount, 1)
+  }
+  
+  func testBatchesShareRuns() throws {
+    try makeScript(duration: 0)
+    let executor = DownloadScriptExecutor()
+    executor.options.batchSize = 2
+    
+    let done = expectation(description: "done")
+    executor.enqueue(urls("1", "2", "fail", "4", "5"), scriptURL: scriptURL) { results in
+      XCTAssertEqual(results, [
+        self.urls("1")[0]: true,
+        self.urls("2")[0]: true,
+        self.urls("fail")[0]: false,
+        self.urls("4")[0]: false,
+        self.urls("5")[0]: true
+      ])
+      done.fulfill()
+    }
+    wait(for: [done], timeout: 10)
+    
+    XCTAssertEqual(logLines.filter { $0.hasPrefix("start") }.sorted(), ["start 1", "start 2", "start 2"])
+  }
+  
+  func testStuckRunsTimeOut() throws {
+    try makeScript(duration: 30)
+    let executor = DownloadScriptExecutor()
+    executor.options.timeout = 0.2
+    
+    let done = expectation(description: "done")
+    executor.enqueue(urls("1"), scriptURL: scriptURL) { results in
+      XCTAssertEqual(results, [self.urls("1")[0]: false])
+      done.fulfill()
+    }
+    wait(for: [done], timeout: 10)
+  }
+  
+  func testQueuedRunsWaitWhilePaused() throws {
+    try makeScript(duration: 0)
+    let executor = DownloadScriptExecutor()
+    executor.isPaused = true
+    
+    var results: [URL:Bool]? = nil
+    executor.enqueue(urls("1"), scriptURL: scriptURL) { results = $0 }
+    
+    RunLoop.main.run(until: Date().addingTimeInterval(0.3))
+    XCTAssertNil(results)
+    XCTAssertTrue(logLines.isEmpty)
+    
+    let done = expectation(description: "done")
+    executor.enqueue(urls("2"), scriptURL: scriptURL, ignoringPause: true) { _ in done.fulfill() }
+    wait(for: [done], timeout: 10)
+    XCTAssertNil(results)
+    
+    executor.isPaused = false
+    let deadline = Date().addingTimeInterval(10)
+    while results == nil && Date() < deadline {
+      RunLoop.main.run(until: Date().addingTimeInterval(0.05))
+    }
+    XCTAssertEqual(results, [urls("1")[0]: true])
+  }
+}
@@ -0,0 +1,55 @@
+import XCTest
+@testable import Catch
+
+
+class EpisodeClaimsTests: XCTestCase {
+  private let keys = ["url:https://example.com/episode.torrent", "title:show s01e01"]
+  private let otherCopyKeys = ["url:https://mirror.example.com/episode.torrent", "title:show s01e01"]
+  
+  func testSeenEpisodesCantBeClaimed() {
+    let claims = EpisodeClaims(isSeen: { $0 == "title:show s01e01" })
+    
+    XCTAssertEqual(claims.claim(keys), .seen)
+  }
+  
+  func testCopiesOfClaimedEpisodesAreDuplicates() {
+    let claims = EpisodeClaims(isSeen: { _ in false })
+    
+    XCTAssertEqual(claims.claim(keys), .claimed)
+    XCTAssertEqual(claims.claim(otherCopyKeys), .duplicate)
+    XCTAssertEqual(claims.state(ofClaimOn: otherCopyKeys, waiting: false), .pending)
+  }
+  
+  func testFulfilledClaimsAreNotTakenOver() {
+    let claims = EpisodeClaims(isSeen: { _ in false })
+    
+    XCTAssertEqual(claims.claim(keys), .claimed)
+    XCTAssertEqual(claims.claim(otherCopyKeys), .duplicate)
+    claims.fulfill(keys)
+    
+    XCTAssertEqual(claims.state(ofClaimOn: otherCopyKeys, waiting: true), .fulfilled)
+    XCTAssertEqual(claims.claim(otherCopyKeys), .duplicate)
+  }
+  
+  func testCopyInAnotherFeedIsDownloadedWhenTheFirstOneFails() {
+    let claims = EpisodeClaims(isSeen: { _ in false })
+    
+    // The first feed claims the episode, the second one finds its copy claimed
+    XCTAssertEqual(claims.claim(keys), .claimed)
+    XCTAssertEqual(claims.claim(otherCopyKeys), .duplicate)
+    
+    // The first feed's download fails while the second feed is waiting for it
+    let firstFeedDownload = expectation(description: "first feed download")
+    DispatchQueue.global().asyncAfter(deadline: .now() + 0.1) {
+      claims.release(self.keys)
+      firstFeedDownload.fulfill()
+    }
+    
+    XCTAssertEqual(claims.state(ofClaimOn: otherCopyKeys, waiting: true), .released)
+    wait(for: [firstFeedDownload], timeout: 1)
+    
+    // So the second feed gets to download its copy
+    XCTAssertEqual(claims.claim(otherCopyKeys), .claimed)
+    XCTAssertEqual(claims.claim(keys), .duplicate)
+  }
+}
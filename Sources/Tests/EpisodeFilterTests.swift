@@ -0,0 +1,141 @@
+import XCTest
+@testable import Catch
+
+
+private let testFeed = Feed(name: "Test", url: URL(string: "https://example.com/feed.xml")!)
+
+
+private let feedContents = """
+  <?xml version="1.0" encoding="UTF-8"?>
+  <rss version="2.0" xmlns:tv="https://showrss.info" xmlns:torrent="http://xmlns.ezrss.it/0.1/">
+    <channel>
+      <item>
+        <title>Show A S01E01 720p</title>
+        <tv:show_name>Show A</tv:show_name>
+        <enclosure url="https://example.com/a/1.torrent" length="700000000" type="application/x-bittorrent"/>
+      </item>
+      <item>
+        <title>Show A S01E01 1080p</title>
+        <tv:show_name>Show A</tv:show_name>
+        <enclosure url="https://example.com/a/1-hd.torrent" length="0" type="application/x-bittorrent"/>
+        <torrent:contentLength>2500000000</torrent:contentLength>
+      </item>
+      <item>
+        <title>Show B S02E03 720p</title>
+        <tv:show_name>Show B</tv:show_name>
+        <enclosure url="https://example.com/b/3.torrent" length="0" type="application/x-bittorrent"/>
+      </item>
+      <item>
+        <title>Show B S02E04 720p x265</title>
+        <tv:show_name>Show B</tv:show_name>
+        <link>magnet:?xt=urn:btih:0123456789ABCDEF0123456789ABCDEF01234567</link>
+      </item>
+    </channel>
+  </rss>
+  """.data(using: .utf8)!
+
+
+class EpisodeFilterTests: XCTestCase {
+  private func titles(passing filter: EpisodeFilter, mode: FeedParser.Mode = .streaming) throws -> [String] {
+    let compiledFilter = try CompiledEpisodeFilter(filter)
+    return try FeedParser.parse(feed: testFeed, feedContents: feedContents, mode: mode, filter: compiledFilter).map(\.title)
+  }
+  
+  func testEmptyFilterAcceptsEverything() throws {
+    XCTAssertEqual(try titles(passing: EpisodeFilter()).count, 4)
+  }
+  
+  func testIncludesAreAlternatives() throws {
+    let filter = EpisodeFilter(includes: [.substring("show a", in: .showName), .regex("x26[45]")])
+    
+    XCTAssertEqual(try titles(passing: filter), [
+      "Show A S01E01 720p",
+      "Show A S01E01 1080p",
+      "Show B S02E04 720p x265"
+    ])
+  }
+  
+  func testExcludesWinOverIncludes() throws {
+    let filter = EpisodeFilter(includes: [.substring("720p")], excludes: [.regex("^magnet:", in: .url)])
+    
+    XCTAssertEqual(try titles(passing: filter), ["Show A S01E01 720p", "Show B S02E03 720p"])
+  }
+  
+  func testSizeRange() throws {
+    // Zero lengths are unknown sizes, and unknown sizes never match
+    let filter = EpisodeFilter(includes: [.size(min: 1_000_000_000)])
+    let excludingFilter = EpisodeFilter(excludes: [.size(max: 1_000_000_000)])
+    
+    for mode in [FeedParser.Mode.document, .streaming] {
+      XCTAssertEqual(try titles(passing: filter, mode: mode), ["Show A S01E01 1080p"])
+      XCTAssertEqual(try titles(passing: excludingFilter, mode: mode), [
+        "Show A S01E01 1080p",
+        "Show B S02E03 720p",
+        "Show B S02E04 720p x265"
+      ])
+    }
+  }
+  
+  func testInvalidRegexThrows() {
+    XCTAssertThrowsError(try CompiledEpisodeFilter(EpisodeFilter(includes: [.regex("(unclosed")])))
+  }
+  
+  func testFilterIsPersistedWithFeed() throws {
+    var feed = testFeed
+    feed.filter = EpisodeFilter(includes: [.regex("1080p"), .size(min: 1, max: 2)], excludes: [.substring("Show B", in: .showName)])
+    
+    XCTAssertEqual(Feed(dictionary: feed.dictionaryRepresentation), feed)
+    XCTAssertNil(testFeed.dictionaryRepresentation["filter"])
+    
+    let payload = try FeedHelperPayload.encode([feed, testFeed])
+    XCTAssertEqual(try FeedHelperPayload.decode([Feed].self, from: payload), [feed, testFeed])
+  }
+  
+  func testEditingTitleSubstringsKeepsOtherRules() {
+    var filter = EpisodeFilter(
+      includes: [.substring("720p"), .regex("1080p"), .substring("Show A", in: .showName)],
+      excludes: [.size(max: 100)]
+    )
+    XCTAssertEqual(filter.includedTitleSubstrings, ["720p"])
+    XCTAssertEqual(filter.excludedTitleSubstrings, [])
+    
+    filter.includedTitleSubstrings = ["x265", "HDR"]
+    filter.excludedTitleSubstrings = ["CAM"]
+    
+    XCTAssertEqual(filter.includes, [.regex("1080p"), .substring("Show A", in: .showName), .substring("x265"), .substring("HDR")])
+    XCTAssertEqual(filter.excludes, [.size(max: 100), .substring("CAM")])
+  }
+  
+  func testCanonicalStringIsStable() {
+    let filter = EpisodeFilter(includes: [.regex("1080p"), .size(min: 1)], excludes: [.substring("Show B", in: .showName)])
+    
+    XCTAssertEqual(filter.canonicalString, """
+      include regex title - - 5:1080p
+      include sizeRange title 1 - 0:
+      exclude substring showName - - 6:Show B
+      """)
+    XCTAssertEqual(EpisodeFilter().canonicalString, "")
+  }
+  
+  func testCanonicalStringTellsFiltersApart() {
+    let oneRule = EpisodeFilter(includes: [.substring("a\ninclude substring title - - 1:b")])
+    let twoRules = EpisodeFilter(includes: [.substring("a"), .substring("b")])
+    
+    XCTAssertNotEqual(oneRule.canonicalString, twoRules.canonicalString)
+    XCTAssertNotEqual(
+      EpisodeFilter(includes: [.substring("a")]).canonicalString,
+      EpisodeFilter(excludes: [.substring("a")]).canonicalString
+    )
+  }
+  
+  func testEditingFilterKeepsFeedID() {
+    var editedFeed = testFeed
+    editedFeed.name = "Renamed"
+    editedFeed.filter = EpisodeFilter(includes: [.regex("1080p")])
+    editedFeed.folder = ["TV"]
+    
+    XCTAssertNotEqual(editedFeed, testFeed)
+    XCTAssertEqual(editedFeed.id, testFeed.id)
+    XCTAssertEqual([testFeed, editedFeed].removingDuplicates { $0.id }, [testFeed])
+  }
+}
@@ -0,0 +1,52 @@
+import XCTest
+@testable import Catch
+
+
+private func episode(_ title: String, url: String = "https://example.com/1.torrent", showName: String? = nil) -> Episode {
+  return Episode(title: title, url: URL(string: url)!, showName: showName, feed: nil)
+}
+
+
+class EpisodeIdentityTests: XCTestCase {
+  func testMagnetInfoHashesAreNormalized() {
+    let hex = URL(string: "magnet:?xt=urn:btih:0123456789ABCDEF0123456789ABCDEF01234567&tr=udp%3A%2F%2Fone.example.com")!
+    let base32 = URL(string: "magnet:?tr=udp%3A%2F%2Ftwo.example.com&xt=urn:btih:AERUKZ4JVPG66AJDIVTYTK6N54ASGRLH")!
+    
+    XCTAssertEqual(hex.infoHash, "0123456789abcdef0123456789abcdef01234567")
+    XCTAssertEqual(base32.infoHash, hex.infoHash)
+    XCTAssertEqual(base32.episodeKey, hex.episodeKey)
+  }
+  
+  func testTorrentURLInfoHash() {
+    XCTAssertEqual(
+      URL(string: "https://tracker.example.com/torrent/0123456789ABCDEF0123456789ABCDEF01234567.torrent")!.infoHash,
+      "0123456789abcdef0123456789abcdef01234567"
+    )
+    XCTAssertNil(URL(string: "https://tracker.example.com/torrent/12345.torrent")!.infoHash)
+  }
+  
+  func testNumbering() {
+    XCTAssertEqual(episode("Show B 3x04 Episode Title").numbering?.season, 3)
+    XCTAssertEqual(episode("Show B 3x04 Episode Title").numbering?.episode, 4)
+    XCTAssertEqual(episode("Show.Name.S01E02.720p.HDTV.x264").numbering?.showName, "Show.Name.")
+    XCTAssertEqual(episode("Show.Name.S01E02.720p.HDTV.x264").numbering?.episode, 2)
+    XCTAssertNil(episode("Show Name 2021 1080p").numbering)
+  }
+  
+  func testSameEpisodeInOtherQualitiesAndFeeds() {
+    let keys = Set(episode("Show C & Friends S02E10 720p", url: "https://one.example.com/1.torrent").identityKeys)
+    let otherKeys = Set(episode("Friends 2x10 1080p", url: "magnet:?xt=urn:btih:89abcdef", showName: "Show C & Friends").identityKeys)
+    let otherEpisodeKeys = Set(episode("Show C & Friends S02E11 720p", url: "https://one.example.com/2.torrent").identityKeys)
+    
+    XCTAssertFalse(keys.isDisjoint(with: otherKeys))
+    XCTAssertTrue(keys.isDisjoint(with: otherEpisodeKeys))
+  }
+  
+  func testTorrentFileInfoHash() {
+    let torrent = "d8:announce3:foo4:infod4:name3:bar12:piece lengthi16384eee".data(using: .utf8)!
+    
+    XCTAssertEqual(TorrentFile.infoHash(of: torrent), "c871eac3fafb33ef38879ecd2f892012aac6a90d")
+    XCTAssertNil(TorrentFile.infoHash(of: "<html>Not found</html>".data(using: .utf8)!))
+    XCTAssertNil(TorrentFile.infoHash(of: "d8:announce3:foo4:infod4:name".data(using: .utf8)!))
+  }
+}
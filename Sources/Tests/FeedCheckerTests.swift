@@ -0,0 +1,145 @@
+import XCTest
+@testable import Catch
+
+
+/// Reports the same episodes for every check, one at a time, then in the final report
+private final class FakeFeedHelper: FeedCheckService {
+  weak var delegate: FeedHelperProxyDelegate? = nil
+  var downloadedEpisodes: [DownloadedEpisode] = []
+  var didCompleteCheck: () -> Void = {}
+  
+  func checkFeeds(
+    feeds: [Feed],
+    options: FeedCheckOptions,
+    downloadOptions: DownloadOptions,
+    seenEpisodeUpdate: SeenEpisodeUpdate,
+    didDownloadEpisode: @escaping (DownloadedEpisode) -> Void,
+    didFinishFeed: @escaping (Feed, FeedCheckReport) -> Void,
+    completion: @escaping (Result<FeedCheckReport, Error>) -> Void) {
+    DispatchQueue.main.async {
+      self.downloadedEpisodes.forEach(didDownloadEpisode)
+      
+      var report = FeedCheckReport()
+      report.downloadedEpisodes = self.downloadedEpisodes
+      completion(.success(report))
+      
+      self.didCompleteCheck()
+    }
+  }
+  
+  func cancelChecks() {}
+}
+
+
+class FeedCheckerTests: XCTestCase {
+  private let feed = Feed(name: "Test", url: URL(string: "https://example.com/feed.xml")!)
+  
+  private var directoryURL: URL!
+  private var scriptURL: URL!
+  private var logURL: URL!
+  private var suiteName: String!
+  private var feedHelper: FakeFeedHelper!
+  private var feedChecker: FeedChecker!
+  
+  override func setUp() {
+    super.setUp()
+    directoryURL = FileManager.default.temporaryDirectory.appendingPathComponent(UUID().uuidString)
+    scriptURL = directoryURL.appendingPathComponent("script.sh")
+    logURL = directoryURL.appendingPathComponent("script.log")
+    try! FileManager.default.createDirectory(at: directoryURL, withIntermediateDirectories: true)
+    
+    // Logs how many URLs each run gets, and fails for URLs containing "fail"
+    let script = """
+      #!/bin/sh
+      echo "start $#" >> "\(logURL.path)"
+      case "$*" in *fail*) exit 1;; esac
+      exit 0
+      """
+    try! script.write(to: scriptURL, atomically: true, encoding: .utf8)
+    try! FileManager.default.setAttributes([.posixPermissions: 0o755], ofItemAtPath: scriptURL.path)
+    
+    // Keep the app's own preferences and history out of it
+    suiteName = "FeedCheckerTests.\(UUID().uuidString)"
+    let userDefaults = UserDefaults(suiteName: suiteName)!
+    userDefaults.set(true, forKey: "openAutomatically")
+    userDefaults.set(true, forKey: "downloadScriptEnabled")
+    userDefaults.set(scriptURL.path, forKey: "downloadScriptPath")
+    userDefaults.set(10, forKey: "downloadScriptBatchSize")
+    let defaults = Defaults(
+      userDefaults: userDefaults,
+      historyStore: HistoryStore(fileURL: directoryURL.appendingPathComponent("History.log"))
+    )
+    defaults.feeds = [feed]
+    
+    feedHelper = FakeFeedHelper()
+    feedChecker = FeedChecker(
+      feedHelperProxy: feedHelper,
+      scriptExecutor: DownloadScriptExecutor(),
+      defaults: defaults,
+      checksPeriodically: false
+    )
+  }
+  
+  override func tearDown() {
+    feedChecker = nil
+    UserDefaults.standard.removePersistentDomain(forName: suiteName)
+    try? FileManager.default.removeItem(at: directoryURL)
+    super.tearDown()
+  }
+  
+  private var scriptRuns: [String] {
+    return ((try? String(contentsOf: logURL)) ?? "").split(separator: "\n").map(String.init)
+  }
+  
+  private func episodes(_ names: String...) -> [DownloadedEpisode] {
+    return names.map {
+      DownloadedEpisode(episode: Episode(title: $0, url: URL(string: "https://example.com/\($0).torrent")!, showName: nil, feed: feed), localURL: nil)
+    }
+  }
+  
+  /// Runs a check, and waits until the download script ran `scriptRunCount` times in total
+  private func check(expectingScriptRuns scriptRunCount: Int) {
+    let done = expectation(description: "check done")
+    feedHelper.didCompleteCheck = { done.fulfill() }
+    feedChecker.checkFeeds([feed], downloadOptions: DownloadOptions(
+      containerDirectory: directoryURL,
+      shouldOrganizeByShow: false,
+      shouldSaveMagnetLinks: false,
+      shouldSaveTorrentFiles: false
+    ))
+    wait(for: [done], timeout: 10)
+    
+    let deadline = Date().addingTimeInterval(10)
+    while scriptRuns.count < scriptRunCount && Date() < deadline {
+      RunLoop.main.run(until: Date().addingTimeInterval(0.05))
+    }
+    
+    // Let the results of the runs come back
+    RunLoop.main.run(until: Date().addingTimeInterval(0.3))
+    XCTAssertEqual(scriptRuns.count, scriptRunCount)
+  }
+  
+  func testEpisodesOfACheckShareScriptRuns() {
+    feedHelper.downloadedEpisodes = episodes("fail-1", "fail-2", "fail-3")
+    
+    check(expectingScriptRuns: 1)
+    
+    XCTAssertEqual(scriptRuns, ["start 3"])
+  }
+  
+  func testFailedEpisodesAreRetriedWithTheNextChecks() {
+    feedHelper.downloadedEpisodes = episodes("fail-1", "fail-2")
+    check(expectingScriptRuns: 1)
+    
+    // The helper won't report them again
+    feedHelper.downloadedEpisodes = episodes("fail-3")
+    check(expectingScriptRuns: 2)
+    
+    feedHelper.downloadedEpisodes = []
+    check(expectingScriptRuns: 3)
+    check(expectingScriptRuns: 4)
+    
+    // Each episode gets 3 runs
+    XCTAssertEqual(scriptRuns, ["start 2", "start 3", "start 3", "start 1"])
+  }
+}
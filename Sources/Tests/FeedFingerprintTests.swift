@@ -0,0 +1,49 @@
+import XCTest
+@testable import Catch
+
+
+class FeedFingerprintTests: XCTestCase {
+  func testKnownValues() {
+    // Reference values for 64-bit FNV-1a
+    var fingerprint = FeedFingerprint()
+    fingerprint.combine(Data("a".utf8))
+    XCTAssertEqual(fingerprint.value, 0xaf63dc4c8601ec8c)
+    
+    fingerprint = FeedFingerprint()
+    fingerprint.combine(Data("foobar".utf8))
+    XCTAssertEqual(fingerprint.value, 0x85944171f73967e8)
+    XCTAssertEqual(fingerprint.stringValue, "85944171f73967e8")
+  }
+  
+  func testStringsAreSeparated() {
+    var first = FeedFingerprint()
+    first.combine("ab")
+    first.combine("c")
+    
+    var second = FeedFingerprint()
+    second.combine("a")
+    second.combine("bc")
+    
+    XCTAssertNotEqual(first, second)
+  }
+  
+  func testSeedChangesFingerprint() {
+    var first = FeedFingerprint(seed: "filter 1")
+    first.combine(Data("<rss/>".utf8))
+    
+    var second = FeedFingerprint(seed: "filter 2")
+    second.combine(Data("<rss/>".utf8))
+    
+    XCTAssertNotEqual(first.stringValue, second.stringValue)
+  }
+  
+  func testFingerprintsArePersisted() {
+    var state = FeedState()
+    state.bodyFingerprint = FeedFingerprint(seed: "body").stringValue
+    state.itemsFingerprint = FeedFingerprint(seed: "items").stringValue
+    
+    let restoredState = FeedState(dictionary: state.dictionaryRepresentation)
+    XCTAssertEqual(restoredState.bodyFingerprint, state.bodyFingerprint)
+    XCTAssertEqual(restoredState.itemsFingerprint, state.itemsFingerprint)
+  }
+}
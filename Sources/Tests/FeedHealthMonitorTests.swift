@@ -0,0 +1,51 @@
+import XCTest
+@testable import Catch
+
+
+private let feed = Feed(name: "Feed", url: URL(string: "https://example.com/feed.xml")!)
+private let otherFeed = Feed(name: "Other Feed", url: URL(string: "https://example.org/feed.xml")!)
+private let now = Date(timeIntervalSince1970: 1_000_000)
+private let error = NSError(domain: feedHelperErrorDomain, code: -5)
+
+
+class FeedHealthMonitorTests: XCTestCase {
+  func testFeedsAreSkippedAfterRepeatedFailures() {
+    let monitor = FeedHealthMonitor()
+    
+    monitor.feedDidFail(feed, error: error, latency: 1, at: now)
+    monitor.feedDidFail(feed, error: error, latency: 1, at: now)
+    XCTAssertTrue(monitor.allowsCheck(of: feed, at: now))
+    
+    monitor.feedDidFail(feed, error: error, latency: 1, at: now)
+    XCTAssertFalse(monitor.allowsCheck(of: feed, at: now))
+    XCTAssertTrue(monitor.allowsCheck(of: feed, at: now + 60 * 30))
+    
+    // Other feeds are unaffected
+    XCTAssertTrue(monitor.allowsCheck(of: otherFeed, at: now))
+  }
+  
+  func testCooldownGrowsWhileFeedKeepsFailing() {
+    let monitor = FeedHealthMonitor()
+    for _ in 1...4 {
+      monitor.feedDidFail(feed, error: error, latency: 1, at: now)
+    }
+    
+    XCTAssertEqual(monitor.health(of: feed).skippedUntil, now + 60 * 60)
+  }
+  
+  func testSuccessResetsHealth() {
+    let monitor = FeedHealthMonitor()
+    for _ in 1...3 {
+      monitor.feedDidFail(feed, error: error, latency: 1, at: now)
+    }
+    monitor.feedWasChecked(feed, latency: 2, at: now + 60 * 30)
+    
+    let health = monitor.health(of: feed)
+    XCTAssertEqual(health.consecutiveFailures, 0)
+    XCTAssertNil(health.skippedUntil)
+    XCTAssertEqual(health.lastSuccessDate, now + 60 * 30)
+    XCTAssertEqual(health.lastLatency, 2)
+    XCTAssertEqual(health.lastFailure?.date, now)
+    XCTAssertTrue(monitor.allowsCheck(of: feed, at: now + 60 * 30))
+  }
+}
@@ -0,0 +1,100 @@
+import XCTest
+@testable import Catch
+
+
+private let feeds = (1...5).map {
+  Feed(name: "Feed \($0)", url: URL(string: "https://example.com/feeds/\($0).xml?user=12345&key=0123456789abcdef")!)
+}
+
+
+/// A large report, like the one for a first check of several busy feeds
+private let report = FeedCheckReport(
+  downloadedEpisodes: (1...500).map { number in
+    DownloadedEpisode(
+      episode: Episode(
+        title: "Some Show S01E\(number) 720p",
+        url: URL(string: "https://example.com/torrents/\(number).torrent")!,
+        showName: "Some Show",
+        feed: feeds[number % feeds.count]
+      ),
+      localURL: URL(fileURLWithPath: "/Users/someone/Downloads/Some Show S01E\(number) 720p.torrent")
+    )
+  },
+  failures: [
+    FeedCheckReport.Failure(
+      feed: feeds[0],
+      error: NSError(domain: feedHelperErrorDomain, code: -1, userInfo: [NSLocalizedDescriptionKey: "Could not download feed"])
+    )
+  ],
+  episodeFailures: []
+)
+
+
+/// What the same episodes used to be sent as
+private func dictionaryPayload(_ report: FeedCheckReport) throws -> Data {
+  return try PropertyListSerialization.data(
+    fromPropertyList: report.downloadedEpisodes.map { downloadedEpisode -> [AnyHashable:Any] in
+      var dictionary = downloadedEpisode.episode.dictionaryRepresentation
+      dictionary["localURL"] = downloadedEpisode.localURL?.absoluteString
+      return dictionary
+    },
+    format: .binary,
+    options: 0
+  )
+}
+
+
+class FeedHelperPayloadTests: XCTestCase {
+  func testReportRoundTrip() throws {
+    let decodedReport = try FeedHelperPayload.decode(FeedCheckReport.self, from: FeedHelperPayload.encode(report))
+    
+    XCTAssertEqual(decodedReport.downloadedEpisodes.map(\.episode), report.downloadedEpisodes.map(\.episode))
+    XCTAssertEqual(decodedReport.downloadedEpisodes.map(\.localURL), report.downloadedEpisodes.map(\.localURL))
+    XCTAssertEqual(decodedReport.failures.map(\.feed), report.failures.map(\.feed))
+    XCTAssertEqual(decodedReport.failures.first?.error.localizedDescription, "Could not download feed")
+    XCTAssertTrue(decodedReport.episodeFailures.isEmpty)
+  }
+  
+  func testFeedsAreEncodedOnce() throws {
+    let payload = try FeedHelperPayload.encode(report)
+    
+    XCTAssertLessThan(payload.count, try dictionaryPayload(report).count)
+  }
+  
+  func testDictionaryEncodingPerformance() {
+    measure {
+      for _ in 1...10 {
+        _ = try! dictionaryPayload(report)
+      }
+    }
+  }
+  
+  func testPayloadEncodingPerformance() {
+    measure {
+      for _ in 1...10 {
+        _ = try! FeedHelperPayload.encode(report)
+      }
+    }
+  }
+  
+  func testDictionaryDecodingPerformance() throws {
+    let payload = try dictionaryPayload(report)
+    
+    measure {
+      for _ in 1...10 {
+        let rawEpisodes = try! PropertyListSerialization.propertyList(from: payload, format: nil) as! [[AnyHashable:Any]]
+        _ = rawEpisodes.map { Episode(dictionary: $0)! }
+      }
+    }
+  }
+  
+  func testPayloadDecodingPerformance() throws {
+    let payload = try FeedHelperPayload.encode(report)
+    
+    measure {
+      for _ in 1...10 {
+        _ = try! FeedHelperPayload.decode(FeedCheckReport.self, from: payload)
+      }
+    }
+  }
+}
@@ -0,0 +1,230 @@
+import XCTest
+@testable import Catch
+
+
+private let testFeed = Feed(name: "Test", url: URL(string: "https://example.com/feed.xml")!)
+
+
+/// Feeds that both parsing modes should agree on, covering the quirks of the
+/// XPath queries the DOM parser uses.
+private let corpus: [String:String] = [
+  "rss enclosures": """
+    <?xml version="1.0" encoding="UTF-8"?>
+    <rss version="2.0">
+      <channel>
+        <title>Channel titles are not episodes</title>
+        <item>
+          <title>Show A S01E01 720p</title>
+          <link>https://example.com/a/1</link>
+          <enclosure url="https://example.com/a/1.torrent" length="1234" type="application/x-bittorrent"/>
+        </item>
+        <item>
+          <title>Show A S01E02 720p</title>
+          <enclosure url="https://example.com/a/2-first.torrent"/>
+          <enclosure url="https://example.com/a/2-last.torrent"/>
+        </item>
+      </channel>
+    </rss>
+    """,
+  "showrss tv namespace": """
+    <?xml version="1.0" encoding="UTF-8"?>
+    <rss version="2.0" xmlns:tv="https://showrss.info">
+      <channel>
+        <item>
+          <title>Show B 3x04 Episode Title</title>
+          <link>magnet:?xt=urn:btih:0123456789ABCDEF0123456789ABCDEF01234567&amp;dn=Show+B&amp;tr=udp%3A%2F%2Ftracker.example.com%3A80</link>
+          <tv:show_id>42</tv:show_id>
+          <tv:show_name>Show B</tv:show_name>
+          <tv:episode_id>1234</tv:episode_id>
+        </item>
+        <item>
+          <title><![CDATA[Show C & Friends S02E10]]></title>
+          <link><![CDATA[magnet:?xt=urn:btih:89ABCDEF0123456789ABCDEF0123456789ABCDEF]]></link>
+          <tv:show_name><![CDATA[Show C & Friends]]></tv:show_name>
+        </item>
+      </channel>
+    </rss>
+    """,
+  "atom links": """
+    <?xml version="1.0" encoding="utf-8"?>
+    <feed xmlns="http://www.w3.org/2005/Atom">
+      <title>Atom feed</title>
+      <link href="https://example.com/"/>
+      <entry>
+        <title>Show D S05E06</title>
+        <link rel="alternate" href="https://example.com/d/6.torrent"/>
+      </entry>
+      <entry>
+        <title type="html">Show D S05E07 &lt;b&gt;PROPER&lt;/b&gt;</title>
+        <link rel="alternate" href="https://example.com/d/7-page"/>
+        <link rel="enclosure" href="https://example.com/d/7.torrent"/>
+      </entry>
+    </feed>
+    """,
+  "invalid items are skipped": """
+    <?xml version="1.0" encoding="UTF-8"?>
+    <rss version="2.0">
+      <channel>
+        <item>
+          <title>No URL at all</title>
+        </item>
+        <item>
+          <link>https://example.com/no-title.torrent</link>
+        </item>
+        <item>
+          <title></title>
+          <link>https://example.com/empty-title.torrent</link>
+        </item>
+        <item>
+          <title>Empty URL</title>
+          <link></link>
+        </item>
+        <item>
+          <title>Valid after invalid ones</title>
+          <link>https://example.com/valid.torrent</link>
+        </item>
+      </channel>
+    </rss>
+    """,
+  "only direct children count": """
+    <?xml version="1.0" encoding="UTF-8"?>
+    <rss version="2.0">
+      <channel>
+        <item>
+          <title>Outer <i>title</i> with markup</title>
+          <description>
+            <title>Nested title is ignored</title>
+            <link>https://example.com/nested.torrent</link>
+          </description>
+          <link>
+            https://example.com/whitespace.torrent
+          </link>
+          <link>https://example.com/last-link.torrent</link>
+        </item>
+      </channel>
+      <item>
+        <title>Items outside of a channel are ignored</title>
+        <link>https://example.com/ignored.torrent</link>
+      </item>
+    </rss>
+    """,
+  "no items": """
+    <?xml version="1.0" encoding="UTF-8"?>
+    <rss version="2.0"><channel><title>Empty</title></channel></rss>
+    """
+]
+
+
+class FeedParserTests: XCTestCase {
+  func testStreamingParserMatchesDocumentParser() throws {
+    for (name, xml) in corpus {
+      let feedContents = xml.data(using: .utf8)!
+      
+      let documentEpisodes = try FeedParser.parse(feed: testFeed, feedContents: feedContents, mode: .document)
+      let streamingEpisodes = try FeedParser.parse(feed: testFeed, feedContents: feedContents, mode: .streaming)
+      
+      XCTAssertEqual(documentEpisodes, streamingEpisodes, name)
+    }
+  }
+  
+  func testExtractedValues() throws {
+    let feedContents = corpus["showrss tv namespace"]!.data(using: .utf8)!
+    let episodes = try FeedParser.parse(feed: testFeed, feedContents: feedContents, mode: .streaming)
+    
+    XCTAssertEqual(episodes.map(\.title), ["Show B 3x04 Episode Title", "Show C & Friends S02E10"])
+    XCTAssertEqual(episodes.map(\.showName), ["Show B", "Show C & Friends"])
+    XCTAssertTrue(episodes.allSatisfy { $0.url.isMagnetLink })
+    XCTAssertTrue(episodes.allSatisfy { $0.feed == testFeed })
+  }
+  
+  func testLastMatchingElementWins() throws {
+    let feedContents = corpus["rss enclosures"]!.data(using: .utf8)!
+    let episodes = try FeedParser.parse(feed: testFeed, feedContents: feedContents, mode: .streaming)
+    
+    XCTAssertEqual(episodes.map(\.url.absoluteString), [
+      "https://example.com/a/1.torrent",
+      "https://example.com/a/2-last.torrent"
+    ])
+  }
+  
+  func testInvalidItemsAreSkipped() throws {
+    let feedContents = corpus["invalid items are skipped"]!.data(using: .utf8)!
+    let episodes = try FeedParser.parse(feed: testFeed, feedContents: feedContents, mode: .streaming)
+    
+    XCTAssertEqual(episodes.map(\.title), ["Valid after invalid ones"])
+  }
+  
+  func testMalformedFeedsThrow() {
+    let feedContents = "<rss><channel><item></channel>".data(using: .utf8)!
+    
+    XCTAssertThrowsError(try FeedParser.parse(feed: testFeed, feedContents: feedContents, mode: .document))
+    XCTAssertThrowsError(try FeedParser.parse(feed: testFeed, feedContents: feedContents, mode: .streaming))
+  }
+  
+  func testParsingStopsWhenAsked() throws {
+    let feedContents = corpus["rss enclosures"]!.data(using: .utf8)!
+    
+    for mode in [FeedParser.Mode.document, .streaming] {
+      var seenItems = 0
+      let episodes = try FeedParser.parse(feed: testFeed, feedContents: feedContents, mode: mode) { _ in
+        seenItems += 1
+        return seenItems < 2
+      }
+      
+      XCTAssertEqual(episodes.map(\.url.absoluteString), ["https://example.com/a/1.torrent"])
+      XCTAssertEqual(seenItems, 2)
+    }
+  }
+  
+  func testIncrementalScanStopsAtPreviousNewestItem() throws {
+    let feedContents = datedFeed(urls: ["new-2", "new-1", "old-2", "old-1"]).data(using: .utf8)!
+    let previousState = FeedState(newestItemURLs: ["https://example.com/old-2", "https://example.com/old-1"], isNewestFirst: true)
+    
+    let scan = IncrementalFeedScan(previousState: previousState, isEnabled: true)
+    let episodes = try FeedParser.parse(feed: testFeed, feedContents: feedContents, while: scan.shouldContinue)
+    
+    XCTAssertEqual(episodes.map(\.title), ["new-2", "new-1"])
+    XCTAssertFalse(scan.needsFullScan)
+    XCTAssertEqual(scan.updatedState.newestItemURLs, [
+      "https://example.com/new-2",
+      "https://example.com/new-1",
+      "https://example.com/old-2",
+      "https://example.com/old-1"
+    ])
+  }
+  
+  func testIncrementalScanFallsBackWhenNewestItemIsGone() throws {
+    let feedContents = datedFeed(urls: ["new-1", "old-1"]).data(using: .utf8)!
+    let previousState = FeedState(newestItemURLs: ["https://example.com/old-2", "https://example.com/old-1"], isNewestFirst: true)
+    
+    let scan = IncrementalFeedScan(previousState: previousState, isEnabled: true)
+    _ = try FeedParser.parse(feed: testFeed, feedContents: feedContents, while: scan.shouldContinue)
+    
+    XCTAssertTrue(scan.needsFullScan)
+  }
+  
+  func testFullScanDetectsItemOrder() throws {
+    let newestFirst = IncrementalFeedScan(previousState: FeedState(), isEnabled: true)
+    _ = try FeedParser.parse(feed: testFeed, feedContents: datedFeed(urls: ["3", "2", "1"]).data(using: .utf8)!, while: newestFirst.shouldContinue)
+    XCTAssertTrue(newestFirst.updatedState.isNewestFirst)
+    
+    let oldestFirst = IncrementalFeedScan(previousState: FeedState(), isEnabled: true)
+    _ = try FeedParser.parse(feed: testFeed, feedContents: datedFeed(urls: ["1", "2", "3"], oldestFirst: true).data(using: .utf8)!, while: oldestFirst.shouldContinue)
+    XCTAssertFalse(oldestFirst.updatedState.isNewestFirst)
+  }
+  
+  /// An RSS feed with one item per URL (also used as title), one day apart
+  private func datedFeed(urls: [String], oldestFirst: Bool = false) -> String {
+    let items = urls.enumerated().map { index, url -> String in
+      let day = oldestFirst ? index + 1 : urls.count - index
+      return """
+        <item>
+          <title>\(url)</title>
+          <link>https://example.com/\(url)</link>
+          <pubDate>\(String(format: "%02d", day)) Jan 2021 12:00:00 +0000</pubDate>
+        </item>
+        """
+    }
+    return "<rss version=\"2.0\"><channel>\(items.joined())</channel></rss>"
+  }
+}
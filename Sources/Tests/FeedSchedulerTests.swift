@@ -0,0 +1,95 @@
+import XCTest
+@testable import Catch
+
+
+private let feed = Feed(name: "Feed", url: URL(string: "https://example.com/feed.xml")!)
+private let now = Date(timeIntervalSince1970: 1_000_000)
+
+
+private func minutes(_ minutes: TimeInterval) -> TimeInterval {
+  return minutes * 60
+}
+
+
+class FeedSchedulerTests: XCTestCase {
+  func testNewFeedsAreDue() {
+    let scheduler = FeedScheduler()
+    
+    XCTAssertEqual(scheduler.dueFeeds(among: [feed], at: now), [feed])
+  }
+  
+  func testFeedsWithUnknownCadenceUseDefaultInterval() {
+    let scheduler = FeedScheduler()
+    scheduler.feedWasChecked(FeedCheckReport.SchedulingHint(feed: feed), at: now)
+    
+    XCTAssertEqual(scheduler.dueFeeds(among: [feed], at: now + minutes(9)), [])
+    XCTAssertEqual(scheduler.dueFeeds(among: [feed], at: now + minutes(10)), [feed])
+  }
+  
+  func testSchedulesFollowFeedsWhoseURLIsWrittenDifferently() {
+    let scheduler = FeedScheduler()
+    scheduler.feedWasChecked(FeedCheckReport.SchedulingHint(feed: feed), at: now)
+    let sameFeed = Feed(name: "Renamed", url: URL(string: "HTTPS://Example.com:443/feed.xml#top")!)
+    
+    XCTAssertEqual(scheduler.dueFeeds(among: [sameFeed], at: now + minutes(9)), [])
+    
+    scheduler.removeFeeds(notIn: [sameFeed])
+    XCTAssertNotNil(scheduler.nextCheckDate(for: feed))
+  }
+  
+  func testActiveFeedsAreCheckedMoreOften() {
+    let hint = FeedCheckReport.SchedulingHint(
+      feed: feed,
+      latestPublicationDate: now - minutes(5),
+      publicationInterval: minutes(30)
+    )
+    
+    XCTAssertEqual(FeedScheduler.checkInterval(for: hint, at: now), minutes(7.5))
+  }
+  
+  func testDormantFeedsAreCheckedLessOften() {
+    let hint = FeedCheckReport.SchedulingHint(
+      feed: feed,
+      latestPublicationDate: now - minutes(60 * 24 * 30),
+      publicationInterval: minutes(30)
+    )
+    
+    XCTAssertEqual(FeedScheduler.checkInterval(for: hint, at: now), minutes(120))
+  }
+  
+  func testTimeToLiveIsHonored() {
+    let hint = FeedCheckReport.SchedulingHint(
+      feed: feed,
+      timeToLive: minutes(60),
+      latestPublicationDate: now - minutes(5),
+      publicationInterval: minutes(30)
+    )
+    
+    XCTAssertEqual(FeedScheduler.checkInterval(for: hint, at: now), minutes(60))
+  }
+  
+  func testFailingFeedsBackOffExponentially() {
+    let scheduler = FeedScheduler()
+    
+    scheduler.feedDidFail(feed, hint: nil, at: now)
+    XCTAssertEqual(scheduler.nextCheckDate(for: feed), now + minutes(10))
+    
+    scheduler.feedDidFail(feed, hint: nil, at: now)
+    XCTAssertEqual(scheduler.nextCheckDate(for: feed), now + minutes(20))
+    
+    scheduler.feedDidFail(feed, hint: nil, at: now)
+    XCTAssertEqual(scheduler.nextCheckDate(for: feed), now + minutes(40))
+    
+    // Success resets the backoff
+    scheduler.feedWasChecked(FeedCheckReport.SchedulingHint(feed: feed), at: now)
+    scheduler.feedDidFail(feed, hint: nil, at: now)
+    XCTAssertEqual(scheduler.nextCheckDate(for: feed), now + minutes(10))
+  }
+  
+  func testRetryAfterIsHonored() {
+    let scheduler = FeedScheduler()
+    scheduler.feedDidFail(feed, hint: FeedCheckReport.SchedulingHint(feed: feed, retryAfter: minutes(90)), at: now)
+    
+    XCTAssertEqual(scheduler.nextCheckDate(for: feed), now + minutes(90))
+  }
+}
@@ -0,0 +1,74 @@
+import XCTest
+@testable import Catch
+
+
+class HelperSessionTests: XCTestCase {
+  private var session: URLSession!
+  
+  override func setUp() {
+    super.setUp()
+    let configuration = URLSessionConfiguration.helper
+    configuration.protocolClasses = [SyntheticFeedURLProtocol.self]
+    session = URLSession(configuration: configuration, delegate: SessionTaskDelegate(), delegateQueue: nil)
+  }
+  
+  override func tearDown() {
+    session.invalidateAndCancel()
+    super.tearDown()
+  }
+  
+  func testDownloadCollectsDataAndMetrics() throws {
+    let request = URLRequest(url: URL(string: "synthetic://feeds/rss/10")!)
+    let (response, data, taskMetrics) = try session.downloadSynchronouslyCollectingMetrics(request: request)
+    
+    XCTAssertEqual((response as? HTTPURLResponse)?.statusCode, 200)
+    XCTAssertEqual(data, SyntheticInputs.rssFeed(itemCount: 10, usesTVNamespace: false))
+    XCTAssertNotNil(taskMetrics)
+  }
+  
+  func testResponsesOverMaxSizeAreRejected() {
+    let request = URLRequest(url: URL(string: "synthetic://feeds/rss/1000")!)
+    
+    XCTAssertThrowsError(try session.downloadSynchronously(request: request, maxResponseSize: 1024)) { error in
+      XCTAssertEqual((error as? URLError)?.code, .dataLengthExceedsMaximum)
+    }
+  }
+  
+  func testFileDownloadsAreStreamedToDisk() throws {
+    let fileURL = FileManager.default.temporaryDirectory.appendingPathComponent(UUID().uuidString)
+    defer { try? FileManager.default.removeItem(at: fileURL) }
+    
+    let request = URLRequest(url: URL(string: "synthetic://feeds/atom/10")!)
+    let response = try session.downloadFileSynchronously(request: request, to: fileURL)
+    
+    XCTAssertEqual((response as? HTTPURLResponse)?.statusCode, 200)
+    XCTAssertEqual(try Data(contentsOf: fileURL), SyntheticInputs.atomFeed(itemCount: 10))
+  }
+  
+  func testFileDownloadsOverMaxSizeAreRejected() {
+    let fileURL = FileManager.default.temporaryDirectory.appendingPathComponent(UUID().uuidString)
+    defer { try? FileManager.default.removeItem(at: fileURL) }
+    
+    let request = URLRequest(url: URL(string: "synthetic://feeds/atom/1000")!)
+    
+    XCTAssertThrowsError(try session.downloadFileSynchronously(request: request, to: fileURL, maxResponseSize: 1024)) { error in
+      XCTAssertEqual((error as? URLError)?.code, .dataLengthExceedsMaximum)
+    }
+  }
+  
+  func testCancelledDownloadsFail() {
+    let cancellation = CancellationToken()
+    cancellation.cancel()
+    
+    let request = URLRequest(url: URL(string: "synthetic://feeds/rss/10")!)
+    
+    XCTAssertThrowsError(try session.downloadSynchronouslyCollectingMetrics(request: request, cancellation: cancellation)) { error in
+      XCTAssertEqual((error as? URLError)?.code, .cancelled)
+    }
+  }
+  
+  func testAcceptsCompressedResponses() {
+    let acceptEncoding = URLSessionConfiguration.helper.httpAdditionalHeaders?["Accept-Encoding"] as? String
+    XCTAssertTrue(acceptEncoding?.contains("gzip") ?? false)
+  }
+}
@@ -0,0 +1,75 @@
+import XCTest
+@testable import Catch
+
+
+private func historyItem(_ number: Int) -> HistoryItem {
+  return HistoryItem(
+    episode: Episode(
+      title: "Episode \(number)",
+      url: URL(string: "https://example.com/\(number).torrent")!,
+      showName: number.isMultiple(of: 2) ? "Show" : nil,
+      feed: Feed(name: "Feed", url: URL(string: "https://example.com/feed.xml")!)
+    ),
+    downloadDate: Date(timeIntervalSince1970: TimeInterval(number) * 1000)
+  )
+}
+
+
+class HistoryStoreTests: XCTestCase {
+  private var fileURL: URL!
+  
+  override func setUp() {
+    super.setUp()
+    fileURL = FileManager.default.temporaryDirectory
+      .appendingPathComponent(UUID().uuidString)
+      .appendingPathComponent("History.log")
+  }
+  
+  override func tearDown() {
+    try? FileManager.default.removeItem(at: fileURL.deletingLastPathComponent())
+    super.tearDown()
+  }
+  
+  func testAppendedItemsAreLoaded() {
+    let store = HistoryStore(fileURL: fileURL)
+    store.append([historyItem(1), historyItem(2)])
+    store.append([historyItem(3)])
+    store.flush()
+    
+    XCTAssertEqual(HistoryStore(fileURL: fileURL).load(), [historyItem(1), historyItem(2), historyItem(3)])
+  }
+  
+  func testRemovalsAndDuplicatesAreReplayed() {
+    let store = HistoryStore(fileURL: fileURL)
+    store.append([historyItem(1), historyItem(2), historyItem(3)])
+    store.remove([historyItem(2)])
+    store.append([historyItem(1), historyItem(4)])
+    store.flush()
+    
+    XCTAssertEqual(HistoryStore(fileURL: fileURL).load(), [historyItem(1), historyItem(3), historyItem(4)])
+  }
+  
+  func testDuplicatesStayMarked() {
+    var duplicateItem = historyItem(2)
+    duplicateItem.isDuplicate = true
+    
+    let store = HistoryStore(fileURL: fileURL)
+    store.append([historyItem(1), duplicateItem])
+    store.flush()
+    
+    XCTAssertEqual(HistoryStore(fileURL: fileURL).load().map { $0.isDuplicate }, [false, true])
+  }
+  
+  func testCompactionKeepsOnlyLiveItems() throws {
+    let store = HistoryStore(fileURL: fileURL)
+    store.append((1...300).map(historyItem))
+    store.remove((1...290).map(historyItem))
+    let liveItems = (291...300).map(historyItem)
+    store.compactIfNeeded(liveItems: liveItems)
+    store.flush()
+    
+    let lines = try String(contentsOf: fileURL).split(separator: "\n")
+    XCTAssertEqual(lines.count, liveItems.count)
+    XCTAssertEqual(HistoryStore(fileURL: fileURL).load(), liveItems)
+  }
+}
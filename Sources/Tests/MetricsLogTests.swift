@@ -0,0 +1,54 @@
+import XCTest
+@testable import Catch
+
+
+class MetricsLogTests: XCTestCase {
+  private var fileURL: URL!
+  
+  override func setUp() {
+    super.setUp()
+    fileURL = FileManager.default.temporaryDirectory
+      .appendingPathComponent(UUID().uuidString)
+      .appendingPathComponent("Metrics.log")
+  }
+  
+  override func tearDown() {
+    try? FileManager.default.removeItem(at: fileURL.deletingLastPathComponent())
+    super.tearDown()
+  }
+  
+  func testRecordsAreWrittenAsJSONLines() throws {
+    var feedMetrics = FeedMetrics(feed: Feed(name: "Feed", url: URL(string: "https://example.com/feed.xml")!))
+    feedMetrics.parseDuration = 0.25
+    feedMetrics.itemCount = 42
+    
+    let log = MetricsLog(fileURL: fileURL)
+    log.append(MetricsLog.Record(date: Date(timeIntervalSince1970: 1000), call: .checkFeeds, roundTripDuration: 1.5, succeeded: true, feeds: [feedMetrics]))
+    log.append(MetricsLog.Record(date: Date(timeIntervalSince1970: 2000), call: .downloadFeed, roundTripDuration: 0.5, succeeded: false))
+    log.flush()
+    
+    let lines = try String(contentsOf: fileURL).split(separator: "\n")
+    XCTAssertEqual(lines.count, 2)
+    
+    let decoder = JSONDecoder()
+    decoder.dateDecodingStrategy = .secondsSince1970
+    let records = try lines.map { try decoder.decode(MetricsLog.Record.self, from: Data($0.utf8)) }
+    XCTAssertEqual(records.map(\.call), [.checkFeeds, .downloadFeed])
+    XCTAssertEqual(records[0].date, Date(timeIntervalSince1970: 1000))
+    XCTAssertEqual(records[0].feeds?.first?.itemCount, 42)
+    XCTAssertEqual(records[0].feeds?.first?.parseDuration, 0.25)
+    XCTAssertNil(records[1].feeds)
+  }
+  
+  func testBigLogsAreRotated() throws {
+    try FileManager.default.createDirectory(at: fileURL.deletingLastPathComponent(), withIntermediateDirectories: true)
+    try Data(count: 2 * 1024 * 1024).write(to: fileURL)
+    
+    let log = MetricsLog(fileURL: fileURL)
+    log.append(MetricsLog.Record(date: Date(), call: .downloadEpisode, roundTripDuration: 0.1, succeeded: true))
+    log.flush()
+    
+    XCTAssertEqual(try String(contentsOf: fileURL).split(separator: "\n").count, 1)
+    XCTAssertTrue(FileManager.default.fileExists(atPath: fileURL.appendingPathExtension("1").path))
+  }
+}
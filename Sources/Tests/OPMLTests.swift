@@ -0,0 +1,70 @@
+import XCTest
+@testable import Catch
+
+
+private let opml = """
+  <?xml version="1.0" encoding="UTF-8"?>
+  <opml version="1.0">
+    <head><title>Subscriptions</title></head>
+    <body>
+      <outline text="Top level" type="rss" xmlUrl="https://example.com/top.xml"/>
+      <outline text="TV">
+        <outline title="Dramas">
+          <outline title="Drama &amp; more" text="ignored" xmlUrl="https://example.com/drama.xml"/>
+          <outline title="Same feed" xmlUrl="https://Example.com:443/drama.xml/#fragment"/>
+        </outline>
+        <outline text="Comedy" xmlUrl="https://example.com/comedy.xml"/>
+        <outline text="Not a feed URL" xmlUrl="ftp://example.com/feed.xml"/>
+        <outline xmlUrl="https://example.com/untitled.xml"/>
+      </outline>
+    </body>
+  </opml>
+  """.data(using: .utf8)!
+
+
+class OPMLTests: XCTestCase {
+  func testImport() throws {
+    let result = try OPMLParser().importFeeds(opml: opml)
+    
+    XCTAssertEqual(result.feeds, [
+      Feed(name: "Top level", url: URL(string: "https://example.com/top.xml")!),
+      Feed(name: "Drama & more", url: URL(string: "https://example.com/drama.xml")!, folder: ["TV", "Dramas"]),
+      Feed(name: "Comedy", url: URL(string: "https://example.com/comedy.xml")!, folder: ["TV"])
+    ])
+    XCTAssertEqual(result.duplicateCount, 1)
+    XCTAssertEqual(result.invalidEntries.map(\.reason), ["Invalid feed URL", "Missing feed title"])
+    XCTAssertEqual(result.invalidEntries.map(\.line), [12, 13])
+  }
+  
+  func testExportKeepsFoldersAndRoundTrips() throws {
+    let feeds = try OPMLParser().parse(opml: opml)
+    let exported = OPMLSerializer().serialize(feeds: feeds)
+    
+    XCTAssertEqual(try OPMLParser().parse(opml: exported), feeds)
+    
+    // Also readable as a document
+    let document = try XMLDocument(data: exported)
+    XCTAssertEqual(try document.nodes(forXPath: "/opml/body/outline[@title='TV']/outline[@title='Dramas']/outline/@xmlUrl").map(\.stringValue), [
+      "https://example.com/drama.xml"
+    ])
+  }
+  
+  func testFeedKeys() {
+    let key = URL(string: "https://example.com/rss?user=1")!.feedKey
+    
+    XCTAssertEqual(URL(string: "HTTPS://EXAMPLE.com:443/rss/?user=1#top")!.feedKey, key)
+    XCTAssertNotEqual(URL(string: "https://example.com:8443/rss?user=1")!.feedKey, key)
+    XCTAssertNotEqual(URL(string: "https://example.com/rss?user=2")!.feedKey, key)
+    XCTAssertEqual(URL(string: "http://example.com/")!.feedKey, URL(string: "http://example.com")!.feedKey)
+  }
+  
+  func testFeedIDFollowsURL() throws {
+    var feed = Feed(name: "Test", url: URL(string: "https://example.com/rss?user=1")!)
+    XCTAssertEqual(feed.id, feed.url.feedKey)
+    
+    feed.url = URL(string: "https://example.com/rss?user=2")!
+    XCTAssertEqual(feed.id, feed.url.feedKey)
+    XCTAssertEqual(Feed(dictionary: feed.dictionaryRepresentation)?.id, feed.id)
+    XCTAssertEqual(try FeedHelperPayload.decode(Feed.self, from: FeedHelperPayload.encode(feed)).id, feed.id)
+  }
+}
@@ -0,0 +1,125 @@
+import XCTest
+@testable import Catch
+
+
+private func historyItem(_ urlString: String, daysAgo: Double = 0) -> HistoryItem {
+  return HistoryItem(
+    episode: Episode(title: urlString, url: URL(string: urlString)!, showName: nil, feed: nil),
+    downloadDate: Date(timeIntervalSinceNow: -daysAgo * 24 * 60 * 60)
+  )
+}
+
+
+class SeenEpisodeSyncTests: XCTestCase {
+  func testFirstUpdateIsSnapshot() {
+    let sync = SeenEpisodeSync()
+    let update = sync.makeUpdate(history: [historyItem("https://example.com/1.torrent")])
+    
+    XCTAssertTrue(update.isSnapshot)
+    XCTAssertEqual(Set(update.added.keys), ["https://example.com/1.torrent"])
+    XCTAssertTrue(update.removed.isEmpty)
+  }
+  
+  func testAppliedUpdatesAreFollowedByDeltas() {
+    let sync = SeenEpisodeSync()
+    let first = sync.makeUpdate(history: [historyItem("https://example.com/1.torrent"), historyItem("https://example.com/2.torrent")])
+    sync.updateWasApplied()
+    
+    sync.historyDidChange(DownloadHistoryChange(
+      inserted: [historyItem("https://example.com/3.torrent")],
+      removed: [historyItem("https://example.com/1.torrent")]
+    ))
+    let second = sync.makeUpdate(history: [HistoryItem]())
+    
+    XCTAssertEqual(second.generation, first.generation)
+    XCTAssertEqual(second.baseRevision, first.revision)
+    XCTAssertEqual(Set(second.added.keys), ["https://example.com/3.torrent"])
+    XCTAssertEqual(second.removed, ["https://example.com/1.torrent"])
+  }
+  
+  func testUnappliedUpdatesAreFollowedBySnapshots() {
+    let sync = SeenEpisodeSync()
+    _ = sync.makeUpdate(history: [historyItem("https://example.com/1.torrent")])
+    sync.updateWasApplied()
+    sync.historyDidChange(DownloadHistoryChange(
+      inserted: [historyItem("https://example.com/2.torrent")],
+      removed: [historyItem("https://example.com/1.torrent")]
+    ))
+    _ = sync.makeUpdate(history: [HistoryItem]())
+    sync.updateWasNotApplied()
+    
+    let update = sync.makeUpdate(history: [HistoryItem]())
+    
+    XCTAssertTrue(update.isSnapshot)
+    XCTAssertEqual(Set(update.added.keys), ["https://example.com/2.torrent"])
+  }
+  
+  func testUnchangedHistoryIsNotReadAgain() {
+    let sync = SeenEpisodeSync()
+    _ = sync.makeUpdate(history: [historyItem("https://example.com/1.torrent")])
+    sync.updateWasApplied()
+    
+    var historyWasRead = false
+    let update = sync.makeUpdate(history: { () -> [HistoryItem] in
+      historyWasRead = true
+      return []
+    }())
+    
+    XCTAssertFalse(update.isSnapshot)
+    XCTAssertTrue(update.added.isEmpty)
+    XCTAssertTrue(update.removed.isEmpty)
+    XCTAssertFalse(historyWasRead)
+  }
+  
+  func testKeysSharedByOtherItemsAreKept() {
+    let sync = SeenEpisodeSync()
+    let torrent = historyItem("https://example.com/abcdef0123456789abcdef0123456789abcdef01.torrent")
+    let magnet = historyItem("magnet:?xt=urn:btih:abcdef0123456789abcdef0123456789abcdef01")
+    _ = sync.makeUpdate(history: [torrent, magnet])
+    sync.updateWasApplied()
+    
+    sync.historyDidChange(DownloadHistoryChange(removed: [magnet]))
+    let update = sync.makeUpdate(history: [HistoryItem]())
+    
+    // The torrent file URL has the same info hash
+    XCTAssertTrue(update.removed.isEmpty)
+  }
+  
+  func testReplacedHistoryIsSentAsSnapshot() {
+    let sync = SeenEpisodeSync()
+    _ = sync.makeUpdate(history: [historyItem("https://example.com/1.torrent")])
+    sync.updateWasApplied()
+    
+    sync.historyWasReplaced()
+    let update = sync.makeUpdate(history: [historyItem("https://example.com/2.torrent")])
+    
+    XCTAssertTrue(update.isSnapshot)
+    XCTAssertEqual(Set(update.added.keys), ["https://example.com/2.torrent"])
+  }
+  
+  func testFirstSeenDateIsOldestDownload() {
+    let sync = SeenEpisodeSync()
+    let update = sync.makeUpdate(history: [
+      historyItem("magnet:?xt=urn:btih:ABCDEF&tr=udp%3A%2F%2Fone.example.com", daysAgo: 1),
+      historyItem("magnet:?xt=urn:btih:abcdef&tr=udp%3A%2F%2Ftwo.example.com", daysAgo: 3)
+    ])
+    
+    XCTAssertEqual(update.added.count, 1)
+    XCTAssertEqual(update.added["urn:btih:abcdef"]!.timeIntervalSinceNow, -3 * 24 * 60 * 60, accuracy: 60)
+  }
+  
+  func testEpisodeKeys() {
+    XCTAssertEqual(
+      URL(string: "HTTPS://Example.COM/a/1.torrent#fragment")!.episodeKey,
+      URL(string: "https://example.com/a/1.torrent")!.episodeKey
+    )
+    XCTAssertNotEqual(
+      URL(string: "https://example.com/A/1.torrent")!.episodeKey,
+      URL(string: "https://example.com/a/1.torrent")!.episodeKey
+    )
+    XCTAssertEqual(
+      URL(string: "magnet:?dn=Show&xt=urn:btih:0123ABCD&tr=udp%3A%2F%2Ftracker.example.com")!.episodeKey,
+      "urn:btih:0123abcd"
+    )
+  }
+}